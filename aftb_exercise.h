@@ -36,17 +36,36 @@ static const uint8_t exeArduPins20[] PROGMEM = {
 
 
 
-void exerciseSetPins(char* line) {
-    uint8_t i;
-    uint8_t pinCount = 24;
-    uint8_t shrZ = 1;
-    uint8_t runCnt = 0;
-    const uint8_t* arduPins = exeArduPins24;
+// The pin map of the selected package is built once by exerciseSetupPinCount()
+// and kept in RAM. On AVR the pins are grouped by ports, so that a vector is
+// applied by a few port writes instead of pinMode() and digitalWrite() per pin.
+#if defined(__AVR__)
+#define EXE_PORT_IO
+#endif
 
-    // TODO: optimise for speed - do it only once
-    if (line[20] == '\r') {
-        pinCount = 20;
-        arduPins = exeArduPins20;
+#define EXE_MAX_PINS 11
+#define EXE_MAX_PORTS 4
+
+static uint8_t exePinTotal;
+static uint8_t exePinIndex[EXE_MAX_PINS]; // index to the test pattern
+static uint8_t exePinArdu[EXE_MAX_PINS];
+static uint8_t exeShrState; // bit 0: shift register is disabled (Z), bit 1: the state is valid
+
+#ifdef EXE_PORT_IO
+static uint8_t exePortCount;
+static volatile uint8_t* exePortOut[EXE_MAX_PORTS];
+static volatile uint8_t* exePortDir[EXE_MAX_PORTS];
+static volatile uint8_t* exePortIn[EXE_MAX_PORTS];
+static uint8_t exePinPort[EXE_MAX_PINS];
+static uint8_t exePinMask[EXE_MAX_PINS];
+#endif
+
+// sets the GND pin control and the pin modes of the 20 or 24 pin IC, builds the pin map
+static void exerciseSetupPinCount(uint8_t pinCount) {
+    const uint8_t* arduPins;
+    uint8_t i = 0;
+
+    if (pinCount == 20) {
         pinMode(7, INPUT);
         digitalWrite(PIN_ZIF_GND_CTRL, HIGH); // enable GND pin
         pinMode(8, OUTPUT);
@@ -55,90 +74,176 @@ void exerciseSetPins(char* line) {
         digitalWrite(6, LOW);
         pinMode(5, OUTPUT);
         digitalWrite(5, LOW);
+        arduPins = exeArduPins20;
     } else {
-        Serial.println(line[20], DEC);
         digitalWrite(PIN_ZIF_GND_CTRL, LOW); // disable GND pin
         pinMode(7, OUTPUT);
+        arduPins = exeArduPins24;
+    }
+
+    exePinTotal = 0;
+#ifdef EXE_PORT_IO
+    exePortCount = 0;
+#endif
+    while (exePinTotal < EXE_MAX_PINS) {
+        uint8_t dataIndex = pgm_read_byte(&arduPins[i++]);
+        if (dataIndex >= pinCount) {
+            break;
+        }
+        exePinIndex[exePinTotal] = dataIndex;
+        exePinArdu[exePinTotal] = pgm_read_byte(&arduPins[i++]);
+#ifdef EXE_PORT_IO
+        {
+            uint8_t port = digitalPinToPort(exePinArdu[exePinTotal]);
+            volatile uint8_t* out = portOutputRegister(port);
+            uint8_t p = 0;
+
+            while (p < exePortCount && exePortOut[p] != out) {
+                p++;
+            }
+            if (p == exePortCount) {
+                exePortOut[p] = out;
+                exePortDir[p] = portModeRegister(port);
+                exePortIn[p] = portInputRegister(port);
+                exePortCount++;
+            }
+            exePinPort[exePinTotal] = p;
+            exePinMask[exePinTotal] = digitalPinToBitMask(exePinArdu[exePinTotal]);
+        }
+#endif
+        exePinTotal++;
     }
+    exePinCount = pinCount;
+    exeShrState = 0;
+}
+
+// sets the shift register, it is shifted only when the value changes
+static void exerciseSetShiftReg(uint8_t shrZ, uint8_t val) {
+    if (exeShrState == (0b10 | shrZ) && (shrZ || val == lastShiftRegVal)) {
+        return;
+    }
+    //all pins are in Z state - disable shift register pins
+    if (shrZ) {
+        digitalWrite(PIN_SHR_EN, HIGH);
+        lastShiftRegVal = val;
+    } else {
+        digitalWrite(PIN_SHR_EN, LOW);
+        setShiftReg(val);
+    }
+    exeShrState = 0b10 | shrZ;
+}
+
+// applies the pin states, pins[0] is the IC pin 1
+static void exerciseApplyPins(const char* pins) {
+    uint8_t i;
+    uint8_t shrZ = 1;
+    uint8_t runCnt = 0;
 
     // run up to 3 times to handle pulse pins
     while (runCnt < 3) {
         uint8_t pulseCnt = 0;
+        uint8_t shrVal = lastShiftRegVal;
+#ifdef EXE_PORT_IO
+        uint8_t dirSet[EXE_MAX_PORTS] = {0};
+        uint8_t dirClr[EXE_MAX_PORTS] = {0};
+        uint8_t outSet[EXE_MAX_PORTS] = {0};
+        uint8_t outClr[EXE_MAX_PORTS] = {0};
+        uint8_t oldSreg;
+#endif
         i = 1;
         // handle shift register values
         while (i < 9) {
-            char d = line[i];
+            char d = pins[i];
             if (d == '1') {
-                lastShiftRegVal |= 1 << (i - 1);
+                shrVal |= 1 << (i - 1);
                 shrZ = 0;
             } else if (d == '0') {
-                lastShiftRegVal &= ~(1 << (i - 1));
+                shrVal &= ~(1 << (i - 1));
                 shrZ = 0;
             } else if (d == 'p') { //falling pulse
                 // the value depends on the runCnt : 0,2 : High, 1 Low
                 if (1 == runCnt)  {
-                    lastShiftRegVal &= ~(1 << (i - 1));
+                    shrVal &= ~(1 << (i - 1));
                 } else {
-                    lastShiftRegVal |= 1 << (i - 1);
+                    shrVal |= 1 << (i - 1);
                 }
                 pulseCnt++;
                 shrZ = 0;
             } else if (d == 'P') { // rising pulse
                 // the value depends on the runCnt : 0,2 : Low, 1 High
                 if (1 == runCnt)  {
-                    lastShiftRegVal |= 1 << (i - 1);
+                    shrVal |= 1 << (i - 1);
                 } else {
-                    lastShiftRegVal &= ~(1 << (i - 1));
+                    shrVal &= ~(1 << (i - 1));
                 }
                 pulseCnt++;
                 shrZ = 0;
             }
             i++;
         }
-
-        //all pins are in Z state - disable shift register pins
-        if (shrZ) {
-            digitalWrite(PIN_SHR_EN, HIGH);
-        } else {
-            digitalWrite(PIN_SHR_EN, LOW);
-            setShiftReg(lastShiftRegVal);
-        }
+        exerciseSetShiftReg(shrZ, shrVal);
 
         // handle direct pins
-        i = 0;
-        while (1) {
-            uint8_t dataIndex;
-            uint8_t arduPin;
-            char d;
-
-            dataIndex = pgm_read_byte(&arduPins[i++]);
-            if (dataIndex >= pinCount) {
-                break;
-            }
-            arduPin = pgm_read_byte(&arduPins[i++]);
+        for (i = 0; i < exePinTotal; i++) {
+            char d = pins[exePinIndex[i]];
+            int8_t level = -1; // -1: keep, 0 / 1: output level, 2: input with pull-up
 
-            d = line[dataIndex];
             // set the regular pins (non pulsed) only in the first run
             if (0 == runCnt) {
                 if (d == '0' || d == '1') {
-                    pinMode(arduPin, OUTPUT);
-                    digitalWrite(arduPin, d == '1' ? HIGH : LOW);
-                } else if (d == 'z') {
-                    pinMode(arduPin, INPUT_PULLUP);
+                    level = d - '0';
+                } else if (d == 'z' || d == 'H' || d == 'L') { // 'H', 'L': DUT output with expected level
+                    level = 2;
                 }
             }
             if (d == 'p' || d == 'P') { // 'p' falling pulse, 'P' rising pulse
-                uint8_t level = (d - 'P') >> 5; // div by 32, 'p' starts with High level,  'P' starts with Low level
+                level = (d - 'P') >> 5; // div by 32, 'p' starts with High level,  'P' starts with Low level
                 // invert the pulse level in the second run to perform the pulse
                 if (1 == runCnt) {
                     level = 1 - level;
                 }
-                pinMode(arduPin, OUTPUT);
-                digitalWrite(arduPin, level ? HIGH : LOW);
                 pulseCnt++;
             }
             //ignore all other data characters
+            if (level < 0) {
+                continue;
+            }
+#ifdef EXE_PORT_IO
+            {
+                uint8_t p = exePinPort[i];
+                uint8_t m = exePinMask[i];
+                if (level == 2) {
+                    dirClr[p] |= m;
+                    outSet[p] |= m;
+                } else {
+                    dirSet[p] |= m;
+                    if (level) {
+                        outSet[p] |= m;
+                    } else {
+                        outClr[p] |= m;
+                    }
+                }
+            }
+#else
+            if (level == 2) {
+                pinMode(exePinArdu[i], INPUT_PULLUP);
+            } else {
+                pinMode(exePinArdu[i], OUTPUT);
+                digitalWrite(exePinArdu[i], level ? HIGH : LOW);
+            }
+#endif
+        }
+#ifdef EXE_PORT_IO
+        // new inputs are released first, the new outputs are enabled when their level is set
+        oldSreg = SREG;
+        cli();
+        for (i = 0; i < exePortCount; i++) {
+            *exePortDir[i] &= ~dirClr[i];
+            *exePortOut[i] = (*exePortOut[i] & ~outClr[i]) | outSet[i];
+            *exePortDir[i] |= dirSet[i];
         }
+        SREG = oldSreg;
+#endif
 
         // no pin is pulsed -> exit after first run
         if (0 == pulseCnt) {
@@ -151,5 +256,382 @@ void exerciseSetPins(char* line) {
         }
         runCnt++;
     }
+}
+
+// time for the DUT outputs to settle before they are sampled
+#define EXE_SETTLE_US 10
+
+// samples the pins with the expected level 'H' or 'L', returns 1 on a mismatch.
+// 'levels' receives the sampled levels, '-' for the pins that are not checked
+static uint8_t exerciseCheckPins(const char* pins, char* levels) {
+    uint8_t i;
+    uint8_t fail = 0;
+
+    memset(levels, '-', exePinCount);
+    delayMicroseconds(EXE_SETTLE_US);
+    for (i = 0; i < exePinTotal; i++) {
+        uint8_t dataIndex = exePinIndex[i];
+        char d = pins[dataIndex];
+        if (d == 'H' || d == 'L') {
+#ifdef EXE_PORT_IO
+            levels[dataIndex] = (*exePortIn[exePinPort[i]] & exePinMask[i]) ? 'H' : 'L';
+#else
+            levels[dataIndex] = digitalRead(exePinArdu[i]) ? 'H' : 'L';
+#endif
+            if (levels[dataIndex] != d) {
+                fail = 1;
+            }
+        }
+    }
+    return fail;
+}
+
+void exerciseSetPins(char* line) {
+    uint8_t pinCount = 24;
+    char levels[24];
+
+    if (line[20] == '\r') {
+        pinCount = 20;
+    } else {
+        Serial.println(line[20], DEC);
+    }
+    // configure the pins only when the package changes
+    if (pinCount != exePinCount) {
+        exerciseSetupPinCount(pinCount);
+    }
+    exerciseApplyPins(line);
+    if (exerciseCheckPins(line, levels)) {
+        printError(STATUS_EXERCISE_MISMATCH);
+        Serial.print(F("mismatch "));
+        Serial.write(levels, pinCount);
+        Serial.println();
+    }
+}
+
+// Batch mode: the PC compiles the whole script into a vector table and sends it
+// by the 'Xb' command. The table is stored in the fusemap buffer and the MCU
+// steps through it with its own timing, then prints a summary line.
+// The table starts with a header: pin count (20 or 24), pulse duration in ms
+// (16 bit LE). Then records follow, each starts with the record type:
+#define EXE_REC_PINS  1 // 6 bytes, 2 bits per pin (0:'0' 1:'1' 2:'z' 3:'x'), IC pin 1 in bits 0-1 of the 1st byte
+#define EXE_REC_PULSE 2 // as EXE_REC_PINS + 3 bytes of pulse mask: pulsed pin of value 1 is 'p', of value 0 is 'P'
+#define EXE_REC_WAIT  3 // 4 bytes, delay in ms (32 bit LE)
+#define EXE_REC_ECHO  4 // 2 bytes, index of the script's Echo line (16 bit LE), printed as '#<index>'
+#define EXE_REC_CHECK 5 // 3 bytes of mask of the checked pins + 3 bytes of expected levels (1: 'H')
+                        // of the previous vector, a mismatch is printed as '!<vector index> <levels> <expected>'
+#define EXE_REC_LOOP  6 // 2 bytes, repeat count (1 - 65535, 16 bit LE) of the records up to the matching EXE_REC_NEXT
+#define EXE_REC_NEXT  7 // no data, end of the repeated records
+#define EXE_REC_GROUP 8 // group index, pin count N (1 - IC pin count), N pin indices (the first one is the most significant bit)
+#define EXE_REC_SET   9 // index of a defined group + 24 bit LE argument: value = argument
+#define EXE_REC_COUNT 10 // value += argument
+#define EXE_REC_SHIFT 11 // value = value << 1 | argument
+#define EXE_REC_WALK  12 // value is rotated left by 1 bit, the argument is not used
+#define EXE_REC_USE   13 // 3 bytes of mask of the pins driven by their group value + 3 bytes of mask
+                         // of the pins checked for their group value, applies to the next vector
+#define EXE_HEADER_SIZE 3
+#define EXE_FEED_SIZE 512
+#define EXE_MAX_LOOPS 4
+#define EXE_MAX_GROUPS 8
+
+// the groups are kept between the tables: pin group (bits 5-7) and bit of the group value (bits 0-4)
+static uint8_t exePinGroup[24];
+static uint32_t exeGroupValue[EXE_MAX_GROUPS];
+static uint8_t exeGroupSize[EXE_MAX_GROUPS];
+
+static const char exePinChars[] PROGMEM = "01zx";
+
+// data bytes of the records, EXE_REC_GROUP has its pin count N more
+static const uint8_t exeRecSize[] PROGMEM = {0, 6, 9, 4, 2, 6, 2, 0, 2, 4, 4, 4, 4, 6};
+
+// receives the table by feed requests ('$' and 3 digit size), returns 1 on success
+static char exerciseReceiveTable(uint16_t size) {
+    uint16_t pos = 0;
+
+    while (pos < size) {
+        uint16_t chunk = size - pos;
+        size_t r;
+
+        if (chunk > EXE_FEED_SIZE) {
+            chunk = EXE_FEED_SIZE;
+        }
+        outPrint('$');
+        outPrint('0' + chunk / 100);
+        outPrint('0' + (chunk / 10) % 10);
+        outPrint('0' + chunk % 10);
+        outPrintln();
+        outFlush();
+        r = Serial.readBytes((char*) fusemap + pos, chunk);
+        if (r == 0) {
+            return 0;
+        }
+        pos += r;
+    }
+    return 1;
+}
+
+static void exerciseRunTable(uint16_t size) {
+    uint16_t pos = EXE_HEADER_SIZE;
+    uint32_t vectors = 0;
+    uint16_t fails = 0;
+    uint8_t pinCount;
+    uint32_t start;
+    char pins[24];
+    char levels[24];
+    uint8_t i;
+    uint16_t loopPos[EXE_MAX_LOOPS];
+    uint16_t loopCount[EXE_MAX_LOOPS];
+    uint8_t loopDepth = 0;
+    uint32_t useDrive = 0;
+    uint32_t useCheck = 0;
+
+    // the fuse map buffer is overwritten by the table
+    mapUploaded = 0;
+    if (size <= EXE_HEADER_SIZE || size > MAXFUSES || !exerciseReceiveTable(size)) {
+        readGarbage();
+        printError(STATUS_EXERCISE);
+        Serial.println(F("vector table upload failed"));
+        return;
+    }
+    pinCount = fusemap[0] == 20 ? 20 : 24;
+    progtime = fusemap[1] | (fusemap[2] << 8);
+    if (pinCount != exePinCount) {
+        exerciseSetupPinCount(pinCount);
+    }
+    start = millis();
+
+    while (pos < size) {
+        uint8_t rec = fusemap[pos++];
+        uint16_t len = (rec && rec <= EXE_REC_USE) ? pgm_read_byte(&exeRecSize[rec]) : size;
+
+        if (rec == EXE_REC_GROUP && pos + len <= size) {
+            len += fusemap[pos + 1];
+        }
+        // the record data must be within the table
+        if (pos + len > size) {
+            rec = 0;
+        }
+        if (rec == EXE_REC_PINS || rec == EXE_REC_PULSE) {
+            for (i = 0; i < pinCount; i++) {
+                uint8_t v = (fusemap[pos + (i >> 2)] >> ((i & 0b11) << 1)) & 0b11;
+                pins[i] = pgm_read_byte(&exePinChars[v]);
+                if (rec == EXE_REC_PULSE && (fusemap[pos + 6 + (i >> 3)] & (1 << (i & 7)))) {
+                    pins[i] = v ? 'p' : 'P';
+                }
+            }
+            pos += (rec == EXE_REC_PULSE) ? 9 : 6;
+            // the group pins are set by the group values
+            for (i = 0; useDrive && i < pinCount; i++) {
+                if (useDrive & (1UL << i)) {
+                    uint8_t g = exePinGroup[i];
+                    pins[i] = ((exeGroupValue[g >> 5] >> (g & 0x1F)) & 1) ? '1' : '0';
+                }
+            }
+            useDrive = 0;
+            exerciseApplyPins(pins);
+            vectors++;
+        } else if (rec == EXE_REC_WAIT) {
+            delay(fusemap[pos] | ((uint32_t) fusemap[pos + 1] << 8) | ((uint32_t) fusemap[pos + 2] << 16) | ((uint32_t) fusemap[pos + 3] << 24));
+            pos += 4;
+        } else if (rec == EXE_REC_CHECK) {
+            for (i = 0; i < pinCount; i++) {
+                if (fusemap[pos + (i >> 3)] & (1 << (i & 7))) {
+                    pins[i] = (fusemap[pos + 3 + (i >> 3)] & (1 << (i & 7))) ? 'H' : 'L';
+                }
+                if (useCheck & (1UL << i)) {
+                    uint8_t g = exePinGroup[i];
+                    pins[i] = ((exeGroupValue[g >> 5] >> (g & 0x1F)) & 1) ? 'H' : 'L';
+                }
+            }
+            useCheck = 0;
+            pos += 6;
+            if (exerciseCheckPins(pins, levels)) {
+                fails++;
+                Serial.print('!');
+                Serial.print(vectors - 1, DEC);
+                Serial.print(' ');
+                Serial.write(levels, pinCount);
+                Serial.print(' ');
+                Serial.write(pins, pinCount);
+                Serial.println();
+            }
+        } else if (rec == EXE_REC_ECHO) {
+            Serial.print('#');
+            Serial.println(fusemap[pos] | (fusemap[pos + 1] << 8), DEC);
+            pos += 2;
+        } else if (rec == EXE_REC_LOOP && loopDepth < EXE_MAX_LOOPS && (fusemap[pos] | fusemap[pos + 1])) {
+            loopCount[loopDepth] = fusemap[pos] | (fusemap[pos + 1] << 8);
+            pos += 2;
+            loopPos[loopDepth++] = pos;
+        } else if (rec == EXE_REC_NEXT && loopDepth) {
+            if (--loopCount[loopDepth - 1]) {
+                pos = loopPos[loopDepth - 1];
+            } else {
+                loopDepth--;
+            }
+        } else if (rec == EXE_REC_GROUP && fusemap[pos] < EXE_MAX_GROUPS &&
+                fusemap[pos + 1] && fusemap[pos + 1] <= pinCount) {
+            uint8_t g = fusemap[pos];
+            uint8_t n = fusemap[pos + 1];
+            for (i = 0; i < n; i++) {
+                exePinGroup[fusemap[pos + 2 + i] % 24] = (g << 5) | (n - 1 - i);
+            }
+            exeGroupSize[g] = n;
+            exeGroupValue[g] = 0;
+            pos += 2 + n;
+        } else if (rec >= EXE_REC_SET && rec <= EXE_REC_WALK && fusemap[pos] < EXE_MAX_GROUPS &&
+                exeGroupSize[fusemap[pos]]) {
+            uint8_t g = fusemap[pos];
+            uint32_t arg = fusemap[pos + 1] | ((uint32_t) fusemap[pos + 2] << 8) | ((uint32_t) fusemap[pos + 3] << 16);
+            uint32_t v = exeGroupValue[g];
+            if (rec == EXE_REC_SET) {
+                v = arg;
+            } else if (rec == EXE_REC_COUNT) {
+                v += arg;
+            } else if (rec == EXE_REC_SHIFT) {
+                v = (v << 1) | arg;
+            } else {
+                v = (v << 1) | (v >> (exeGroupSize[g] - 1));
+            }
+            exeGroupValue[g] = v & ((1UL << exeGroupSize[g]) - 1);
+            pos += 4;
+        } else if (rec == EXE_REC_USE) {
+            useDrive = fusemap[pos] | ((uint32_t) fusemap[pos + 1] << 8) | ((uint32_t) fusemap[pos + 2] << 16);
+            useCheck = fusemap[pos + 3] | ((uint32_t) fusemap[pos + 4] << 8) | ((uint32_t) fusemap[pos + 5] << 16);
+            pos += 6;
+        } else {
+            printError(STATUS_EXERCISE);
+            Serial.println(F("bad vector table record"));
+            return;
+        }
+    }
+    Serial.print(F("OK vectors:"));
+    Serial.print(vectors, DEC);
+    Serial.print(F(" time:"));
+    Serial.print(millis() - start, DEC);
+    Serial.print(F(" fail:"));
+    Serial.println(fails, DEC);
+}
+
+// Signature test of combinatorial designs ('Xs' command): all combinations of the input
+// pins are applied in Gray code order, so one pin changes per vector. After each vector
+// the levels of the sampled pins (bit N is the IC pin N + 1) are folded into a 32 bit
+// MISR: sig = ((sig << 1) ^ (top bit of sig ? EXE_MISR_POLY : 0)) ^ levels.
+// Input 0 is the input pin with the lowest number, it is bit 0 of the Gray code.
+#define EXE_MISR_POLY 0x04C11DB7UL
+#define EXE_SIG_MAX_INPUTS 20
+// the sampled pins are not driven by the MCU, the pull-ups need a short time to rise
+#define EXE_SIG_SETTLE_US 2
+
+// sets the level of one driven pin
+static void exerciseSetPinLevel(uint8_t index, uint8_t level) {
+    uint8_t i;
+
+    // pins 2 to 9 are set via shift register
+    if (index >= 1 && index <= 8) {
+        if (level) {
+            lastShiftRegVal |= 1 << (index - 1);
+        } else {
+            lastShiftRegVal &= ~(1 << (index - 1));
+        }
+        setShiftReg(lastShiftRegVal);
+        return;
+    }
+    for (i = 0; i < exePinTotal; i++) {
+        if (exePinIndex[i] == index) {
+#ifdef EXE_PORT_IO
+            uint8_t oldSreg = SREG;
+            cli();
+            if (level) {
+                *exePortOut[exePinPort[i]] |= exePinMask[i];
+            } else {
+                *exePortOut[exePinPort[i]] &= ~exePinMask[i];
+            }
+            SREG = oldSreg;
+#else
+            digitalWrite(exePinArdu[i], level ? HIGH : LOW);
+#endif
+            return;
+        }
+    }
+}
+
+// levels of the pins in the mask, bit N is the IC pin N + 1
+static uint32_t exerciseSamplePins(uint32_t mask) {
+    uint32_t levels = 0;
+    uint8_t i;
+
+    for (i = 0; i < exePinTotal; i++) {
+        uint8_t dataIndex = exePinIndex[i];
+        if (!(mask & (1UL << dataIndex))) {
+            continue;
+        }
+#ifdef EXE_PORT_IO
+        if (*exePortIn[exePinPort[i]] & exePinMask[i]) {
+#else
+        if (digitalRead(exePinArdu[i])) {
+#endif
+            levels |= 1UL << dataIndex;
+        }
+    }
+    return levels;
+}
+
+// 'inputs' and 'outputs' are pin masks, bit 0 is pin 1. The sampled pins are inputs with
+// pull-ups, all other pins (except the power pins) are driven low.
+static void exerciseSignature(uint8_t pinCount, uint32_t inputs, uint32_t outputs) {
+    uint8_t inputIndex[EXE_SIG_MAX_INPUTS];
+    uint8_t inputCount = 0;
+    char pins[24];
+    uint32_t sig = 0;
+    uint32_t count;
+    uint32_t k;
+    uint8_t i;
+
+    if (pinCount != 20 && pinCount != 24) {
+        pinCount = 0;
+    }
+    for (i = 0; i < pinCount; i++) {
+        if (inputs & (1UL << i)) {
+            if (inputCount == EXE_SIG_MAX_INPUTS) {
+                pinCount = 0;
+                break;
+            }
+            inputIndex[inputCount++] = i;
+        }
+    }
+    if (pinCount == 0 || inputCount == 0 || (inputs & outputs)) {
+        printError(STATUS_EXERCISE);
+        Serial.println(F("invalid signature parameters"));
+        return;
+    }
+
+    if (pinCount != exePinCount) {
+        exerciseSetupPinCount(pinCount);
+    }
+    for (i = 0; i < pinCount; i++) {
+        pins[i] = (outputs & (1UL << i)) ? 'z' : '0';
+    }
+    // power pins
+    pins[pinCount == 20 ? 9 : 11] = 'g';
+    pins[pinCount - 1] = 'v';
+    exerciseApplyPins(pins);
+
+    count = 1UL << inputCount;
+    for (k = 0; k < count; k++) {
+        // Gray code: the input of the lowest set bit of 'k' changes
+        if (k) {
+            uint8_t j = 0;
+            while (!(k & (1UL << j))) {
+                j++;
+            }
+            exerciseSetPinLevel(inputIndex[j], ((k ^ (k >> 1)) >> j) & 1);
+        }
+        delayMicroseconds(EXE_SIG_SETTLE_US);
+        sig = ((sig << 1) ^ ((sig & 0x80000000UL) ? EXE_MISR_POLY : 0)) ^ exerciseSamplePins(outputs);
+    }
 
+    Serial.print(F("OK vectors:"));
+    Serial.print(count, DEC);
+    Serial.print(F(" signature:"));
+    Serial.println(sig, HEX);
 }
@@ -156,7 +156,7 @@ static void operationSetupPEEL(uint8_t shreg)
     digitalWrite(PIN_SHR_EN, LOW); //enable output of the shift register
 
     delay(1);
-    setVPP(ERASEALL, 4); // VPP to 16V
+    setVPP(ERASEALL, 4); // VPP to 16V, calibrated variable VPP waits until it settles
 }
 
 // erases fuse map in the PEEL device (all fuses to 1)
@@ -200,7 +200,7 @@ static void eraseProgramAllPEEL(uint8_t pulseLen, uint8_t erase)
     // Step 7
     rampUpVppPEEL();
 
-    delay(pulseLen); // 100 ms for preconditioning
+    vppLogDelay(pulseLen); // 100 ms for preconditioning
 
     digitalWrite(PIN_CTL_PVP, LOW); // The bleed resistor pulls PVP to 0V
     delay(20); // 20 ms to go to 3V,  40 ms to fully go to 0V
@@ -13,6 +13,7 @@
  *  Sparse fusemap supports:
  *  - random reads and writes
  *  - a simple cache to speed up index look-ups.
+ *  - sequential byte reads (checksum, JEDEC output)
  */
 
 #ifdef USE_SPARSE_FUSEMAP
@@ -221,6 +222,70 @@ static inline uint16_t sparseGetFuseBit(uint16_t bitPos) {
     return pos;
 }
 
+// sequential reader of the sparse fuse map: 8 fuses per byte, starting at fuse byte 'bytePos'
+uint16_t sparseReadPos = 0;    // fuse byte position (group index * 4 + byte in the group)
+uint16_t sparseReadOffset = 0; // fusemap offset of the group at the read position
+
+static void sparseReadStart(uint16_t bytePos) {
+  uint16_t group = bytePos >> 2;
+  uint16_t i;
+
+  sparseReadPos = bytePos;
+  sparseReadOffset = 0;
+  // count the stored groups (type 1) before the read position
+  for (i = 0; i < group; i++) {
+    if (((fuseType[i >> 2] >> ((i & 0b11) << 1)) & 0b11) == 1) {
+      sparseReadOffset += 4;
+    }
+  }
+}
+
+static inline uint8_t sparseReadByte(void) {
+  uint16_t group = sparseReadPos >> 2;
+  uint8_t type = (fuseType[group >> 2] >> ((group & 0b11) << 1)) & 0b11;
+  uint8_t b = sparseReadPos & 0b11;
+
+  sparseReadPos++;
+  if (type == 1) {
+    uint8_t v = fusemap[sparseReadOffset + b];
+    if (b == 3) {
+      sparseReadOffset += 4;
+    }
+    return v;
+  }
+  return type ? 0xFF : 0; // type 3: all bits 1, type 0: all bits 0
+}
+
+// sum of the next 'bytes' fuse bytes: groups of type 0 and 3 are summed without touching the fusemap
+static unsigned long sparseSumFuseBytes(uint16_t bytes) {
+  unsigned long a = 0;
+  uint16_t end = sparseReadPos + bytes;
+
+  while (sparseReadPos < end) {
+    uint16_t group = sparseReadPos >> 2;
+    uint8_t rec = fuseType[group >> 2];
+    if ((sparseReadPos & 0b1111) == 0 && sparseReadPos + 16 <= end && (rec == 0 || rec == 0xFF)) {
+      // 4 groups of type 0 or 3 (16 bytes)
+      if (rec) {
+        a += 16 * 0xFF;
+      }
+      sparseReadPos += 16;
+    } else if ((sparseReadPos & 0b11) == 0 && sparseReadPos + 4 <= end) {
+      uint8_t type = (rec >> ((group & 0b11) << 1)) & 0b11;
+      if (type == 1) {
+        a += fusemap[sparseReadOffset] + fusemap[sparseReadOffset + 1] + fusemap[sparseReadOffset + 2] + fusemap[sparseReadOffset + 3];
+        sparseReadOffset += 4;
+      } else if (type == 3) {
+        a += 4 * 0xFF;
+      }
+      sparseReadPos += 4;
+    } else {
+      a += sparseReadByte();
+    }
+  }
+  return a;
+}
+
 static void sparsePrintStat() {
     Serial.print(F("sp bytes="));
     Serial.println(sparseFusemapStat & 0x7FF, DEC);
@@ -262,5 +327,8 @@ static inline void sparseDisable(void) {
 #define sparseGetFuseBit(X) 0
 #define sparseSetFuseBit(X) 0
 #define sparsePrintStat()
+#define sparseReadStart(X)
+#define sparseReadByte() 0
+#define sparseSumFuseBytes(X) 0
 #define sparseFusemapStat 0
 #endif
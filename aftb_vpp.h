@@ -186,14 +186,10 @@ static void varVppSet(uint8_t value) {
 #define SAMPLE_OFFSET 5
 #endif
 
-static int16_t varVppMeasureVpp(int8_t printValue) {
-    int8_t i = 0;
-    uint16_t r1 = 0;
+// converts the sum of SAMPLE_CNT ADC readings to VPP in 10mV units
+static uint16_t varVppScale(uint16_t r1) {
     int16_t r2; //correction for ADC gain error
 
-    while (i++ < SAMPLE_CNT) {
-        r1 += analogRead(VPP);
-    }
     r2 = (r1 / (SAMPLE_DIVIDER * SAMPLE_MULTIPLIER));
 #ifdef SAMPLE_OFFSET
     r1+= SAMPLE_OFFSET;
@@ -204,6 +200,18 @@ static int16_t varVppMeasureVpp(int8_t printValue) {
     r1 += r2;
 #endif    
     r1 += calOffset;
+    return r1;
+}
+
+static int16_t varVppMeasureVpp(int8_t printValue) {
+    int8_t i = 0;
+    uint16_t raw = 0;
+    uint16_t r1;
+
+    while (i++ < SAMPLE_CNT) {
+        raw += analogRead(VPP);
+    }
+    r1 = varVppScale(raw);
     if (printValue) {
         uint8_t a = r1%100;
         Serial.print(r1/100);
@@ -214,110 +222,239 @@ static int16_t varVppMeasureVpp(int8_t printValue) {
 #if 1
         Serial.println(a);
 #else
-        //debug - display the voltage skew value in r2
+        //debug - display the sum of the ADC readings
         Serial.print(a);
         Serial.println(F(", "));
-        Serial.println(r2);
+        Serial.println(raw);
 #endif        
     }
     return r1;
 }
 
+// Closed-loop settle: VPP is sampled until 3 samples in a row are within 0.15V of the
+// calibrated target (the calibrated taps are within 0.05V). VPP off waits until the
+// voltage drops below 5.5V, the booster gives 4.2V - 5.0V when the wiper is disabled.
+#define VPP_WAIT_STEP_MS 1
+#define VPP_WAIT_COUNT 3
+#define VPP_WAIT_TOL 15
+#define VPP_WAIT_OVERSHOOT 50   // samples 0.5V above the target are reported
+#define VPP_OFF_MAX 550
+#define VPP_WAIT_MAX_MS 100     // the longest wait of setVPP() for a calibrated VPP
+
+#define VPP_FAULT_TIMEOUT 1
+#define VPP_FAULT_OVERSHOOT 2
+#define VPP_UNCONFIRMED 4       // returned only: the voltage was not measured settled
+
+static uint8_t vppFault;        // faults since the last report
+static int16_t vppFaultTarget;  // the target, the last and the highest voltage of the last fault
+static int16_t vppFaultV;
+static int16_t vppFaultPeak;
+
+// waits at most 'maxMs' until the voltage set by varVppSet() settles, returns the faults
+// and VPP_UNCONFIRMED when the voltage did not settle in time. Without calibration the
+// target is not known, so it waits the fixed 'fixedMs' instead and returns VPP_UNCONFIRMED.
+static uint8_t varVppWaitSettle(uint8_t value, uint16_t fixedMs, uint16_t maxMs) {
+    uint32_t start = millis();
+    int16_t target = 0;
+    int16_t peak = 0;
+    int16_t v;
+    uint8_t inside = 0;
+    uint8_t fault = 0;
+
+    if (vppWiper[0] == 0) {
+        delay(fixedMs);
+        return VPP_UNCONFIRMED;
+    }
+    if (value != VPP_5V0 && value < MAX_WIPER) {
+        target = 900 + value * 50;
+    }
+    while (1) {
+        v = varVppMeasureVpp(0);
+        if (v > peak) {
+            peak = v;
+        }
+        if (target) {
+            int16_t d = v - target;
+            d = ABS(d);
+            inside = (d <= VPP_WAIT_TOL) ? inside + 1 : 0;
+        } else {
+            inside = (v <= VPP_OFF_MAX) ? inside + 1 : 0;
+        }
+        if (inside >= VPP_WAIT_COUNT || millis() - start >= maxMs) {
+            break;
+        }
+        delay(VPP_WAIT_STEP_MS);
+    }
+    // the discharge of VPP depends on the load, a slow drop is not a fault
+    if (target && inside < VPP_WAIT_COUNT) {
+        fault = VPP_FAULT_TIMEOUT;
+    }
+    if (target && peak > target + VPP_WAIT_OVERSHOOT) {
+        fault |= VPP_FAULT_OVERSHOOT;
+    }
+    if (fault) {
+        vppFault |= fault;
+        vppFaultTarget = target;
+        vppFaultV = v;
+        vppFaultPeak = peak;
+    }
+    if (inside < VPP_WAIT_COUNT) {
+        fault |= VPP_UNCONFIRMED;
+    }
+#if VPP_VERBOSE
+    Serial.print(F("VPP settle ms="));
+    Serial.print(millis() - start);
+    Serial.print(F(" v="));
+    Serial.println(v);
+#endif
+    return fault;
+}
+
+// prints the error response of the faults during the last command, the voltages in 0.01V
+static void varVppReportFault(void) {
+    if (!vppFault) {
+        return;
+    }
+    printError(STATUS_VPP_SETTLE);
+    Serial.print(F("VPP "));
+    if (vppFault & VPP_FAULT_TIMEOUT) {
+        Serial.print(F("not settled "));
+    }
+    if (vppFault & VPP_FAULT_OVERSHOOT) {
+        Serial.print(F("overshoot "));
+    }
+    Serial.print(F("target:"));
+    Serial.print(vppFaultTarget);
+    Serial.print(F(" measured:"));
+    Serial.print(vppFaultV);
+    Serial.print(F(" peak:"));
+    Serial.println(vppFaultPeak);
+    vppFault = 0;
+}
+
+// Calibration: the wiper taps of the voltages 9.0V to 16.5V are searched upwards only,
+// the booster can not pull the voltage down quickly. The next tap is predicted from the
+// slope of the last step over several taps (single taps differ mostly by the ADC noise):
+// far from the target the search goes half of the predicted distance, near the target
+// it goes tap by tap.
+#define VPP_CAL_PROBE 8         // first step when the slope is not known yet
+#define VPP_CAL_MAX_STEP 32
+#define VPP_CAL_NEAR 4          // predicted distance searched tap by tap
+#define VPP_SETTLE_STEP_MS 4    // the voltage is settled when 3 samples 4ms apart
+#define VPP_SETTLE_COUNT 3      // differ by 0.02V at most
+#define VPP_SETTLE_DIFF 2
+#define VPP_SETTLE_MAX_MS 300
+
+static uint8_t vppCalTap;
+
+// sets the tap and measures the voltage when it settles
+static int16_t varVppMeasureTap(uint8_t tap) {
+    uint32_t start;
+    int16_t last;
+    int16_t v;
+    uint8_t stable = 0;
+
+    // ramp up to prevent voltage overshoots
+    while (vppCalTap + VPP_CAL_MAX_STEP / 2 < tap) {
+        vppCalTap += VPP_CAL_MAX_STEP / 2;
+        varVppSetVppIndex(vppCalTap);
+    }
+    vppCalTap = tap;
+    varVppSetVppIndex(tap);
+
+    start = millis();
+    last = varVppMeasureVpp(0);
+    do {
+        int16_t d;
+        delay(VPP_SETTLE_STEP_MS);
+        v = varVppMeasureVpp(0);
+        d = v - last;
+        d = ABS(d);
+        stable = (d <= VPP_SETTLE_DIFF) ? stable + 1 : 0;
+        last = v;
+    } while (stable < VPP_SETTLE_COUNT && millis() - start < VPP_SETTLE_MAX_MS);
+#if VPP_VERBOSE
+    Serial.print(tap);
+    Serial.print(F(") v="));
+    Serial.print(v, DEC);
+    Serial.print(F(" ms="));
+    Serial.println(millis() - start, DEC);
+#endif
+    return v;
+}
+
 // Returns 1 on Success, 0 on Failure
 static uint8_t varVppCalibrateVpp(void) {
-    uint8_t vppIndex = 0;
-    uint8_t i = 1;
+    uint8_t vppIndex;
     int16_t v = 900; //starting at 9.00 V
-    int16_t r1 = 0;
-    int16_t r2;
-    int16_t minDif;
+    uint8_t t0, t1; // the last 2 measured taps
+    int16_t v0, v1; // and their voltages
+    uint8_t slopeTaps = 0;
+    int16_t slopeV = 0;
+    uint8_t r = FAIL;
 
     Serial.print(F("VPP calib. offset: "));
     Serial.println(calOffset);
 
-    varVppSetVppIndex(1);
-    delay(300); //settle voltage
+    vppCalTap = 0;
+    t0 = t1 = 1;
+    v0 = v1 = varVppMeasureTap(1);
 
-    while (1) {
-      // reset the 'minimal difference' variable every time we search for a new index
-        minDif = 9000;
-        //the 'vppWiper' storage for tap indices is 8bit wide, therefore we must not use tap index 256.
-        while (i <= 0xFF) {
-            int16_t d1,d2;
-            varVppSetVppIndex(i);
-            delay(100); //let the voltage settle
-
-            r2 = varVppMeasureVpp(0);
-            // Sanity check: the previous voltage can't be higher than the voltage just measured
-            // because we are ramping up the voltage. Therefore it must be an ADC measurement
-            // glitch. In that case use the previous value as the measured one.
-            // This can happen at lower tap indices where the voltage differences are very small (like 0.01V).
-            if (r1 > r2) {
-              r2 = r1;
-            }
-            d1 = r1 - v;
-            d2 = r2 - v;
-            d1 = ABS(d1);
-            d2 = ABS(d2);
-#if VPP_VERBOSE
-            Serial.print(i);
-            Serial.print(F(") r2="));
-            Serial.print(r2, DEC);
-            Serial.print(F(" d1="));
-            Serial.print(d1, DEC);
-            Serial.print(F(" d2="));
-            Serial.print(d2, DEC);
-            Serial.print(F(" md="));
-            Serial.println(minDif, DEC);
-#endif
+    for (vppIndex = 0; vppIndex < MAX_WIPER; vppIndex++, v += 50) {
+        int16_t d0, d1;
 
-            if (r2 <= 100) { // less than 1V ? Failure
-                r1 = FAIL;
-                goto ret;
-            }
+        while (v1 < v) {
+            int32_t step = VPP_CAL_PROBE;
 
-            if (d2 <= minDif) {
-                minDif = d2;
-                vppWiper[vppIndex] = i;
-                //check last value / voltage
-                if (i == 0xFF) {
-                    if (v >= 1620 && v <= 1670) {
-                        Serial.println(F("*Index for VPP 1650 is 255"));
-                        r1 = OK;
-                        goto ret;
-                    }
-                    r1 = FAIL;
-                    goto ret;
+            // the taps are exhausted: only the last voltage may be out of reach
+            if (t1 == 0xFF) {
+                if (v >= 1620 && v <= 1670) {
+                    break;
                 }
-            } else {
-                i--;
-                minDif = 5000;
-                Serial.print(F("*Index for VPP "));
-                Serial.print(v);
-                Serial.print(F(" is "));
-                Serial.println(i);
-                break;
+                goto ret;
+            }
+            if (slopeV > 0) {
+                step = (int32_t) (v - v1) * slopeTaps / slopeV;
+                step = (step > VPP_CAL_NEAR) ? step >> 1 : 1;
+            }
+            if (step > VPP_CAL_MAX_STEP) {
+                step = VPP_CAL_MAX_STEP;
+            }
+            if (step > 0xFF - t1) {
+                step = 0xFF - t1;
+            }
+            t0 = t1;
+            v0 = v1;
+            t1 += step;
+            v1 = varVppMeasureTap(t1);
+            if (v1 <= 100) { // less than 1V ? Failure
+                goto ret;
+            }
+            // ADC glitch at lower taps: the voltage can't be lower than the previous one
+            if (v1 < v0) {
+                v1 = v0;
+            }
+            if (step >= VPP_CAL_NEAR) {
+                slopeTaps = step;
+                slopeV = v1 - v0;
             }
-            
-            r1 = r2;
-            i++;
-        }
-        vppIndex++;
-#if VPP_VERBOSE
-        Serial.print(F("vppIndex "));
-        Serial.println(vppIndex);
-#endif
-        if (vppIndex >= MAX_WIPER) {
-            r1 = OK;
-            goto ret; 
         }
-        v += 50; //next voltage to search for is 0.5V higher
+        // the closer one of the last 2 taps
+        d0 = v0 - v;
+        d1 = v1 - v;
+        d0 = ABS(d0);
+        d1 = ABS(d1);
+        vppWiper[vppIndex] = (d1 <= d0) ? t1 : t0;
+        Serial.print(F("*Index for VPP "));
+        Serial.print(v);
+        Serial.print(F(" is "));
+        Serial.println(vppWiper[vppIndex]);
     }
+    r = OK;
 
 ret:
     varVppSet(VPP_5V0);
-    return r1;
-
+    return r;
 }
 
 
@@ -394,7 +531,8 @@ static int8_t varVppCheckCalibration(void) {
     varVppSet(VPP_5V0); //set VPP back to 5V
     // lower voltages have a good resolution, so we can have a tight voltage check bounds
     if (v < 890 || v > 910) {
-        Serial.print(F("ER: VPP voltage check of 9V failed. Expected 900, measured "));
+        printError(STATUS_VPP_CHECK);
+        Serial.print(F("VPP voltage check of 9V failed. Expected 900, measured "));
         Serial.println(v);
         return FAIL;
     }
@@ -429,7 +567,8 @@ static int8_t varVppCalibrate(void) {
     if (varVppCalibrateVpp()) {
         varVppStoreWiperCalib();
     } else {
-        Serial.println(F("ER: Wiper calibration failed"));
+        printError(STATUS_VPP_CALIBRATION);
+        Serial.println(F("Wiper calibration failed"));
         return FAIL;
     }
     return OK;
@@ -0,0 +1,153 @@
+/*
+ * VPP capture of the programming pulses for Afterburner GAL project.
+ *
+ * When the capture is on ('L1' command) the programming and erase pulses
+ * (strobeProgram() and the PEEL programming pulse, not the read strobes)
+ * sample the VPP ADC for the length of the pulse instead of sleeping.
+ * Every pulse of the last command gets min / max / mean of its samples,
+ * the last few pulses also keep a waveform: the pulse is split into
+ * VPPLOG_DUMP_SAMPLES time slots and each slot holds its first sample.
+ * The 'L' command prints both, the next GAL command starts a new log.
+ *
+ * The pulse ends with the first sample taken after its length elapsed,
+ * so a captured pulse is longer by up to one ADC conversion (~0.1ms on AVR).
+ */
+#pragma once
+#include "Arduino.h"
+
+#ifdef RAM_BIG
+#define VPPLOG_PULSES 64        // pulses with min / max / mean
+#define VPPLOG_DUMPS 8          // last pulses with the waveform
+#define VPPLOG_DUMP_SAMPLES 32
+#else
+#define VPPLOG_PULSES 8
+#define VPPLOG_DUMPS 2
+#define VPPLOG_DUMP_SAMPLES 16
+#endif
+
+#define VPPLOG_NONE -1          // the slot has no sample (ADC slower than the slot)
+
+// VPP in 10mV units
+typedef struct {
+    uint16_t ms;
+    uint16_t samples;
+    int16_t min;
+    int16_t max;
+    int16_t mean;
+} VppLogPulse;
+
+typedef struct {
+    uint16_t slotUs;
+    int16_t v[VPPLOG_DUMP_SAMPLES];
+} VppLogDump;
+
+static uint8_t vppLogOn = 0;
+static uint16_t vppLogCount;                    // pulses of the last command
+static VppLogPulse vppLogPulses[VPPLOG_PULSES]; // pulse N is at N % VPPLOG_PULSES
+static VppLogDump vppLogDumps[VPPLOG_DUMPS];    // pulse N is at N % VPPLOG_DUMPS
+
+static void vppLogReset(void) {
+    vppLogCount = 0;
+}
+
+// samples VPP for 'msec' milliseconds
+static void vppLogPulse(uint16_t msec) {
+    VppLogPulse* p = &vppLogPulses[vppLogCount % VPPLOG_PULSES];
+    VppLogDump* d = &vppLogDumps[vppLogCount % VPPLOG_DUMPS];
+    uint32_t len = msec * 1000UL;
+    uint32_t sum = 0;
+    uint32_t start;
+    uint32_t t;
+    uint16_t slot;
+    int16_t v;
+
+    p->ms = msec;
+    p->samples = 0;
+    p->min = 0x7FFF;
+    p->max = 0;
+    d->slotUs = len / VPPLOG_DUMP_SAMPLES;
+    for (slot = 0; slot < VPPLOG_DUMP_SAMPLES; slot++) {
+        d->v[slot] = VPPLOG_NONE;
+    }
+
+    start = micros();
+    do {
+        t = micros() - start;
+        v = varVppScale(analogRead(VPP) * SAMPLE_CNT);
+        if (v < 0) {
+            v = 0;
+        }
+        if (v < p->min) {
+            p->min = v;
+        }
+        if (v > p->max) {
+            p->max = v;
+        }
+        sum += v;
+        p->samples++;
+        slot = t / d->slotUs;
+        if (slot < VPPLOG_DUMP_SAMPLES && d->v[slot] == VPPLOG_NONE) {
+            d->v[slot] = v;
+        }
+    } while (micros() - start < len);
+
+    p->mean = sum / p->samples;
+    vppLogCount++;
+}
+
+// waits 'msec' milliseconds, samples VPP when the capture is on
+static void vppLogDelay(uint16_t msec) {
+    if (vppLogOn) {
+        vppLogPulse(msec);
+    } else {
+        delay(msec);
+    }
+}
+
+// Prints the log of the last command:
+// "P pulse:N ms:N samples:N min:N max:N mean:N" for each kept pulse, followed by
+// "D pulse:N us:N V V ..." when its waveform is kept ('-' marks a slot without a sample),
+// and "OK pulses:N" with the number of all pulses.
+static void vppLogPrint(void) {
+    uint16_t i = vppLogCount > VPPLOG_PULSES ? vppLogCount - VPPLOG_PULSES : 0;
+    uint8_t slot;
+
+    for (; i < vppLogCount; i++) {
+        VppLogPulse* p = &vppLogPulses[i % VPPLOG_PULSES];
+
+        outPrintF(F("P pulse:"));
+        outPrintDec(i);
+        outPrintF(F(" ms:"));
+        outPrintDec(p->ms);
+        outPrintF(F(" samples:"));
+        outPrintDec(p->samples);
+        outPrintF(F(" min:"));
+        outPrintDec(p->min);
+        outPrintF(F(" max:"));
+        outPrintDec(p->max);
+        outPrintF(F(" mean:"));
+        outPrintDec(p->mean);
+        outPrintln();
+        if (i + VPPLOG_DUMPS >= vppLogCount) {
+            VppLogDump* d = &vppLogDumps[i % VPPLOG_DUMPS];
+
+            outPrintF(F("D pulse:"));
+            outPrintDec(i);
+            outPrintF(F(" us:"));
+            outPrintDec(d->slotUs);
+            for (slot = 0; slot < VPPLOG_DUMP_SAMPLES; slot++) {
+                outPrint(' ');
+                if (d->v[slot] == VPPLOG_NONE) {
+                    outPrint('-');
+                } else {
+                    outPrintDec(d->v[slot]);
+                }
+            }
+            outPrintln();
+        }
+    }
+    outPrintF(F("OK pulses:"));
+    outPrintDec(vppLogCount);
+    outPrintln();
+    outFlush();
+}
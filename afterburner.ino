@@ -129,8 +129,11 @@
 #define COMMAND_CALIBRATE_VPP 'b'
 #define COMMAND_CALIBRATION_OFFSET 'B'
 #define COMMAND_JTAG_PLAYER 'j'
+#define COMMAND_JTAG_ISP 'J'
 #define COMMAND_EXERCISE 'X'
 #define COMMAND_EXERCISE_SET_PINS 'x'
+#define COMMAND_TIMING 'T'
+#define COMMAND_VPP_LOG 'L'
 
 
 #define READGAL 0
@@ -467,6 +470,7 @@ unsigned char fusemap[MAXFUSES];
 unsigned char flagBits;
 char varVppExists;
 uint8_t lastShiftRegVal = 0;
+static uint8_t exePinCount = 0; // exercise pin setup: 20 or 24, 0: the pins are not configured
 
 static char getFuseBit(unsigned short bitPos);
 static void setFuseBitVal(unsigned short bitPos, char val);
@@ -477,10 +481,158 @@ static void turnOff(void);
 static void printFormatedNumberHex2(unsigned char num) ;
 static void setupGpios(uint8_t pm);
 static void setShiftReg(uint8_t val);
-static void setVPP(char on, uint8_t settleTime = 50);
+static char setVPP(char on, uint8_t settleTime = 50);
 static void setGalDefaults(void);
+void readGarbage(void);
+
+// Status codes of the error responses. An error response line is 'ER', 2 digit code,
+// space and the error text. The PC client reports the codes in its JSON output.
+#define STATUS_UPLOAD_FAILED     1
+#define STATUS_GAL_INDEX         2
+#define STATUS_CHECKSUM          3
+#define STATUS_UPLOAD_COMMAND    4
+#define STATUS_PES_WRITE         5
+#define STATUS_VERIFY            6
+#define STATUS_GAL_TYPE          7
+#define STATUS_NO_FUSES          8
+#define STATUS_UNSUPPORTED       9
+#define STATUS_NO_VAR_VPP       10
+#define STATUS_UPLOAD_ABORTED   11
+#define STATUS_UNKNOWN_GAL      12
+#define STATUS_CAL_OFFSET       13
+#define STATUS_UNKNOWN_COMMAND  14
+#define STATUS_VPP_CHECK        15
+#define STATUS_VPP_CALIBRATION  16
+#define STATUS_EXERCISE         17
+#define STATUS_EXERCISE_MISMATCH 18
+#define STATUS_VPP_SETTLE       19
+
+// Text output buffer. The fuse map and PES printing assemble the text here
+// and send it by Serial.write() in bulk instead of one Serial.print() per
+// character. Call outFlush() before printing by Serial directly.
+#ifdef RAM_BIG
+#define OUT_BUF_SIZE 64
+#else
+#define OUT_BUF_SIZE 32
+#endif
+
+static char outBuf[OUT_BUF_SIZE];
+static uint8_t outBufPos = 0;
+
+static void outFlush(void) {
+  if (outBufPos) {
+    Serial.write(outBuf, outBufPos);
+    outBufPos = 0;
+  }
+}
+
+static inline void outPrint(char c) {
+  outBuf[outBufPos++] = c;
+  if (outBufPos == OUT_BUF_SIZE) {
+    outFlush();
+  }
+}
+
+// prints a string stored in the flash memory
+static void outPrintF(const __FlashStringHelper* s) {
+  const char* p = (const char*) s;
+  char c;
+
+  while ((c = pgm_read_byte(p++))) {
+    outPrint(c);
+  }
+}
+
+static void outPrintln(void) {
+  outPrint('\r');
+  outPrint('\n');
+}
+
+static void outPrintDec(unsigned long num) {
+  char digits[10];
+  uint8_t i = 0;
+
+  do {
+    digits[i++] = '0' + (num % 10);
+    num /= 10;
+  } while (num);
+  while (i) {
+    outPrint(digits[--i]);
+  }
+}
+
+// prints the start of the error response, the caller prints the error text
+static void printError(uint8_t code) {
+  Serial.print(F("ER"));
+  if (code < 10) {
+    Serial.print('0');
+  }
+  Serial.print(code, DEC);
+  Serial.print(' ');
+}
+
+// Time spent by the last command, split into phases. The time is measured
+// exclusively: a nested phase (VPP settle inside power-on) is not counted
+// in the outer phase. TIMING_TYPE_CHECK is the whole PES type check and is
+// not part of the total.
+#define TIMING_SHIFT      0   // bit shifting and the rest of the command
+#define TIMING_POWER      1   // turnOn() / turnOff() delays
+#define TIMING_VPP        2   // VPP switching and settle
+#define TIMING_STROBE     3   // programming / erase pulses
+#define TIMING_SERIAL     4   // printing of the fuse map and PES
+#define TIMING_TYPE_CHECK 5
+#define TIMING_COUNT      6
+
+static uint32_t timing[TIMING_COUNT];
+static uint32_t timingMark;
+static uint8_t timingPhase;
+static uint8_t timingPowerUps; // turnOn() calls, the PES type check adds one
+
+static void timingReset(void) {
+  memset(timing, 0, sizeof(timing));
+  timingPowerUps = 0;
+  timingPhase = TIMING_SHIFT;
+  timingMark = micros();
+}
+
+// accumulates the time of the current phase and starts the new one, returns the previous phase
+static uint8_t timingEnter(uint8_t phase) {
+  uint32_t now = micros();
+  uint8_t prev = timingPhase;
+
+  timing[timingPhase] += now - timingMark;
+  timingMark = now;
+  timingPhase = phase;
+  return prev;
+}
+
+static void printTimingValue(const __FlashStringHelper* name, uint32_t value) {
+  outPrintF(name);
+  outPrintDec(value);
+}
+
+// prints the phase times of the last command in microseconds
+static void printTiming(void) {
+  uint32_t total = 0;
+  uint8_t i;
+
+  for (i = 0; i < TIMING_TYPE_CHECK; i++) {
+    total += timing[i];
+  }
+  printTimingValue(F("OK total:"), total);
+  printTimingValue(F(" shift:"), timing[TIMING_SHIFT]);
+  printTimingValue(F(" power:"), timing[TIMING_POWER]);
+  printTimingValue(F(" vpp:"), timing[TIMING_VPP]);
+  printTimingValue(F(" strobe:"), timing[TIMING_STROBE]);
+  printTimingValue(F(" serial:"), timing[TIMING_SERIAL]);
+  printTimingValue(F(" typecheck:"), timing[TIMING_TYPE_CHECK]);
+  printTimingValue(F(" powerups:"), timingPowerUps);
+  outPrintln();
+  outFlush();
+}
 
 #include "aftb_vpp.h"
+#include "aftb_vpplog.h"
 #include "aftb_sparse.h"
 #include "aftb_seram.h"
 #include "aftb_peel.h"
@@ -489,6 +641,7 @@ static void setGalDefaults(void);
 // share fusemap buffer with jtag
 #define XSVF_HEAP fusemap
 #include "jtag_xsvf_player.h"
+#include "jtag_atf150x.h"
 
 // print some help on the serial console
 void printHelp(char full) {
@@ -500,6 +653,20 @@ void printHelp(char full) {
 #ifdef RAM_BIG
     Serial.println(F(" RAM-BIG "));
 #endif
+  // indication for PC software that ATF150x .jed files can be programmed directly
+  Serial.println(F(" JTAG-ISP "));
+  // indication for PC software that the XSVF player accepts packed payloads
+  Serial.println(F(" XSVF-PACK "));
+  // indication for PC software that the 'T' command reports the phase timing
+  Serial.println(F(" TIMING "));
+  // indication for PC software that the exerciser runs vector tables ('Xb' command)
+  Serial.println(F(" EXE-BATCH "));
+  // indication for PC software that the exerciser runs the signature test ('Xs' command)
+  Serial.println(F(" EXE-SIG "));
+  // indication for PC software that the 'L' command reports the VPP of the programming pulses
+  if (varVppExists) {
+    Serial.println(F(" VPP-LOG "));
+  }
 
   if (!full) {
     Serial.println(F("type 'h' for help"));
@@ -517,6 +684,8 @@ void printHelp(char full) {
   Serial.println(F("  t - test & set VPP"));
   Serial.println(F("  b - calibrate VPP"));
   Serial.println(F("  m - measure VPP"));
+  Serial.println(F("  T - print timing of the last command"));
+  Serial.println(F("  L - print VPP of the pulses of the last command, L1/L0 capture on/off"));
 }
 
 static void setFlagBit(uint8_t flag, uint8_t value) {
@@ -649,6 +818,8 @@ static void setPinMux(uint8_t pm) {
 }
 
 static void setupGpios(uint8_t pm) {
+  // the exercise pin setup (ZIF GND control, pin mux) is overwritten below
+  exePinCount = 0;
 
   // Serial input of the GAL chip, output from Arduino
   pinMode(PIN_SDIN, pm);
@@ -804,7 +975,8 @@ char handleTerminalCommands() {
         // prevent 2 character commands from being flagged as invalid
         if (!(
             c == COMMAND_SET_GAL_TYPE || c == COMMAND_CALIBRATION_OFFSET || c == COMMAND_JTAG_PLAYER ||
-            c == COMMAND_EXERCISE || c == COMMAND_EXERCISE_SET_PINS)
+            c == COMMAND_JTAG_ISP || c == COMMAND_EXERCISE || c == COMMAND_EXERCISE_SET_PINS ||
+            c == COMMAND_VPP_LOG)
         ) {
           c = COMMAND_UNKNOWN; 
         }
@@ -900,7 +1072,8 @@ void parseUploadLine() {
   switch (line[1]) {
     case 'e': {
       if (uploadError) {
-        Serial.print(F("ER upload failed"));
+        printError(STATUS_UPLOAD_FAILED);
+        Serial.print(F("upload failed"));
       } else {
         Serial.print(F("OK upload finished"));
       }
@@ -916,7 +1089,8 @@ void parseUploadLine() {
         Serial.print(F("OK gal set: "));
         Serial.println((short) gal, DEC);
       } else {
-        Serial.println(F("ER unknown gal index"));
+        printError(STATUS_GAL_INDEX);
+        Serial.println(F("unknown gal index"));
         uploadError = 1;
       }
     } break;
@@ -965,7 +1139,8 @@ void parseUploadLine() {
         mapUploaded = 1;
       } else {
         uploadError = 1;
-        Serial.print(F("ER checksum:"));
+        printError(STATUS_CHECKSUM);
+        Serial.print(F("checksum:"));
         Serial.print(cs, HEX);
         Serial.print(F(" expected:"));
         Serial.println(val, HEX);
@@ -985,7 +1160,8 @@ void parseUploadLine() {
 
     default:
       uploadError = 1;
-      Serial.println(F("ER unknown upload cmd"));
+      printError(STATUS_UPLOAD_COMMAND);
+      Serial.println(F("unknown upload cmd"));
   }
 
   lineIndex = 0;
@@ -999,7 +1175,13 @@ static void setVCC(char on) {
     //it is assumed the voltage is always on
 }
 
-static void setVPP(char on, uint8_t settleTime) {
+// Calibrated variable VPP waits until the ADC reads the voltage settled (at most VPP_WAIT_MAX_MS,
+// VPP off at most 'settleTime'), otherwise the fixed 'settleTime' ms is used.
+// Returns 1 when the voltage was measured settled.
+static char setVPP(char on, uint8_t settleTime) {
+    uint8_t phase = timingEnter(TIMING_VPP);
+    char settled = 0;
+
     // new board desgin
     if (varVppExists) {
         uint8_t v = VPP_11V0;
@@ -1033,7 +1215,8 @@ static void setVPP(char on, uint8_t settleTime) {
         }
         varVppSet(on ? v : VPP_5V0);
         if (settleTime) {
-            delay(settleTime); //settle the voltage
+            uint8_t r = varVppWaitSettle(on ? v : VPP_5V0, settleTime, on ? VPP_WAIT_MAX_MS : settleTime);
+            settled = !(r & VPP_UNCONFIRMED);
         }
     }
     // old board design
@@ -1046,7 +1229,8 @@ static void setVPP(char on, uint8_t settleTime) {
         //Serial.println( on ? "12V": "5V");
         delay(10);      
     }
-
+    timingEnter(phase);
+    return settled;
 }
 
 static void setSTB(char on) {
@@ -1193,21 +1377,31 @@ static char getSDOUT(void)
 // GAL finish sequence
 static void turnOff(void)
 {
+    uint8_t phase = timingEnter(TIMING_POWER);
+    char vppLow;
+
     delay(100);
     setPV(0);    // P/V- low
     setRow(0x3F);// RA0-5 high  
     setSDIN(1);  // SDIN high
-    setVPP(0);   // Vpp off (+12V)
+    vppLow = setVPP(0);   // Vpp off (+12V), calibrated variable VPP measures it low
     setPV(1);    // P/V- high
     delay(2);
     setVCC(0);   // turn off VCC (if controlled)
 
     setupGpios(INPUT);
-    delay(100); //ensure VPP is low
+    if (!vppLow) {
+        delay(100); //ensure VPP is low
+    }
+    timingEnter(phase);
 }
 
 // GAL init sequence
 static void turnOn(char mode) {
+    uint8_t phase = timingEnter(TIMING_POWER);
+
+    timingPowerUps++;
+
     setupGpios(OUTPUT);
 
     if (mode == READPES) {
@@ -1240,6 +1434,7 @@ static void turnOn(char mode) {
     setSCLK(0);   // SCLK low
     setVPP(mode);
     delay(20);
+    timingEnter(phase);
 }
 
 
@@ -1315,9 +1510,23 @@ static void sendAddress(unsigned char n, unsigned char row)
 // pulse STB pin low for some milliseconds 
 static void strobe(unsigned short msec)
 {
+  uint8_t phase = timingEnter(TIMING_STROBE);
+
   setSTB(0);
   delay(msec);
   setSTB(1);
+  timingEnter(phase);
+}
+
+// programming / erase pulse, VPP is sampled when the capture is on
+static void strobeProgram(unsigned short msec)
+{
+  uint8_t phase = timingEnter(TIMING_STROBE);
+
+  setSTB(0);
+  vppLogDelay(msec);
+  setSTB(1);
+  timingEnter(phase);
 }
 
 // 16V8, 20V8 RA0-5 = row address, strobe.
@@ -1422,7 +1631,8 @@ static void writePes(void) {
   uint8_t extraBits;
 
   if (gal == ATF16V8B || gal == ATF20V8B || gal == ATF22V10B || gal == ATF22V10C) {
-    Serial.println(F("ER write PES not supported"));
+    printError(STATUS_PES_WRITE);
+    Serial.println(F("write PES not supported"));
     return;
   }
 
@@ -1474,7 +1684,7 @@ static void writePes(void) {
       }
   }
 
-  strobe(progtime);
+  strobeProgram(progtime);
 
   turnOff();
 }
@@ -1598,67 +1808,68 @@ void parsePes(char type) {
 // print PES information
 void printPes(char type) {
   
-  Serial.print(F("PES info: "));
+  outPrintF(F("PES info: "));
   //voltage
   if (pes[3] == ATMEL16 || pes[3] == ATMEL22 || pes[3] == ATMEL750 || pes[3] == ATMEL750L) {
      //Serial.print("  ");
   } else {
     if (pes[1] & 0x10) {
-      Serial.print(F("3.3V "));
+      outPrintF(F("3.3V "));
     } else {
-      Serial.print(F("5V "));
+      outPrintF(F("5V "));
     }
   }
 
   //manufacturer
   switch (pes[3]) {
-    case LATTICE:    Serial.print(F("Lattice ")); break;
-    case NATIONAL:   Serial.print(F("National ")); break;
-    case SGSTHOMSON: Serial.print(F("ST Microsystems ")); break;
+    case LATTICE:    outPrintF(F("Lattice ")); break;
+    case NATIONAL:   outPrintF(F("National ")); break;
+    case SGSTHOMSON: outPrintF(F("ST Microsystems ")); break;
     case ATMEL750:
     case ATMEL750L:
     case ATMEL16:
-    case ATMEL22:    Serial.print(F("Atmel ")); break;
-    default:         Serial.print(F("Unknown GAL."));
+    case ATMEL22:    outPrintF(F("Atmel ")); break;
+    default:         outPrintF(F("Unknown GAL."));
   }
 
   // GAL type
   switch (type) {
-    case GAL16V8: Serial.print(F("GAL16V8 ")); break;
-    case GAL18V10: Serial.print(F("GAL18V10 ")); break;
-    case GAL20V8: Serial.print(F("GAL20V8 ")); break;
-    case GAL20RA10: Serial.print(F("GAL20RA10 ")); break;
-    case GAL20XV10: Serial.print(F("GAL20XV10 ")); break;
-    case GAL22V10: Serial.print(F("GAL22V10 ")); break;
-    case GAL26CV12: Serial.print(F("GAL26CV12 ")); break;
-    case GAL26V12: Serial.print(F("GAL26V12 ")); break;
-    case GAL6001: Serial.print(F("GAL6001 ")); break;
-    case GAL6002: Serial.print(F("GAL6002 ")); break;
-    case ATF16V8B: Serial.print(0 == (flagBits & FLAG_BIT_ATF16V8C) ? F("ATF16V8B "): F("ATF16V8C ")); break;
-    case ATF20V8B: Serial.print(F("ATF20V8B ")); break;
-    case ATF22V10B: Serial.print(F("ATF22V10B ")); break;
-    case ATF22V10C: Serial.print(F("ATF22V10C ")); break;
-    case ATF750C: Serial.print(pes[3] == ATMEL750L ? F("ATF750LVC "): F("ATF750C ")); break;
+    case GAL16V8: outPrintF(F("GAL16V8 ")); break;
+    case GAL18V10: outPrintF(F("GAL18V10 ")); break;
+    case GAL20V8: outPrintF(F("GAL20V8 ")); break;
+    case GAL20RA10: outPrintF(F("GAL20RA10 ")); break;
+    case GAL20XV10: outPrintF(F("GAL20XV10 ")); break;
+    case GAL22V10: outPrintF(F("GAL22V10 ")); break;
+    case GAL26CV12: outPrintF(F("GAL26CV12 ")); break;
+    case GAL26V12: outPrintF(F("GAL26V12 ")); break;
+    case GAL6001: outPrintF(F("GAL6001 ")); break;
+    case GAL6002: outPrintF(F("GAL6002 ")); break;
+    case ATF16V8B: outPrintF(0 == (flagBits & FLAG_BIT_ATF16V8C) ? F("ATF16V8B "): F("ATF16V8C ")); break;
+    case ATF20V8B: outPrintF(F("ATF20V8B ")); break;
+    case ATF22V10B: outPrintF(F("ATF22V10B ")); break;
+    case ATF22V10C: outPrintF(F("ATF22V10C ")); break;
+    case ATF750C: outPrintF(pes[3] == ATMEL750L ? F("ATF750LVC "): F("ATF750C ")); break;
   }
 
   //programming info
   if (UNKNOWN != type) {
-    Serial.print(F(" VPP="));
-    Serial.print(vpp >> 2, DEC);
-    Serial.print(F("."));
-    Serial.print((vpp & 3) * 25, DEC);
-    Serial.print(F(" Timing: prog="));
-    Serial.print(progtime, DEC);
-    Serial.print(F(" erase="));
-    Serial.print(erasetime / 4, DEC);
+    outPrintF(F(" VPP="));
+    outPrintDec(vpp >> 2);
+    outPrintF(F("."));
+    outPrintDec((vpp & 3) * 25);
+    outPrintF(F(" Timing: prog="));
+    outPrintDec(progtime);
+    outPrintF(F(" erase="));
+    outPrintDec(erasetime / 4);
   } else {
     // manual VPP adjustment (via pot) is available only on the old board design
     if (!varVppExists) {
-        Serial.print(F(" try VPP=10..14 in 1V steps"));
+        outPrintF(F(" try VPP=10..14 in 1V steps"));
     }
   }
   
-  Serial.println();
+  outPrintln();
+  outFlush();
 }
 
 // sets a fuse bit on particular position
@@ -1687,6 +1898,77 @@ static char getFuseBit(unsigned short bitPos) {
   return (fusemap[pos] & (1 << (bitPos & 7))) ? 1 : 0;
 }
 
+// sequential fuse reader used by the checksum and the JEDEC output:
+// fuses are read 8 at a time instead of one getFuseBit() look-up per fuse
+static uint16_t fuseReadPos;     // next fuse byte (dense fusemap)
+static uint8_t fuseReadCur;      // fuses read but not consumed yet (in the low bits)
+static uint8_t fuseReadBitsLeft; // number of fuses in fuseReadCur
+
+static inline uint8_t fuseReadByte(void) {
+  if (sparseFusemapStat) {
+    return sparseReadByte();
+  }
+  return fusemap[fuseReadPos++];
+}
+
+// sets the reader at a fuse position
+static void fuseReadStart(unsigned short bitPos) {
+  fuseReadPos = bitPos >> 3;
+  fuseReadCur = 0;
+  fuseReadBitsLeft = 0;
+  if (sparseFusemapStat) {
+    sparseReadStart(fuseReadPos);
+  }
+  if (bitPos & 7) {
+    fuseReadCur = fuseReadByte() >> (bitPos & 7);
+    fuseReadBitsLeft = 8 - (bitPos & 7);
+  }
+}
+
+// reads 'count' fuses into 'dst' (LSB first), returns non-zero if any of the fuses is 1
+static uint8_t fuseReadBits(uint8_t* dst, unsigned short count) {
+  uint8_t used = 0;
+  uint8_t v, next, rest;
+
+  for (; count >= 8; count -= 8) {
+    next = fuseReadByte();
+    v = fuseReadCur | (next << fuseReadBitsLeft);
+    fuseReadCur = fuseReadBitsLeft ? next >> (8 - fuseReadBitsLeft) : 0;
+    *dst++ = v;
+    used |= v;
+  }
+  if (count) {
+    if (count <= fuseReadBitsLeft) {
+      v = fuseReadCur;
+      fuseReadCur >>= count;
+      fuseReadBitsLeft -= count;
+    } else {
+      rest = count - fuseReadBitsLeft;
+      next = fuseReadByte();
+      v = fuseReadCur | (next << fuseReadBitsLeft);
+      fuseReadCur = next >> rest;
+      fuseReadBitsLeft = 8 - rest;
+    }
+    v &= (1 << count) - 1;
+    *dst = v;
+    used |= v;
+  }
+  return used;
+}
+
+// sum of the next 'bytes' fuse bytes, the reader must be byte aligned
+static unsigned long fuseReadSum(unsigned short bytes) {
+  unsigned long a = 0;
+
+  if (sparseFusemapStat) {
+    return sparseSumFuseBytes(bytes);
+  }
+  while (bytes--) {
+    a += fusemap[fuseReadPos++];
+  }
+  return a;
+}
+
 static void setFuseBitVal(unsigned short bitPos, char val) {
   if (val) {
     setFuseBit(bitPos);
@@ -2236,7 +2518,8 @@ static void readOrVerifyGal(char verify)
   }
 
   if (verify && i > 0) {
-    Serial.print(F("ER verify failed. Bit errors: "));
+    printError(STATUS_VERIFY);
+    Serial.print(F("verify failed. Bit errors: "));
     Serial.println(i, DEC);
   }
 }
@@ -2259,7 +2542,7 @@ static void writeGalFuseMapV8(const unsigned char* cfgArray) {
       addr += row;
       sendBit(getFuseBit(addr), rbit == rbitMax - 1 ? skipLastClk : 0);
     }
-    strobe(progtime);
+    strobeProgram(progtime);
   }
 
   // write UES
@@ -2269,7 +2552,7 @@ static void writeGalFuseMapV8(const unsigned char* cfgArray) {
     addr += rbit;
     sendBit(getFuseBit(addr), rbit == 63 ? skipLastClk : 0);
   }
-  strobe(progtime);
+  strobeProgram(progtime);
 
   // write CFG (all ICs use setRow)
   rbitMax = galinfo.cfgbits;
@@ -2278,7 +2561,7 @@ static void writeGalFuseMapV8(const unsigned char* cfgArray) {
     unsigned char cfgOffset = pgm_read_byte(&cfgArray[rbit]); //read array byte flom flash
     sendBit(getFuseBit(cfgAddr + cfgOffset), rbit == rbitMax - 1 ? skipLastClk : 0);
   }
-  strobe(progtime);
+  strobeProgram(progtime);
   setPV(0);
 
   // disable power-down if the APD flag is not set (only for ATF16V8C)
@@ -2307,7 +2590,7 @@ static void writeGalFuseMapV10(const unsigned char* cfgArray, char fillUesStart,
     }
     sendAddress(6, row);
     setPV(1);
-    strobe(progtime);
+    strobeProgram(progtime);
     setPV(0);
   }
 
@@ -2325,7 +2608,7 @@ static void writeGalFuseMapV10(const unsigned char* cfgArray, char fillUesStart,
   }
   sendAddress(6, galinfo.uesrow);
   setPV(1);
-  strobe(progtime);
+  strobeProgram(progtime);
   setPV(0);
   
   // write CFG
@@ -2339,7 +2622,7 @@ static void writeGalFuseMapV10(const unsigned char* cfgArray, char fillUesStart,
     setSDIN(getFuseBit(cfgAddr + cfgOffset));
   }
   setPV(1);
-  strobe(progtime);
+  strobeProgram(progtime);
   setPV(0);
 
   if (useSdin && (flagBits & FLAG_BIT_APD) == 0) {
@@ -2347,7 +2630,7 @@ static void writeGalFuseMapV10(const unsigned char* cfgArray, char fillUesStart,
     setRow(0);
     sendAddress(6, CFG_ROW_APD);
     setPV(1);
-    strobe(progtime);
+    strobeProgram(progtime);
     setPV(0);
   }
 }
@@ -2379,7 +2662,7 @@ static void writeGalFuseMapV750(const unsigned char* cfgArray) {
     sendAddress(7, row);
     setPV(1);
     delayMicroseconds(20);
-    strobe(progtime);
+    strobeProgram(progtime);
     delayMicroseconds(100);
     setPV(0);
     delayMicroseconds(12);
@@ -2402,7 +2685,7 @@ static void writeGalFuseMapV750(const unsigned char* cfgArray) {
   row = galinfo.uesrow;
   sendAddress(7, row);
   setPV(1);
-  strobe(progtime);
+  strobeProgram(progtime);
   setPV(0);
   delay(progtime);
 
@@ -2425,7 +2708,7 @@ static void writeGalFuseMapV750(const unsigned char* cfgArray) {
     delayMicroseconds(10);
     setPV(1);
     delayMicroseconds(18);
-    strobe(progtime); // 20ms
+    strobeProgram(progtime); // 20ms
     delayMicroseconds(32);
     setPV(0);
     delayMicroseconds(12);
@@ -2438,7 +2721,7 @@ static void writeGalFuseMapV750(const unsigned char* cfgArray) {
     setRow(0);
     sendAddress(7, 125);
     setPV(1);
-    strobe(progtime);
+    strobeProgram(progtime);
     setPV(0);
     delay(progtime);
   }
@@ -2463,7 +2746,7 @@ static void writeGalFuseMap600(const unsigned char* cfgArray) {
         sendBits(16, 0);
         setSDIN(0);
         setPV(1);
-        strobe(progtime);
+        strobeProgram(progtime);
         setPV(0);
     }
     for (row = 0; row < 64; row++)
@@ -2478,7 +2761,7 @@ static void writeGalFuseMap600(const unsigned char* cfgArray) {
             sendBit(getFuseBit(98 + 114 * row + bit));
         setSDIN(0);
         setPV(1);
-        strobe(progtime);
+        strobeProgram(progtime);
         setPV(0);
     }
     // UES
@@ -2492,7 +2775,7 @@ static void writeGalFuseMap600(const unsigned char* cfgArray) {
     sendBits(16, 0);
     setSDIN(0);
     setPV(1);
-    strobe(progtime);
+    strobeProgram(progtime);
     setPV(0);
     // CFG
     setRow(galinfo.cfgrow);
@@ -2503,7 +2786,7 @@ static void writeGalFuseMap600(const unsigned char* cfgArray) {
     }
     setSDIN(0);
     setPV(1);
-    strobe(progtime);
+    strobeProgram(progtime);
     setPV(0);
 }
 
@@ -2573,7 +2856,7 @@ static void eraseGAL(char eraseAll)
     if (gal == GAL16V8 || gal == ATF16V8B || gal==GAL20V8) {
         sendBit(1);
     }
-    strobe(erasetime);
+    strobeProgram(erasetime);
     setPV(0);
     turnOff();
 }
@@ -2599,9 +2882,10 @@ static char checkGalTypeViaPes(void)
     Serial.println(F("PES raw bytes:"));
     for (i = 0; i < 10; i++) {
       printFormatedNumberHex2(pes[i]);
-      Serial.print(F(" "));
+      outPrint(' ');
     }
-    Serial.println();
+    outPrintln();
+    outFlush();
 #endif
     setFlagBit(FLAG_BIT_ATF16V8C, 0);
     
@@ -2656,49 +2940,37 @@ static char testProperGAL(void)
     return 1;
 
 error:
-    Serial.println(F("ER unknown or wrong GAL type (check Power ON)"));
+    printError(STATUS_GAL_TYPE);
+    Serial.println(F("unknown or wrong GAL type (check Power ON)"));
     return 0;
 }
 
 // prints a hexadecimal number - 2 digits with a leading zero
 static void printFormatedNumberHex2(unsigned char num) {
-  if (num < 16) {
-    Serial.print(F("0"));
-  }
-  Serial.print(num, HEX);  
+  static const char hex[] PROGMEM = "0123456789ABCDEF";
+
+  outPrint(pgm_read_byte(&hex[num >> 4]));
+  outPrint(pgm_read_byte(&hex[num & 0xF]));
 }
 
 // prints a hexadecimal number - 4 digits with a leading zero
 static void printFormatedNumberHex4(unsigned short num) {
-  if (num < 0x10) {
-    Serial.print(F("000"));
-  } else
-  if (num < 0x100) {
-    Serial.print(F("00"));
-  } else
-  if (num < 0x1000) {
-    Serial.print(F("0"));
-  }
-  Serial.print(num, HEX);  
+  printFormatedNumberHex2(num >> 8);
+  printFormatedNumberHex2(num & 0xFF);
 }
 
 // prints a decimal number - 4 digits with a leading zero
 static void printFormatedNumberDec4(unsigned short num) {
-  if (num < 1) {
-    Serial.print(F("0000"));
-    return;
+  if (num < 1000) {
+    outPrint('0');
   }
-
-  if (num < 10) {
-    Serial.print(F("000"));
-  } else
   if (num < 100) {
-    Serial.print(F("00"));
-  } else
-  if (num < 1000) {
-    Serial.print(F("0"));
+    outPrint('0');
+  }
+  if (num < 10) {
+    outPrint('0');
   }
-  Serial.print(num, DEC);  
+  outPrintDec(num);
 }
 
 // adds a formated decimal number with a leading zero to a line buffer at position 'i'
@@ -2714,85 +2986,75 @@ static unsigned char addFormatedNumberDec4(unsigned short num, unsigned char i)
 }
 
 // calculates fuse-map checksum and returns it
+// the checksum is the sum of the fuse bytes (8 fuses per byte, LSB first),
+// the last byte contains only the remaining fuses
 static unsigned short checkSum(unsigned short n)
 {
-    unsigned short c, e, i;
     unsigned long a;
+    uint8_t last;
 
-    c = e= 0;
-    a = 0;
-    for (i = 0; i < n; i++) {
-        e++;
-        if (e == 9) {
-          e = 1;
-          a += c;
-          c = 0;
-        }
-        c >>= 1;
-        if (getFuseBit(i)) {
-          c += 0x80;
-        }
+    fuseReadStart(0);
+    a = fuseReadSum(n >> 3);
+    if (n & 7) {
+        fuseReadBits(&last, n & 7);
+        a += last;
     }
-    return (unsigned short)((c >> (8 - e)) + a);
+    return (unsigned short) a;
 }
 
 static void printGalName() {
     switch (gal) {
-    case PEEL18CV8: Serial.println(F("PEEL18CV8")); break;
-    case GAL16V8: Serial.println(F("GAL16V8")); break;
-    case GAL18V10: Serial.println(F("GAL18V10")); break;
-    case GAL20V8: Serial.println(F("GAL20V8")); break;
-    case GAL20RA10: Serial.println(F("GAL20RA10")); break;
-    case GAL20XV10: Serial.println(F("GAL20XV10")); break;
-    case GAL22V10: Serial.println(F("GAL22V10")); break;
-    case GAL26CV12: Serial.println(F("GAL26CV12")); break;
-    case GAL26V12: Serial.println(F("GAL26V12")); break;
-    case GAL6001: Serial.println(F("GAL6001")); break;
-    case GAL6002: Serial.println(F("GAL6002")); break;
+    case PEEL18CV8: outPrintF(F("PEEL18CV8")); break;
+    case GAL16V8: outPrintF(F("GAL16V8")); break;
+    case GAL18V10: outPrintF(F("GAL18V10")); break;
+    case GAL20V8: outPrintF(F("GAL20V8")); break;
+    case GAL20RA10: outPrintF(F("GAL20RA10")); break;
+    case GAL20XV10: outPrintF(F("GAL20XV10")); break;
+    case GAL22V10: outPrintF(F("GAL22V10")); break;
+    case GAL26CV12: outPrintF(F("GAL26CV12")); break;
+    case GAL26V12: outPrintF(F("GAL26V12")); break;
+    case GAL6001: outPrintF(F("GAL6001")); break;
+    case GAL6002: outPrintF(F("GAL6002")); break;
     case ATF16V8B:
         if (flagBits & FLAG_BIT_ATF16V8C) {
-            Serial.println(F("ATF16V8C"));          
+            outPrintF(F("ATF16V8C"));          
         } else {
-            Serial.println(F("ATF16V8B"));
+            outPrintF(F("ATF16V8B"));
         }
         break;
-    case ATF20V8B: Serial.println(F("ATF20V8B")); break;
-    case ATF22V10B: Serial.println(F("ATF22V10B")); break;
-    case ATF22V10C: Serial.println(F("ATF22V10C")); break;
-    case ATF750C: Serial.println(F("ATF750C")); break;
-    default:  Serial.println(F("GAL")); break;
+    case ATF20V8B: outPrintF(F("ATF20V8B")); break;
+    case ATF22V10B: outPrintF(F("ATF22V10B")); break;
+    case ATF22V10C: outPrintF(F("ATF22V10C")); break;
+    case ATF750C: outPrintF(F("ATF750C")); break;
+    default:  outPrintF(F("GAL")); break;
     }
+    outPrintln();
 }
 
+// longest fuse row printed by printJedecBlock() (GAL6001: 114 fuses)
+#define JEDEC_ROW_BYTES 16
+
 static unsigned printJedecBlock(unsigned short k, unsigned short bits, unsigned short rows) {
   unsigned short i, j;
-  unsigned char unused;
+  uint8_t row[JEDEC_ROW_BYTES];
 
-  for (i = 0; i < bits; i++)
+  fuseReadStart(k);
+  for (i = 0; i < bits; i++, k += rows)
   {
-      unused = 1;
-      for (j = 0; j < rows; j++)
-      {
-        unused &= !getFuseBit(k + j);
-      }
-      if (unused) {
-        k += rows;
+      // the row is read once, unused rows (all fuses 0) are detected while reading
+      if (!fuseReadBits(row, rows)) {
         continue;
       }
 
-      Serial.print('L');
+      outPrint('L');
       printFormatedNumberDec4(k);
-      Serial.print(' ');
-      for (j = 0; j < rows; j++, k++)
+      outPrint(' ');
+      for (j = 0; j < rows; j++)
       {
-          if (getFuseBit(k)) {
-              unused = 0;
-              Serial.print('1');
-          } else {
-              Serial.print('0');
-          }
+          outPrint((row[j >> 3] & (1 << (j & 7))) ? '1' : '0');
       }
-      Serial.println('*');
+      outPrint('*');
+      outPrintln();
   }
   return k;
 }
@@ -2804,11 +3066,11 @@ static void printJedec()
     unsigned char unused, start;
     uint8_t apdFuse = (flagBits & FLAG_BIT_APD) ? 1 : 0;
 
-    Serial.print(F("JEDEC file for "));
+    outPrintF(F("JEDEC file for "));
     printGalName();
-    Serial.print(F("*QP")); Serial.print(galinfo.pins, DEC);
-    Serial.print(F("*QF")); Serial.print(galinfo.fuses + apdFuse, DEC);
-    Serial.println(F("*QV0*F0*G0*X0*"));
+    outPrintF(F("*QP")); outPrintDec(galinfo.pins);
+    outPrintF(F("*QF")); outPrintDec(galinfo.fuses + apdFuse);
+    outPrintF(F("*QV0*F0*G0*X0*")); outPrintln();
     
     k = 0;
     if (gal == GAL6001 || gal == GAL6002) {
@@ -2819,26 +3081,27 @@ static void printJedec()
     }
 
     if( k < galinfo.uesfuse) {
-        Serial.print('L');
+        outPrint('L');
         printFormatedNumberDec4(k);
-        Serial.print(' ');
+        outPrint(' ');
         
         while(k < galinfo.uesfuse) {
            if (getFuseBit(k)) {
               unused = 0;
-              Serial.print('1');
+              outPrint('1');
            } else {
-              Serial.print('0');
+              outPrint('0');
            }
            k++;
         }
-        Serial.println('*');
+        outPrint('*');
+        outPrintln();
     }
 
 
     // UES in byte form
     if (galinfo.uesbytes) {
-        Serial.print(F("N UES"));
+        outPrintF(F("N UES"));
 
         for (j = 0;j < galinfo.uesbytes; j++) {
             n = 0;
@@ -2852,77 +3115,85 @@ static void printJedec()
                     }
                 }
             }
-            Serial.print(' ');
+            outPrint(' ');
             printFormatedNumberHex2(n);
         }
-        Serial.println('*');
+        outPrint('*');
+        outPrintln();
 
         // UES in bit form
-        Serial.print('L');
+        outPrint('L');
         printFormatedNumberDec4(k);
-        Serial.print(' ');
+        outPrint(' ');
 
         for(j = 0; j < 8 * galinfo.uesbytes; j++) {
         if (getFuseBit(k++)) {
-            Serial.print('1');
+            outPrint('1');
         } else {
-            Serial.print('0');
+            outPrint('0');
         }
         }
-        Serial.println('*');
+        outPrint('*');
+        outPrintln();
     }
 
     // CFG bits
     if (k < galinfo.fuses) {
-      Serial.print('L');
+      outPrint('L');
       printFormatedNumberDec4(k);
-      Serial.print(' ');
+      outPrint(' ');
 
       while( k < galinfo.fuses) {
         if (getFuseBit(k++)) {
-           Serial.print('1');
+           outPrint('1');
         } else {
-           Serial.print('0');
+           outPrint('0');
         }
       }
       //ATF16V8C
       if (apdFuse) {
-        Serial.print('1');
+        outPrint('1');
         setFuseBit(k); // set for correct check-sum calculation
       }
-      Serial.println('*');
+      outPrint('*');
+      outPrintln();
     } else if (apdFuse) { //ATF22V10C
-      Serial.print('L');
+      outPrint('L');
       printFormatedNumberDec4(k);
-      Serial.println(F(" 1*"));
+      outPrintF(F(" 1*")); outPrintln();
       setFuseBit(k); // set for correct check-sum calculation
     }
 
     if (galinfo.pesbytes) {
-        Serial.print(F("N PES"));
+        outPrintF(F("N PES"));
         for(i = 0; i < galinfo.pesbytes; i++) {
-            Serial.print(' ');
+            outPrint(' ');
             printFormatedNumberHex2(pes[i]);
         }
-        Serial.println('*');
+        outPrint('*');
+        outPrintln();
     }
-    Serial.print('C');
+    outPrint('C');
     printFormatedNumberHex4(checkSum(galinfo.fuses + apdFuse));
-    Serial.println();
-    Serial.println('*');
-
+    outPrintln();
+    outPrint('*');
+    outPrintln();
+    outFlush();
 }
 
 // helper print function to save RAM space
 static void printNoFusesError() {
-  Serial.println(F("ER fuse map not uploaded"));
+  printError(STATUS_NO_FUSES);
+  Serial.println(F("fuse map not uploaded"));
 }
 static void printUnsupportedError() {
-  Serial.println(F("ER operation not supported"));
+  printError(STATUS_UNSUPPORTED);
+  Serial.println(F("operation not supported"));
 }
 
 static void printVariableVppNotSupportedError() {
-    Serial.println(F("ER variable VPP not supported"));
+    printError(STATUS_NO_VAR_VPP);
+    Serial.println(F("variable VPP not supported"));
 }
 
 static void testVoltage(int seconds) {
@@ -2972,14 +3243,19 @@ static char doTypeCheck(void) {
     setGalDefaults();
     return 1; // no need to do type check
   }
+  uint32_t start = micros();
+  char result;
+
   readPes();
   parsePes(UNKNOWN);
-  return testProperGAL();
+  result = testProperGAL();
+  timing[TIMING_TYPE_CHECK] += micros() - start;
+  return result;
 }
 
 static void measureVpp(uint8_t index) {
   varVppSet(index);
-  delay(150);
+  varVppWaitSettle(index, 150, 300);
   varVppMeasureVpp(1); //print measured value
   delay(5000);
 }
@@ -3017,7 +3293,23 @@ static void calibrateVpp(void) {
   }
 }
 
-static void startJtagPlayer(uint8_t vpp) {
+// Parses the optional JTAG chain padding of the j / J command: j<vpp>,<hir>,<tir>,<hdr>,<tdr>
+static void parseJtagChain(void) {
+  uint8_t* v = (uint8_t*) &jtag_chain;
+  uint8_t i = 2;
+  uint8_t n;
+
+  memset(&jtag_chain, 0, sizeof(jtag_chain));
+  for (n = 0; n < 4 && line[i] == ','; n++) {
+    i++;
+    while (line[i] >= '0' && line[i] <= '9') {
+      v[n] = v[n] * 10 + line[i] - '0';
+      i++;
+    }
+  }
+}
+
+static void startJtagPlayer(uint8_t vpp, char isp) {
   jtag_port_t jport;
   //assign jtag pins
   jport.tms = 12;
@@ -3035,8 +3327,13 @@ static void startJtagPlayer(uint8_t vpp) {
     varVppSet(vpp ? VPP_11V0 : VPP_5V0);
   }
 
-  // start XSVF player / processor
-  jtag_play_xsvf(&jport);
+  if (isp) {
+    // start ATF150x ISP engine
+    jtag_play_isp(&jport);
+  } else {
+    // start XSVF player / processor
+    jtag_play_xsvf(&jport);
+  }
 
   // unset VPP
   if (varVppExists) {
@@ -3053,11 +3350,18 @@ void loop() {
 
     // any unexpected input when uploading fuse map terminates the upload process
     if (isUploading && command != COMMAND_UTX && command != COMMAND_NONE) {
-      Serial.println(F("ER upload aborted"));
+      printError(STATUS_UPLOAD_ABORTED);
+      Serial.println(F("upload aborted"));
       isUploading = 0;
       lineIndex = 0;
     }
 
+    // the timing and the VPP log are collected per command, the query commands report the previous one
+    if (command != COMMAND_NONE && command != COMMAND_TIMING && command != COMMAND_VPP_LOG) {
+      timingReset();
+      vppLogReset();
+    }
+
     // handle commands received from the serial terminal
     switch (command) {
       
@@ -3107,7 +3411,9 @@ void loop() {
             readPes();
             type = checkGalTypeViaPes();
             parsePes(type);
+            uint8_t phase = timingEnter(TIMING_SERIAL);
             printPes(type);
+            timingEnter(phase);
         }
       } break;
 
@@ -3126,7 +3432,9 @@ void loop() {
       case COMMAND_READ_FUSES : {
         if (doTypeCheck()) {
           readOrVerifyGal(0); //just read, no verification
+          uint8_t phase = timingEnter(TIMING_SERIAL);
           printJedec();
+          timingEnter(phase);
         }
       } break;
 
@@ -3195,7 +3503,8 @@ void loop() {
             setGalDefaults();
           }
         } else {
-          Serial.print(F("ER Unknown gal type "));
+          printError(STATUS_UNKNOWN_GAL);
+          Serial.print(F("Unknown gal type "));
           Serial.println(type, DEC);
         }
       } break;
@@ -3232,7 +3541,8 @@ void loop() {
           Serial.print(F("Using cal offset: "));
           Serial.println(calOffset);
         } else {
-          Serial.println(F("ER: cal offset failed"));
+          printError(STATUS_CAL_OFFSET);
+          Serial.println(F("cal offset failed"));
         }
       } break;
 
@@ -3240,8 +3550,10 @@ void loop() {
         calibrateVpp();
       } break;
 
-      case COMMAND_JTAG_PLAYER: {
-        startJtagPlayer(line[1] == '1');
+      case COMMAND_JTAG_PLAYER:
+      case COMMAND_JTAG_ISP: {
+        parseJtagChain();
+        startJtagPlayer(line[1] == '1', command == COMMAND_JTAG_ISP);
         //flush the serial line in case the player ended abruptly
         readGarbage();
       } break;
@@ -3251,12 +3563,32 @@ void loop() {
         if (line[1] == 'p') {
             // progtime serves as the pulse duration during exercise
             progtime = parse45dec(2, 0);
+        } else if (line[1] == 'b') {
+            // vector table of the batch mode, the size has 5 digits
+            if (flagBits & FLAG_BIT_EXERCISE) {
+                exerciseRunTable(parse45dec(2, 1));
+            } else {
+                printError(STATUS_EXERCISE);
+                Serial.println(F("exercise mode is off"));
+            }
+            break;
+        } else if (line[1] == 's') {
+            // signature test: 2 digits of pin count, 6 hex digits of input pins, 6 hex digits of sampled pins
+            if (flagBits & FLAG_BIT_EXERCISE) {
+                exerciseSignature((line[2] - '0') * 10 + line[3] - '0',
+                    ((uint32_t) parse2hex(4) << 16) | ((uint32_t) parse2hex(6) << 8) | parse2hex(8),
+                    ((uint32_t) parse2hex(10) << 16) | ((uint32_t) parse2hex(12) << 8) | parse2hex(14));
+            } else {
+                printError(STATUS_EXERCISE);
+                Serial.println(F("exercise mode is off"));
+            }
+            break;
         } else {
             progtime = 100; // revert back to default prog time
             setFlagBit(FLAG_BIT_EXERCISE, line[1] == '1' ? 1 : 0);
         }
         lastShiftRegVal = 0;
-        setupGpios(INPUT);
+        setupGpios(INPUT); // the pins are configured again by the first vector
         pinMode(PIN_ZIF15, INPUT);
         pinMode(PIN_ZIF13, INPUT);
         Serial.println(F("OK"));
@@ -3266,14 +3598,39 @@ void loop() {
         exerciseSetPins(line + 1); // skip the command character
       } break;
 
+      case COMMAND_TIMING: {
+        printTiming();
+      } break;
+
+      case COMMAND_VPP_LOG: {
+        if (!varVppExists) {
+          printVariableVppNotSupportedError();
+        } else if (line[1] == '0' || line[1] == '1') {
+          vppLogOn = line[1] - '0';
+        } else {
+          vppLogPrint();
+        }
+      } break;
+
       default: {
         if (command != COMMAND_NONE) {
-          Serial.print(F("ER Unknown command: "));
+          printError(STATUS_UNKNOWN_COMMAND);
+          Serial.print(F("Unknown command: "));
           Serial.println(line);
         }
       }
     }
 
+    // close the timing of the command, the query command keeps the previous timing
+    if (command != COMMAND_NONE && command != COMMAND_TIMING && command != COMMAND_VPP_LOG) {
+      timingEnter(TIMING_SHIFT);
+    }
+
+    // VPP did not reach the calibrated voltage during the command
+    if (varVppExists) {
+      varVppReportFault();
+    }
+
     // display prompt character - important for the PC program to check that Arduino
     // finished the desired operation
     if (command != COMMAND_NONE) {
@@ -0,0 +1,359 @@
+/*
+
+ BENCH_FIRMWARE : firmware hot paths measured on the PC
+
+ part of Afterburner GAL project
+
+ Build: ./compile_bench.sh
+ Run:   ./bench_firmware [iterations] [file.jed ...]
+
+ The sketch is compiled for the Arduino UNO (sparse fuse map available)
+ against the stub Arduino layer in bench/stub. For every GAL type of
+ galInfoList (or for the given .jed files) it measures:
+
+   upload      parsing of the "#f" upload lines and setting the fuses
+   get         reading all fuses by getFuseBit()
+   checksum    checkSum() of the fuse map
+   jedec block printJedecBlock() of the AND array
+   print jedec printJedec() of the whole fuse map
+
+ with the byte-per-fuse map ("dense") and with the sparse fuse map. The
+ XSVF byte decoder is measured with a raw and an LZSS packed stream.
+
+ ns/op is the time of one operation on the whole fuse map (the fastest of
+ the iterations), bytes/op are the bytes received (upload, XSVF) or sent
+ (JEDEC) over the serial line.
+
+*/
+
+#include "Arduino.h"
+#include "../afterburner.ino"
+#include "corpus.h"
+
+#define MAX_UPLOAD (64 * 1024)
+#define XSVF_STREAM_SIZE (32 * 1024)
+#define XPACK_MIN_MATCH 3
+#define XPACK_MAX_MATCH (255 + XPACK_MIN_MATCH)
+
+// names of GALTYPE values
+static const char* typeNames[LAST_GAL_TYPE] = {
+  "UNKNOWN", "GAL16V8", "GAL18V10", "GAL20V8", "GAL20RA10", "GAL20XV10", "GAL22V10", "GAL26CV12",
+  "GAL26V12", "GAL6001", "GAL6002", "ATF16V8B", "ATF20V8B", "ATF22V10B", "ATF22V10C", "ATF750C",
+  "PEEL18CV8"
+};
+
+static unsigned char corpus[CORPUS_MAX_FUSES];
+static char jedecText[CORPUS_MAX_JEDEC];
+static char upload[MAX_UPLOAD];
+static int uploadSize;
+static char capture[2][CORPUS_MAX_JEDEC];
+static size_t captureSize[2];
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// runs the statement 'iterations' times and keeps the fastest run: the PC is never idle
+#define MEASURE(best, statement) { \
+  int n_; \
+  best = 1e9; \
+  for (n_ = 0; n_ < iterations; n_++) { \
+    double t_ = now(); \
+    statement; \
+    t_ = now() - t_; \
+    if (t_ < best) best = t_; \
+  } \
+}
+
+static void report(const char* type, const char* name, double seconds, double bytes) {
+  printf("%-10s %-20s %12.1f ns/op", type, name, seconds * 1e9);
+  if (bytes > 0) {
+    printf(" %9.0f bytes/op", bytes);
+  }
+  printf("\n");
+}
+
+// the upload lines as sent by the PC: 32 fuses per line, lines without any fuse set are skipped
+static void makeUpload(int fuses) {
+  int i, j, k;
+
+  uploadSize = 0;
+  for (i = 0; i < fuses;) {
+    char fuseSet = 0;
+    int pos = uploadSize + sprintf(upload + uploadSize, "#f %04i ", i);
+
+    for (j = 0; j < 4 && i < fuses; j++) {
+      unsigned char f = 0;
+      for (k = 0; k < 8 && i < fuses; k++, i++) {
+        if (corpus[i]) {
+          f |= (1 << k);
+          fuseSet = 1;
+        }
+      }
+      pos += sprintf(upload + pos, "%02X", f);
+    }
+    if (fuseSet) {
+      upload[pos++] = 0;
+      uploadSize = pos;
+    }
+  }
+}
+
+// clears the fuse map like the 'u' command does
+static void clearFuseMap(char sparse) {
+  memset(fusemap, 0, MAXFUSES);
+  if (sparse) {
+    sparseInit(1);
+  } else {
+    sparseDisable();
+  }
+}
+
+static void runUpload(char sparse) {
+  int i = 0;
+
+  clearFuseMap(sparse);
+  while (i < uploadSize) {
+    int len = strlen(upload + i);
+    memcpy(line, upload + i, len + 1);
+    lineIndex = len;
+    parseUploadLine();
+    i += len + 1;
+  }
+}
+
+// AND array blocks as printed by printJedec()
+static void printArray(void) {
+  if (gal == GAL6001 || gal == GAL6002) {
+    printJedecBlock(printJedecBlock(0, 64, 114), 11, 78);
+  } else {
+    printJedecBlock(0, galinfo.bits, galinfo.rows);
+  }
+  outFlush();
+}
+
+// the sparse map stores 4 bytes for each 32 fuse group that is not all 0
+static int sparseFits(int fuses) {
+  int groups = 0;
+  int i, j;
+
+  for (i = 0; i < fuses; i += 32) {
+    for (j = i; j < i + 32 && j < fuses; j++) {
+      if (corpus[j]) {
+        groups++;
+        break;
+      }
+    }
+  }
+  return groups * 4 <= MAXFUSES;
+}
+
+static int benchType(GALTYPE type, const char* name, int iterations) {
+  unsigned short expected;
+  int fuses, mode, i;
+  double t;
+  volatile unsigned long sum = 0;
+
+  gal = type;
+  copyGalInfo();
+  fuses = galinfo.fuses;
+  expected = corpusChecksum(corpus, fuses);
+  makeUpload(fuses);
+
+  for (mode = 0; mode < 2; mode++) {
+    char sparse = mode;
+    const char* label = sparse ? "sparse" : "dense";
+    char buf[64];
+
+    captureSize[mode] = 0;
+    if ((!sparse && (fuses + 7) / 8 > MAXFUSES) || (sparse && !sparseFits(fuses))) {
+      printf("%-10s %-20s does not fit into %d bytes\n", name, label, MAXFUSES);
+      continue;
+    }
+
+    MEASURE(t, runUpload(sparse));
+    snprintf(buf, sizeof(buf), "upload %s", label);
+    report(name, buf, t, uploadSize);
+
+    if (checkSum(fuses) != expected) {
+      printf("Error: %s %s checksum mismatch\n", name, label);
+      return 1;
+    }
+
+    MEASURE(t, for (i = 0; i < fuses; i++) sum += getFuseBit(i));
+    snprintf(buf, sizeof(buf), "get %s", label);
+    report(name, buf, t, 0);
+
+    MEASURE(t, sum += checkSum(fuses));
+    snprintf(buf, sizeof(buf), "checksum %s", label);
+    report(name, buf, t, 0);
+
+    benchSerialBytes = 0;
+    MEASURE(t, printArray());
+    snprintf(buf, sizeof(buf), "jedec block %s", label);
+    report(name, buf, t, (double) benchSerialBytes / iterations);
+
+    benchSerialBytes = 0;
+    MEASURE(t, printJedec());
+    snprintf(buf, sizeof(buf), "print jedec %s", label);
+    report(name, buf, t, (double) benchSerialBytes / iterations);
+
+    // keep one output to compare the fuse map modes
+    benchSerialCapture = capture[mode];
+    benchSerialCaptureSize = CORPUS_MAX_JEDEC;
+    benchSerialCapturePos = 0;
+    printJedec();
+    captureSize[mode] = benchSerialCapturePos;
+    benchSerialCapture = NULL;
+  }
+  if (captureSize[0] && captureSize[1] &&
+      (captureSize[0] != captureSize[1] || memcmp(capture[0], capture[1], captureSize[0]))) {
+    printf("Error: %s dense and sparse JEDEC output differ\n", name);
+    return 1;
+  }
+  return 0;
+}
+
+/* -------------------- XSVF -------------------- */
+
+// XSVF-like stream: SDR records of an ISP session with incrementing addresses
+static int makeXsvf(unsigned char* buf, int size) {
+  int pos = 0;
+  int row = 0;
+
+  corpusRandom = 777;
+  while (pos + 40 <= size) {
+    int i;
+    buf[pos++] = 0x02;      // XSIR
+    buf[pos++] = 10;
+    buf[pos++] = 0x00;
+    buf[pos++] = 0xA1;
+    buf[pos++] = 0x09;      // XSDRTDO
+    buf[pos++] = row >> 8;
+    buf[pos++] = row & 0xFF;
+    for (i = 0; i < 16; i++) {
+      buf[pos++] = (corpusNext() % 4) ? 0xFF : corpusNext();
+    }
+    for (i = 0; i < 12; i++) {
+      buf[pos++] = 0x00;
+    }
+    buf[pos++] = 0x04;      // XRUNTEST
+    buf[pos++] = 0x00;
+    buf[pos++] = 0x00;
+    row++;
+  }
+  return pos;
+}
+
+// LZSS packer of the PC client (without the XPACK instruction)
+static int packXsvf(const unsigned char* in, int size, unsigned char* out) {
+  int pos = 0, outPos = 0, flagPos = 0, flagBit = 8;
+
+  while (pos < size) {
+    int bestLen = 0, bestDist = 0, dist;
+    int maxLen = (size - pos > XPACK_MAX_MATCH) ? XPACK_MAX_MATCH : size - pos;
+
+    for (dist = 1; dist <= XPACK_HISTORY_SIZE && dist <= pos; dist++) {
+      int len = 0;
+      while (len < maxLen && in[pos - dist + len] == in[pos + len]) {
+        len++;
+      }
+      if (len > bestLen) {
+        bestLen = len;
+        bestDist = dist;
+      }
+    }
+    if (flagBit == 8) {
+      flagPos = outPos++;
+      out[flagPos] = 0;
+      flagBit = 0;
+    }
+    if (bestLen >= XPACK_MIN_MATCH) {
+      out[flagPos] |= 1 << flagBit;
+      out[outPos++] = bestDist - 1;
+      out[outPos++] = bestLen - XPACK_MIN_MATCH;
+      pos += bestLen;
+    } else {
+      out[outPos++] = in[pos++];
+    }
+    flagBit++;
+  }
+  return outPos;
+}
+
+static int benchXsvf(int iterations) {
+  static unsigned char raw[XSVF_STREAM_SIZE];
+  static unsigned char packed[XSVF_STREAM_SIZE * 2];
+  jtag_port_t port = {12, 2, 4, 3, 5};
+  int rawSize = makeXsvf(raw, XSVF_STREAM_SIZE);
+  int packedSize = packXsvf(raw, rawSize, packed);
+  static unsigned char out[XSVF_STREAM_SIZE];
+  int mode, k;
+  double best;
+
+  for (mode = 0; mode < 2; mode++) {
+    MEASURE(best, {
+      xsvf_player_init(&port);
+      xsvf->packed = mode;
+      benchSerialInput = mode ? packed : raw;
+      benchSerialInputSize = mode ? packedSize : rawSize;
+      benchSerialInputPos = 0;
+      for (k = 0; k < rawSize; k++) {
+        out[k] = xsvf_player_get_next_byte();
+      }
+    });
+    if (memcmp(out, raw, rawSize) != 0) {
+      printf("Error: XSVF decoder output differs\n");
+      return 1;
+    }
+    report("XSVF", mode ? "decode packed" : "decode raw", best, mode ? packedSize : rawSize);
+  }
+  benchSerialInput = NULL;
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  int iterations = (argc > 1) ? atoi(argv[1]) : 20;
+  int i;
+
+  if (iterations < 1) {
+    iterations = 1;
+  }
+  flagBits = 0;
+  printf("MCU fuse map: %d bytes, %d iterations\n", MAXFUSES, iterations);
+
+  // .jed files given: the GAL type is the first one with the same number of fuses
+  if (argc > 2) {
+    for (i = 2; i < argc; i++) {
+      int size;
+      int fuses = corpusLoadFile(argv[i], corpus, jedecText, &size);
+      int type;
+
+      for (type = 1; type < LAST_GAL_TYPE; type++) {
+        if (fuses == (int) pgm_read_word(&galInfoList[type].fuses)) {
+          break;
+        }
+      }
+      if (fuses < 0 || type == LAST_GAL_TYPE) {
+        printf("%s: not a known GAL fuse map\n", argv[i]);
+        continue;
+      }
+      printf("%s:\n", argv[i]);
+      if (benchType((GALTYPE) type, typeNames[type], iterations)) {
+        return 1;
+      }
+    }
+  } else {
+    for (i = 1; i < LAST_GAL_TYPE; i++) {
+      galinfo_t g;
+      memcpy_P(&g, &galInfoList[i], sizeof(galinfo_t));
+      corpusMakeFuses(corpus, g.fuses, g.rows, g.bits, 1000 + i);
+      if (benchType((GALTYPE) i, typeNames[i], iterations)) {
+        return 1;
+      }
+    }
+  }
+  return benchXsvf(iterations);
+}
@@ -0,0 +1,175 @@
+/*
+
+ BENCH_JEDEC : JEDEC parser and checksum micro benchmark
+
+ part of Afterburner GAL project
+
+ Build: ./compile_bench.sh
+ Run:   ./bench_jedec [iterations]
+
+ The JEDEC inputs are synthetic (random fuse maps), so the results do
+ not depend on local files. Each test reports the time per operation
+ and the parsing speed in MB/s.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../src_pc/jedec.h"
+
+#define GAL22V10_FUSES 5892
+#define ATF1504AS_FUSES 34192
+
+#define BATCH_SIZE 1000
+#define HUGE_COPIES 100
+#define CHUNK_SIZE (64 * 1024)
+
+static uint32_t rnd = 12345;
+
+static uint32_t nextRandom(void) {
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    return rnd;
+}
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Creates a JEDEC file with random fuses. Returns the file size.
+static int makeJedec(char* buf, int fuses, int pins, int lineFuses) {
+    int i;
+    int pos = sprintf(buf, "\x02JEDEC file by bench_jedec*\nQP%d*QF%d*G0*F0*\n", pins, fuses);
+
+    for (i = 0; i < fuses; i++) {
+        if (i % lineFuses == 0) {
+            pos += sprintf(buf + pos, "L%05d ", i);
+        }
+        buf[pos++] = (nextRandom() & 1) ? '1' : '0';
+        if (i % lineFuses == lineFuses - 1 || i == fuses - 1) {
+            pos += sprintf(buf + pos, "*\n");
+        }
+    }
+    pos += sprintf(buf + pos, "C0000*\n\x03" "0000\n");
+    return pos;
+}
+
+// the original byte per fuse checksum algorithm
+static unsigned short checkSumPerFuse(const JedecFile* j, int n) {
+    unsigned short c, e;
+    unsigned long a;
+    int i;
+
+    c = e = 0;
+    a = 0;
+    for (i = 0; i < n; i++) {
+        e++;
+        if (e == 9) {
+            e = 1;
+            a += c;
+            c = 0;
+        }
+        c >>= 1;
+        if (jedecGetFuse(j, i)) {
+            c += 0x80;
+        }
+    }
+    return (unsigned short)((c >> (8 - e)) + a);
+}
+
+static void report(const char* name, double seconds, int ops, double bytes) {
+    printf("%-34s %10.1f ns/op", name, seconds * 1e9 / ops);
+    if (bytes > 0) {
+        printf(" %8.1f MB/s", bytes / seconds / 1e6);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    static JedecFile j;
+    int iterations = (argc > 1) ? atoi(argv[1]) : 200;
+    char* large = (char*) malloc(64 * 1024);
+    char* huge;
+    char** batch = (char**) malloc(BATCH_SIZE * sizeof(char*));
+    int* batchSize = (int*) malloc(BATCH_SIZE * sizeof(int));
+    int largeSize, hugeSize, i, k;
+    double t, batchBytes = 0;
+    volatile unsigned short sum = 0;
+
+    if (iterations < 1) {
+        iterations = 1;
+    }
+
+    // large: ATF1504AS design, 64 fuses per line
+    largeSize = makeJedec(large, ATF1504AS_FUSES, 44, 64);
+
+    // huge: many designs in one buffer, as if the file was memory mapped
+    huge = (char*) malloc((size_t) largeSize * HUGE_COPIES);
+    for (hugeSize = 0, i = 0; i < HUGE_COPIES; i++) {
+        memcpy(huge + hugeSize, large, largeSize);
+        hugeSize += largeSize;
+    }
+
+    // batch: many GAL22V10 designs, 44 fuses per line
+    for (i = 0; i < BATCH_SIZE; i++) {
+        batch[i] = (char*) malloc(16 * 1024);
+        batchSize[i] = makeJedec(batch[i], GAL22V10_FUSES, 24, 44);
+        batchBytes += batchSize[i];
+    }
+
+    printf("large: %d bytes, huge: %d bytes, batch: %d files\n", largeSize, hugeSize, BATCH_SIZE);
+
+    t = now();
+    for (i = 0; i < iterations; i++) {
+        jedecInit(&j);
+        jedecParse(&j, large, largeSize);
+        sum += jedecChecksum(&j, j.fuseCount);
+    }
+    report("parse + checksum ATF1504AS", now() - t, iterations, (double) largeSize * iterations);
+
+    t = now();
+    for (i = 0; i < iterations / 10 + 1; i++) {
+        jedecInit(&j);
+        for (k = 0; k < hugeSize; k += CHUNK_SIZE) {
+            jedecParse(&j, huge + k, (hugeSize - k < CHUNK_SIZE) ? hugeSize - k : CHUNK_SIZE);
+        }
+        sum += jedecChecksum(&j, j.fuseCount);
+    }
+    report("parse + checksum huge, by chunks", now() - t, iterations / 10 + 1, (double) hugeSize * (iterations / 10 + 1));
+
+    t = now();
+    for (i = 0; i < BATCH_SIZE; i++) {
+        jedecInit(&j);
+        jedecParse(&j, batch[i], batchSize[i]);
+        sum += jedecChecksum(&j, j.fuseCount);
+    }
+    report("parse + checksum GAL22V10 batch", now() - t, BATCH_SIZE, batchBytes);
+
+    jedecInit(&j);
+    jedecParse(&j, large, largeSize);
+    if (jedecChecksum(&j, j.fuseCount) != checkSumPerFuse(&j, j.fuseCount)) {
+        printf("Error: checksum mismatch\n");
+        return 1;
+    }
+
+    t = now();
+    for (i = 0; i < iterations * 10; i++) {
+        sum += jedecChecksum(&j, j.fuseCount - (i & 7));
+    }
+    report("checksum ATF1504AS, word wise", now() - t, iterations * 10, 0);
+
+    t = now();
+    for (i = 0; i < iterations * 10; i++) {
+        sum += checkSumPerFuse(&j, j.fuseCount - (i & 7));
+    }
+    report("checksum ATF1504AS, per fuse", now() - t, iterations * 10, 0);
+
+    return 0;
+}
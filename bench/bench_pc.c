@@ -0,0 +1,153 @@
+/*
+
+ BENCH_PC : PC client hot paths
+
+ part of Afterburner GAL project
+
+ Build: ./compile_bench.sh
+ Run:   ./bench_pc [iterations] [file.jed ...]
+
+ For every GAL type of afbGalInfo (or for the given .jed files) it measures:
+
+   parse       parsing of the .jed file into the design (afbDesignLoadBuffer)
+   checksum    the fuse map checksum (jedecChecksum)
+   upload      encoding of the fuse map into the "#f" upload lines (afbEncodeUploadLine)
+
+ The corpus is the same as the one of bench_firmware.
+
+ ns/op is the time of one operation on the whole fuse map (the fastest of
+ the iterations), bytes/op are the .jed bytes parsed or the bytes of the
+ upload lines sent to the programmer.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src_pc/libafterburner.h"
+#include "../src_pc/jedec.h"
+#include "corpus.h"
+
+// runs the statement 'iterations' times and keeps the fastest run: the PC is never idle
+#define MEASURE(best, statement) { \
+    int n_; \
+    best = 1e9; \
+    for (n_ = 0; n_ < iterations; n_++) { \
+        double t_ = now(); \
+        statement; \
+        t_ = now() - t_; \
+        if (t_ < best) best = t_; \
+    } \
+}
+
+static unsigned char corpus[CORPUS_MAX_FUSES];
+static char jedecText[CORPUS_MAX_JEDEC];
+static int jedecSize;
+static AfbDesign design;
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void report(const char* type, const char* name, double seconds, double bytes) {
+    printf("%-10s %-20s %12.1f ns/op", type, name, seconds * 1e9);
+    if (bytes > 0) {
+        printf(" %9.0f bytes/op", bytes);
+    }
+    printf("\n");
+}
+
+// encodes the upload lines of the whole fuse map, returns the bytes of the lines that are sent
+static long encodeUpload(const AfbDesign* d) {
+    int totalFuses = afbGalInfo[d->gal].fuses + (d->apdFuse ? 1 : 0);
+    char buf[AFB_UPLOAD_LINE_SIZE];
+    long bytes = 0;
+    int i = 0;
+
+    while (i < totalFuses) {
+        char fuseSet;
+
+        i = afbEncodeUploadLine(d, i, buf, &fuseSet);
+        if (fuseSet) {
+            bytes += strlen(buf) + 1;
+        }
+    }
+    return bytes;
+}
+
+static int benchType(AfbGalType type, int iterations) {
+    const AfbGalInfo* g = &afbGalInfo[type];
+    volatile unsigned short sum = 0;
+    long uploadBytes = 0;
+    double t;
+
+    MEASURE(t, afbDesignLoadBuffer(&design, type, jedecText, jedecSize));
+    report(g->name, "parse", t, jedecSize);
+    if (design.jedec.fuseCount != g->fuses ||
+        design.calculatedChecksum != corpusChecksum(corpus, g->fuses)) {
+        printf("Error: %s parsed fuse map differs\n", g->name);
+        return 1;
+    }
+
+    MEASURE(t, sum += jedecChecksum(&design.jedec, g->fuses));
+    report(g->name, "checksum", t, 0);
+
+    // the JTAG devices are not programmed by the upload lines
+    if (g->id0 == AFB_JTAG_ID) {
+        return 0;
+    }
+    MEASURE(t, uploadBytes = encodeUpload(&design));
+    report(g->name, "upload", t, uploadBytes);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int iterations = (argc > 1) ? atoi(argv[1]) : 20;
+    int i;
+
+    if (iterations < 1) {
+        iterations = 1;
+    }
+    printf("%d iterations\n", iterations);
+
+    // .jed files given: the GAL type is the first one with the same number of fuses
+    if (argc > 2) {
+        for (i = 2; i < argc; i++) {
+            int fuses = corpusLoadFile(argv[i], corpus, jedecText, &jedecSize);
+            int type;
+
+            for (type = 1; type < afbGalInfoCount; type++) {
+                if (fuses == afbGalInfo[type].fuses) {
+                    break;
+                }
+            }
+            if (fuses < 0 || type == afbGalInfoCount) {
+                printf("%s: not a known fuse map\n", argv[i]);
+                continue;
+            }
+            printf("%s:\n", argv[i]);
+            if (benchType((AfbGalType) type, iterations)) {
+                return 1;
+            }
+        }
+    } else {
+        for (i = 1; i < afbGalInfoCount; i++) {
+            const AfbGalInfo* g = &afbGalInfo[i];
+            // the JTAG devices have no product term rows in the table: 64 fuse lines
+            int termFuses = g->bits ? g->rows : 64;
+            int terms = g->bits ? g->bits : g->fuses / 64;
+
+            // the same seed as bench_firmware uses for the GAL type
+            corpusMakeFuses(corpus, g->fuses, termFuses, terms, 1000 + i);
+            jedecSize = corpusMakeJedec(jedecText, g->name, corpus, g->fuses, g->pins, termFuses);
+            if (benchType((AfbGalType) i, iterations)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+
+ CORPUS : JEDEC designs for the benchmarks
+
+ part of Afterburner GAL project
+
+ Generates a fuse map that looks like a fitted design: the AND array is
+ made of product terms ('rows' fuses each), most of them unused (all 0),
+ the used ones have all fuses 1 except the few connected inputs. The UES
+ and config fuses are random. The generator is deterministic, so the
+ PC and the firmware benchmarks get the same corpus.
+
+ Real .jed files can be loaded instead (QF, F and L fields are read).
+
+ Fuse maps are stored one byte per fuse (0 or 1).
+
+*/
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#define CORPUS_MAX_FUSES 40000
+#define CORPUS_MAX_JEDEC (64 * 1024)
+
+// percentage of the used product terms
+#define CORPUS_USED_TERMS 35
+
+static uint32_t corpusRandom = 12345;
+
+static uint32_t corpusNext(void) {
+    corpusRandom ^= corpusRandom << 13;
+    corpusRandom ^= corpusRandom >> 17;
+    corpusRandom ^= corpusRandom << 5;
+    return corpusRandom;
+}
+
+// 'terms' product terms of 'termFuses' fuses, the rest up to 'fuses' is random
+static void corpusMakeFuses(unsigned char* map, int fuses, int termFuses, int terms, uint32_t seed) {
+    int i, j;
+    int array = termFuses * terms;
+
+    corpusRandom = seed ? seed : 1;
+    if (array > fuses) {
+        array = fuses;
+    }
+    for (i = 0; i < array; i += termFuses) {
+        char used = (corpusNext() % 100) < CORPUS_USED_TERMS;
+        int inputs = 1 + corpusNext() % 6;
+        for (j = 0; j < termFuses && i + j < array; j++) {
+            map[i + j] = used;
+        }
+        // connected inputs have the fuse 0
+        while (used && inputs--) {
+            map[i + corpusNext() % termFuses] = 0;
+        }
+    }
+    for (i = array; i < fuses; i++) {
+        map[i] = corpusNext() & 1;
+    }
+}
+
+// the checksum of the JEDEC C field
+static unsigned short corpusChecksum(const unsigned char* map, int fuses) {
+    unsigned short c = 0, e = 0;
+    unsigned long a = 0;
+    int i;
+
+    for (i = 0; i < fuses; i++) {
+        e++;
+        if (e == 9) {
+            e = 1;
+            a += c;
+            c = 0;
+        }
+        c >>= 1;
+        if (map[i]) {
+            c += 0x80;
+        }
+    }
+    return (unsigned short)((c >> (8 - e)) + a);
+}
+
+// writes the fuse map as a JEDEC file, one product term per L field, returns the size
+static int corpusMakeJedec(char* buf, const char* name, const unsigned char* map, int fuses, int pins, int lineFuses) {
+    int i;
+    int pos = sprintf(buf, "\x02JEDEC file for %s*\nQP%d*QF%d*QV0*F0*G0*\n", name, pins, fuses);
+
+    for (i = 0; i < fuses; i++) {
+        if (i % lineFuses == 0) {
+            pos += sprintf(buf + pos, "L%05d ", i);
+        }
+        buf[pos++] = map[i] ? '1' : '0';
+        if (i % lineFuses == lineFuses - 1 || i == fuses - 1) {
+            pos += sprintf(buf + pos, "*\n");
+        }
+    }
+    pos += sprintf(buf + pos, "C%04X*\n\x03" "0000\n", corpusChecksum(map, fuses));
+    return pos;
+}
+
+// reads the QF, F and L fields of a .jed file, returns the number of fuses or -1
+static int corpusLoadFile(const char* fileName, unsigned char* map, char* text, int* textSize) {
+    FILE* f = fopen(fileName, "rb");
+    int size, fuses = 0;
+    int i = 0;
+
+    if (f == NULL) {
+        return -1;
+    }
+    size = (int) fread(text, 1, CORPUS_MAX_JEDEC - 1, f);
+    fclose(f);
+    text[size] = 0;
+    *textSize = size;
+    memset(map, 0, CORPUS_MAX_FUSES);
+
+    // fields start after '*', the first one after STX
+    while (i < size) {
+        while (i < size && (text[i] == '\r' || text[i] == '\n' || text[i] == ' ' || text[i] == '\x02')) {
+            i++;
+        }
+        if (text[i] == 'Q' && text[i + 1] == 'F') {
+            fuses = atoi(text + i + 2);
+        } else if (text[i] == 'F') {
+            memset(map, text[i + 1] == '1', CORPUS_MAX_FUSES);
+        } else if (text[i] == 'L') {
+            int address = atoi(text + i + 1);
+            while (i < size && text[i] != ' ') {
+                i++;
+            }
+            for (; i < size && text[i] != '*'; i++) {
+                if ((text[i] == '0' || text[i] == '1') && address < CORPUS_MAX_FUSES) {
+                    map[address++] = text[i] - '0';
+                }
+            }
+        }
+        while (i < size && text[i] != '*') {
+            i++;
+        }
+        i++;
+    }
+    return (fuses > 0 && fuses <= CORPUS_MAX_FUSES) ? fuses : -1;
+}
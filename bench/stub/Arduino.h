@@ -0,0 +1,138 @@
+/*
+
+ Host stub of the Arduino layer used by the firmware benchmark
+
+ part of Afterburner GAL project
+
+ Only what afterburner.ino needs to compile on a PC. GPIOs and delays do
+ nothing, micros() is the host's monotonic clock. Serial output is counted
+ in benchSerialBytes and copied into benchSerialCapture while it is set,
+ Serial input is read from benchSerialInput.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PROGMEM
+#define F(x) ((const __FlashStringHelper*)(x))
+class __FlashStringHelper;
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define memcpy_P memcpy
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define DEC 10
+#define HEX 16
+#define EXTERNAL 0
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+#define noInterrupts()
+#define interrupts()
+
+typedef uint8_t byte;
+
+static inline void pinMode(uint8_t, uint8_t) {}
+static inline void digitalWrite(uint8_t, uint8_t) {}
+static inline int digitalRead(uint8_t) { return 0; }
+static inline int analogRead(uint8_t) { return 0; }
+static inline void analogReference(uint8_t) {}
+static inline void delay(unsigned long) {}
+static inline void delayMicroseconds(unsigned int) {}
+
+static inline unsigned long micros(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (unsigned long) (t.tv_sec * 1000000L + t.tv_nsec / 1000);
+}
+
+static inline unsigned long millis(void) {
+  return micros() / 1000;
+}
+
+// serial output counter and optional capture buffer
+static unsigned long benchSerialBytes = 0;
+static char* benchSerialCapture = NULL;
+static size_t benchSerialCaptureSize = 0;
+static size_t benchSerialCapturePos = 0;
+
+// serial input
+static const uint8_t* benchSerialInput = NULL;
+static size_t benchSerialInputSize = 0;
+static size_t benchSerialInputPos = 0;
+
+static inline size_t benchSerialWrite(const char* b, size_t n) {
+  benchSerialBytes += n;
+  if (benchSerialCapture != NULL && benchSerialCapturePos + n <= benchSerialCaptureSize) {
+    memcpy(benchSerialCapture + benchSerialCapturePos, b, n);
+    benchSerialCapturePos += n;
+  }
+  return n;
+}
+
+class HardwareSerial {
+public:
+  void begin(long) {}
+  void setTimeout(long) {}
+  void flush() {}
+  int availableForWrite() { return 63; }
+  int available() { return (int) (benchSerialInputSize - benchSerialInputPos); }
+  int read() {
+    return (benchSerialInputPos < benchSerialInputSize) ? benchSerialInput[benchSerialInputPos++] : -1;
+  }
+  size_t readBytes(char* b, size_t n) { return readBytes((uint8_t*) b, n); }
+  size_t readBytes(uint8_t* b, size_t n) {
+    size_t left = benchSerialInputSize - benchSerialInputPos;
+    if (n > left) {
+      n = left;
+    }
+    memcpy(b, benchSerialInput + benchSerialInputPos, n);
+    benchSerialInputPos += n;
+    return n;
+  }
+
+  size_t write(uint8_t c) { return benchSerialWrite((const char*) &c, 1); }
+  size_t write(const uint8_t* b, size_t n) { return benchSerialWrite((const char*) b, n); }
+  size_t write(const char* b, size_t n) { return benchSerialWrite(b, n); }
+
+  size_t print(const __FlashStringHelper* s) { return print((const char*) s); }
+  size_t print(const char* s) { return benchSerialWrite(s, strlen(s)); }
+  size_t print(char c) { return benchSerialWrite(&c, 1); }
+  size_t print(unsigned char v, int base = DEC) { return print((unsigned long) v, base); }
+  size_t print(short v, int base = DEC) { return print((long) v, base); }
+  size_t print(unsigned short v, int base = DEC) { return print((unsigned long) v, base); }
+  size_t print(int v, int base = DEC) { return print((long) v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long) v, base); }
+  size_t print(long v, int base = DEC) {
+    char t[24];
+    return benchSerialWrite(t, snprintf(t, sizeof(t), base == HEX ? "%lX" : "%ld", v));
+  }
+  size_t print(unsigned long v, int base = DEC) {
+    char t[24];
+    return benchSerialWrite(t, snprintf(t, sizeof(t), base == HEX ? "%lX" : "%lu", v));
+  }
+  size_t print(double v, int digits = 2) {
+    char t[32];
+    return benchSerialWrite(t, snprintf(t, sizeof(t), "%.*f", digits, v));
+  }
+
+  size_t println() { return benchSerialWrite("\r\n", 2); }
+  template<class T> size_t println(T v) { size_t r = print(v); return r + println(); }
+  template<class T> size_t println(T v, int base) { size_t r = print(v, base); return r + println(); }
+};
+
+static HardwareSerial Serial;
@@ -0,0 +1,22 @@
+/*
+
+ Host stub of the Arduino EEPROM library used by the firmware benchmark
+
+ part of Afterburner GAL project
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+class EEPROMClass {
+public:
+  uint8_t read(int address) { return data[address & 1023]; }
+  void write(int address, uint8_t value) { data[address & 1023] = value; }
+  void update(int address, uint8_t value) { data[address & 1023] = value; }
+private:
+  uint8_t data[1024];
+};
+
+static EEPROMClass EEPROM;
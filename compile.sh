@@ -2,4 +2,6 @@
 GCOM=`git  rev-parse --short HEAD`
 
 
-gcc -g2 -O0 -DNO_CLOSE -DGCOM="\"g${GCOM}\"" -o afterburner src_pc/afterburner.c src_pc/exerciser.c
+gcc -g2 -O0 -DNO_CLOSE -DGCOM="\"g${GCOM}\"" -o afterburner src_pc/afterburner.c src_pc/exerciser.c src_pc/galsim.c src_pc/jedec.c src_pc/libafterburner.c
+gcc -g2 -O0 -DNO_CLOSE -o afterburnerd src_pc/afterburnerd.c src_pc/jedec.c src_pc/libafterburner.c
+gcc -g2 -O0 -o aftrace src_pc/aftrace.c
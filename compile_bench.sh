@@ -0,0 +1,9 @@
+
+# host benchmarks of the PC code, built with optimisations
+
+gcc -O2 -o bench_jedec bench/bench_jedec.c src_pc/jedec.c
+gcc -O2 -o bench_pc bench/bench_pc.c src_pc/libafterburner.c src_pc/jedec.c
+
+# firmware (Arduino UNO configuration) built against the stub Arduino layer
+
+g++ -O2 -Ibench/stub -o bench_firmware bench/bench_firmware.cpp
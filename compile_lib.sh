@@ -0,0 +1,8 @@
+
+# static library for embedding the programmer support into other programs
+# link with: -I<path>/src_pc <path>/libafterburner.a
+
+gcc -O2 -c -o libafterburner.o src_pc/libafterburner.c
+gcc -O2 -c -o jedec.o src_pc/jedec.c
+ar rcs libafterburner.a libafterburner.o jedec.o
+rm -f libafterburner.o jedec.o
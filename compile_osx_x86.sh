@@ -5,4 +5,6 @@ CC=x86_64-apple-darwin24.4-clang
 GCOM=`git  rev-parse --short HEAD`
 
 
-$CC -g3 -O0 -D_OSX_ -DNO_CLOSE -DGCOM="\"g${GCOM}\"" -o afterburner_osx_x86  src_pc/afterburner.c src_pc/exerciser.c
+$CC -g3 -O0 -D_OSX_ -DNO_CLOSE -DGCOM="\"g${GCOM}\"" -o afterburner_osx_x86  src_pc/afterburner.c src_pc/exerciser.c src_pc/galsim.c src_pc/jedec.c src_pc/libafterburner.c
+$CC -g3 -O0 -D_OSX_ -DNO_CLOSE -o afterburnerd_osx_x86  src_pc/afterburnerd.c src_pc/jedec.c src_pc/libafterburner.c
+$CC -g3 -O0 -D_OSX_ -o aftrace_osx_x86  src_pc/aftrace.c
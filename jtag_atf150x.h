@@ -0,0 +1,323 @@
+#ifndef _JTAG_ATF150X_H_
+#define _JTAG_ATF150X_H_
+
+/*
+ATF1502AS / ATF1504AS native ISP engine for Afterburner GAL project
+-------------------------------------------------------------------
+Programs and verifies ATF150x CPLDs without XSVF. Instead of receiving
+pre-generated SIR/SDR/RUNTEST instructions, the engine receives compact
+row records (ISP stream) and generates the JTAG sequences itself.
+The sequences follow the SVF files produced by utils/jtag/fuseconv.py.
+
+Requires jtag_xsvf_player.h to be included first: the TAP helpers,
+serial feed requests ($062) and the heap buffers are shared with the
+XSVF player.
+
+ISP stream format (multi-byte values are big endian):
+  ISP_END                            : end of the stream
+  ISP_IDCODE  <idcode:4>             : check the device IDCODE
+  ISP_ENABLE                         : enter ISC mode
+  ISP_ERASE                          : bulk erase
+  ISP_WIDTH   <bits:2>               : set the row width for next records
+  ISP_PROGRAM <address:2> <data:N>   : program a row
+  ISP_VERIFY  <address:2> <data:N>   : read a row and compare
+  ISP_DISABLE                        : leave ISC mode
+  ISP_READ    <address:2>            : read a row and send it to the PC
+  ISP_SCAN                           : scan the JTAG chain, see xsvf_jtag_scan_chain()
+  N = (width + 7) / 8 bytes; row bit 0 is the LSB of the last byte.
+
+The rows read by ISP_READ are sent as binary frames (no new line):
+  ISP_ROW_FRAME <N:1> <data:N>
+ISP_ROW_FRAME is a control character, so no text line of the player starts with it.
+
+Arduino usage:
+  jtag_port_t jport;
+  ... assign jtag pins the same way as for the XSVF player
+  ... set jtag_chain when the target device is in a JTAG chain
+  jtag_play_isp(&jport);
+*/
+
+#define ISP_END       0
+#define ISP_IDCODE    1
+#define ISP_ENABLE    2
+#define ISP_ERASE     3
+#define ISP_PROGRAM   4
+#define ISP_VERIFY    5
+#define ISP_DISABLE   6
+#define ISP_WIDTH     7
+#define ISP_READ      8
+#define ISP_SCAN      9
+
+#define ISP_ROW_FRAME 0x02      // STX: starts the binary frame of a row read by ISP_READ
+
+// ATF15xx instructions (IR is 10 bits long)
+#define ATF_IDCODE            0x059
+#define ATF_ISC_CONFIG        0x280
+#define ATF_ISC_READ          0x28C
+#define ATF_ISC_DATA          0x290
+#define ATF_ISC_PROGRAM_ERASE 0x29E
+#define ATF_ISC_ADDRESS       0x2A1
+#define ATF_ISC_LATCH_ERASE   0x2B3
+#define ATF_ISC_UNKNOWN       0x2BF
+
+#define ATF_IDCODE_MASK       0xFFFEEFFF
+
+// run-test times in microseconds
+#define ATF_TIME_ERASE   210000
+#define ATF_TIME_PROGRAM  30000
+#define ATF_TIME_READ     20000
+
+#define ERR_ISP_IDCODE 110
+#define ERR_ISP_VERIFY 111
+#define ERR_ISP_WIDTH  112
+
+// the row width set by ISP_WIDTH record
+static uint16_t isp_row_bits;
+
+static void isp_sir(jtag_port_t* port, uint16_t ir) {
+  xsvf->sirsize_bits = 10;
+  xsvf->sirsize_bytes = 2;
+  xsvf->xsvf_tdi[0] = ir >> 8;
+  xsvf->xsvf_tdi[1] = ir & 0xFF;
+  xsvf_jtag_sir(port);
+}
+
+// shifts xsvf_tdi into DR, the captured bits are stored in xsvf_tdo
+static void isp_sdr(jtag_port_t* port, uint16_t bits) {
+  xsvf->sdrsize_bits = bits;
+  xsvf->sdrsize_bytes = (bits + 7) >> 3;
+  // begin + end, no TDO check
+  xsvf_jtag_sdr(port, 0b1001);
+  xsvf_jtagtap_state_goto(port, xsvf->enddr_state);
+}
+
+static void isp_sdr_value(jtag_port_t* port, uint16_t bits, uint32_t value) {
+  uint8_t i = (bits + 7) >> 3;
+  while (i) {
+    i--;
+    xsvf->xsvf_tdi[i] = value & 0xFF;
+    value >>= 8;
+  }
+  isp_sdr(port, bits);
+}
+
+static void isp_runtest(jtag_port_t* port, uint32_t usecs) {
+  xsvf_jtagtap_state_goto(port, XSTATE_RUN_TEST_IDLE);
+  xsvf_jtagtap_wait_time(port, usecs, 0);
+  xsvf_jtagtap_state_goto(port, XSTATE_RUN_TEST_IDLE);
+}
+
+static void isp_set_address(jtag_port_t* port, uint16_t address) {
+  isp_sir(port, ATF_ISC_ADDRESS);
+  isp_sdr_value(port, 11, address);
+}
+
+static uint8_t isp_check_idcode(jtag_port_t* port) {
+  uint32_t expected = xsvf_player_get_next_long();
+  uint32_t id = 0;
+  uint8_t i;
+
+  isp_sir(port, ATF_IDCODE);
+  isp_sdr_value(port, 32, ATF_IDCODE_MASK);
+  for (i = 0; i < 4; i++) {
+    id <<= 8;
+    id |= xsvf->xsvf_tdo[i];
+  }
+  if ((id & ATF_IDCODE_MASK) != (expected & ATF_IDCODE_MASK)) {
+    Serial.print(F("!IDCODE mismatch: 0x"));
+    Serial.println(id, HEX);
+    return ERR_ISP_IDCODE;
+  }
+  return 0;
+}
+
+static void isp_config(jtag_port_t* port, uint16_t value) {
+  isp_sir(port, ATF_ISC_CONFIG);
+  isp_sdr_value(port, 10, value);
+  xsvf_jtagtap_state_goto(port, XSTATE_RUN_TEST_IDLE);
+}
+
+static void isp_erase(jtag_port_t* port) {
+  isp_sir(port, ATF_ISC_LATCH_ERASE);
+  isp_sir(port, ATF_ISC_PROGRAM_ERASE);
+  isp_runtest(port, ATF_TIME_ERASE);
+  isp_sir(port, ATF_ISC_UNKNOWN);
+}
+
+// reads the row address and row data from the stream
+static uint16_t isp_read_row(void) {
+  uint16_t address = xsvf_player_get_next_byte();
+  address <<= 8;
+  address |= xsvf_player_get_next_byte();
+  xsvf->sdrsize_bytes = (isp_row_bits + 7) >> 3;
+  xsvf_player_get_next_bytes(xsvf->xsvf_tdi, xsvf->sdrsize_bytes);
+  return address;
+}
+
+static void isp_program_row(jtag_port_t* port) {
+  uint16_t address = isp_read_row();
+
+  // the row data are in xsvf_tdi - keep them in tdo_expected while setting the address
+  memcpy(xsvf->xsvf_tdo_expected, xsvf->xsvf_tdi, xsvf->sdrsize_bytes);
+  isp_set_address(port, address);
+  isp_sir(port, ATF_ISC_DATA | (address >> 8));
+  memcpy(xsvf->xsvf_tdi, xsvf->xsvf_tdo_expected, (isp_row_bits + 7) >> 3);
+  isp_sdr(port, isp_row_bits);
+  isp_sir(port, ATF_ISC_PROGRAM_ERASE);
+  isp_runtest(port, ATF_TIME_PROGRAM);
+  isp_sir(port, ATF_ISC_UNKNOWN);
+}
+
+// reads the row from the device, the row bits are stored in xsvf_tdo
+static void isp_read_device_row(jtag_port_t* port, uint16_t address) {
+  isp_set_address(port, address);
+  isp_sir(port, ATF_ISC_READ);
+  isp_runtest(port, ATF_TIME_READ);
+  isp_sir(port, ATF_ISC_DATA | (address >> 8));
+  memcpy(xsvf->xsvf_tdi, xsvf->xsvf_tdo_expected, (isp_row_bits + 7) >> 3);
+  isp_sdr(port, isp_row_bits);
+}
+
+static uint8_t isp_verify_row(jtag_port_t* port) {
+  uint16_t address = isp_read_row();
+
+  memcpy(xsvf->xsvf_tdo_expected, xsvf->xsvf_tdi, xsvf->sdrsize_bytes);
+  isp_read_device_row(port, address);
+  if (!xsvf_jtag_is_tdo_as_expected(0)) {
+    Serial.print(F("!verify failed row: "));
+    Serial.println(address, DEC);
+    return 1;
+  }
+  return 0;
+}
+
+// reads the row from the device and sends it to the PC as a binary frame
+static void isp_send_row(jtag_port_t* port) {
+  uint16_t address = xsvf_player_get_next_byte();
+  uint8_t size = (isp_row_bits + 7) >> 3;
+  address <<= 8;
+  address |= xsvf_player_get_next_byte();
+
+  // shift in all ones while reading
+  memset(xsvf->xsvf_tdo_expected, 0xFF, size);
+  isp_read_device_row(port, address);
+  Serial.write(ISP_ROW_FRAME);
+  Serial.write(size);
+  Serial.write(xsvf->xsvf_tdo, size);
+}
+
+static uint8_t isp_handle_next_record(jtag_port_t* port, uint16_t* verifyErrors) {
+  uint8_t record = xsvf_player_get_next_byte();
+  if (xsvf->error) {
+    return ERR_IO;
+  }
+  xsvf->instruction_counter++;
+
+  if (record == ISP_END) {
+    xsvf->xcomplete = 1;
+  } else
+  if (record == ISP_IDCODE) {
+    uint8_t r = isp_check_idcode(port);
+    if (r) {
+      return r;
+    }
+  } else
+  if (record == ISP_ENABLE) {
+    isp_config(port, 0x1B9);
+  } else
+  if (record == ISP_ERASE) {
+    isp_erase(port);
+  } else
+  if (record == ISP_WIDTH) {
+    isp_row_bits = xsvf_player_get_next_byte();
+    isp_row_bits <<= 8;
+    isp_row_bits |= xsvf_player_get_next_byte();
+    if (((isp_row_bits + 7) >> 3) > S_MAX_CHAIN_SIZE_BYTES) {
+      return ERR_ISP_WIDTH;
+    }
+  } else
+  if (record == ISP_PROGRAM) {
+    isp_program_row(port);
+  } else
+  if (record == ISP_VERIFY) {
+    *verifyErrors += isp_verify_row(port);
+  } else
+  if (record == ISP_DISABLE) {
+    isp_config(port, 0);
+  } else
+  if (record == ISP_READ) {
+    isp_send_row(port);
+  } else
+  if (record == ISP_SCAN) {
+    xsvf_jtag_scan_chain(port);
+  } else {
+    return ERR_INSTR_NOT_IMPLEMENTED;
+  }
+
+  if (xsvf->error) {
+    return xsvf->error;
+  }
+  return 0;
+}
+
+static void jtag_play_isp(jtag_port_t* port)
+{
+  uint8_t ret = 0;
+  uint16_t verifyErrors = 0;
+
+  xsvf_player_init(port);
+
+  if (!jtag_port_get_veref(port)) {
+    Serial.println(F("Q-255,JTAG not connected"));
+    return;
+  }
+
+  // same TAP setup as the SVF files generated by fuseconv.py
+  xsvf->repeat = 0;
+  xsvf_jtagtap_state_goto(port, XSTATE_TEST_LOGIC_RESET);
+
+  Serial.println(F("RISP")); //announce ready to receive ISP stream
+
+  while (!xsvf->xcomplete) {
+    ret = isp_handle_next_record(port, &verifyErrors);
+    if (ret) {
+      break;
+    }
+  }
+  if (!ret && verifyErrors) {
+    ret = ERR_ISP_VERIFY;
+  }
+  if (!ret) {
+    Serial.println(F("!Success"));
+  }
+
+  Serial.print(F("!Processed records:"));
+  Serial.println(xsvf->instruction_counter, DEC);
+
+  if (ret) {
+    Serial.print(F("Q-"));
+    Serial.print(ret, DEC);
+    if (ret == ERR_ISP_VERIFY) {
+      Serial.print(F(",Verify failed. Rows: "));
+      Serial.println(verifyErrors, DEC);
+    } else {
+      Serial.println(F(",Fail"));
+    }
+  } else {
+    Serial.println(F("Q-0,OK"));
+  }
+
+  //the 3 pins must be low or else the vref might be triggered next time
+  digitalWrite(port->tms, 0);
+  digitalWrite(port->tdi, 0);
+  digitalWrite(port->tck, 0);
+  delay(100);
+
+  // put the jtag port pins into High-Z (vref already is input)
+  pinMode(port->tms, INPUT);
+  pinMode(port->tdi, INPUT);
+  pinMode(port->tck, INPUT);
+  pinMode(port->tdo, INPUT);
+}
+
+#endif /*_JTAG_ATF150X_H_*/
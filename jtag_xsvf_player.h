@@ -19,6 +19,18 @@ This port:
 
 * reduces the code to a single .h file
 
+* accepts packed XSVF stream: XPACK pseudo instruction announces
+  the rest of the stream is LZSS packed. The unpacker keeps the last
+  256 unpacked bytes in a history buffer (also allocated on the heap).
+  LZSS format: a flag byte precedes each group of 8 items, flag bit
+  (LSB first) 0 is a literal byte, 1 is a back reference of 2 bytes:
+  <distance - 1> <length - 3>
+
+* supports a target device within a JTAG chain: set jtag_chain before
+  playing the stream and the IR / DR shifts are padded by BYPASS bits
+  of the other devices. xsvf_jtag_scan_chain() reports the IDCODEs
+  and the total IR length of the chain.
+
 Use the original JTAG libray python scripts to upload XSVF files
 from your PC:
 ./xsvf -p /dev/ttyACM0 my_file.xsvf
@@ -73,10 +85,15 @@ Arduino usage:
 #define		XWAIT 23
 #define		XWAITSTATE 24
 #define		XTRST 28
+#define		XPACK 0x7F
 
 #define S_MAX_CHAIN_SIZE_BYTES 129
 #define S_MAX_CHAIN_SIZE_BITS (S_MAX_CHAIN_SIZE_BYTES * 8)
 
+#define XPACK_HISTORY_SIZE 256
+
+#define JTAG_CHAIN_MAX_DEVICES 8
+
 #define STATE_RUN_TEST_IDLE 1
 #define STATE_PAUSE_DR 6
 #define STATE_PAUSE_IR 13
@@ -232,6 +249,15 @@ typedef struct xsvf_t {
   uint8_t  wait_end_state;
   uint8_t  jtag_current_state;
 
+  // LZSS unpacker state
+  uint8_t* xsvf_history;
+  uint8_t  packed;
+  uint8_t  pack_flags;
+  uint8_t  pack_flag_bits;
+  uint8_t  history_pos;
+  uint8_t  match_distance;
+  uint16_t match_length;
+
 } xsvf_t;
 
 #ifdef XSVF_HEAP
@@ -249,6 +275,7 @@ uint8_t xsvf_tdo[S_MAX_CHAIN_SIZE_BYTES];
 uint8_t xsvf_tdo_expected[S_MAX_CHAIN_SIZE_BYTES];
 uint8_t xsvf_address_mask[S_MAX_CHAIN_SIZE_BYTES];
 uint8_t xsvf_data_mask[S_MAX_CHAIN_SIZE_BYTES];
+uint8_t xsvf_history[XPACK_HISTORY_SIZE];
 xsvf_t xsvf_context;
 xsvf_t* xsvf = &xsvf_context;
 
@@ -264,6 +291,19 @@ static const uint16_t xsvf_tms_map[] = {
 
 
 
+// Number of padding bits shifted before (header) and after (trailer) the target
+// device's IR and DR. Header bits are shifted first, they end up in the devices
+// placed between the target device and TDO.
+typedef struct jtag_chain_t {
+  uint8_t hir;
+  uint8_t tir;
+  uint8_t hdr;
+  uint8_t tdr;
+} jtag_chain_t;
+
+// kept outside of the heap, it is set before the player starts
+jtag_chain_t jtag_chain;
+
 typedef struct jtag_port_t {
 	uint8_t tms;
 	uint8_t tdi;
@@ -307,7 +347,7 @@ static inline uint8_t jtag_port_get_veref(jtag_port_t* port) {
 }
 
 
-static uint8_t  xsvf_player_next_byte(void) {
+static uint8_t  xsvf_player_recv_byte(void) {
   uint8_t retry = 16;
   uint8_t pos =  xsvf->rdpos % XSVF_BUF_SIZE;
 
@@ -350,6 +390,34 @@ static uint8_t  xsvf_player_next_byte(void) {
   return xsvf_buf[pos];
 }
 
+// returns the next byte of the XSVF stream, unpacks the stream if XPACK was received
+static uint8_t xsvf_player_next_byte(void) {
+  uint8_t b;
+  if (!xsvf->packed) {
+    return xsvf_player_recv_byte();
+  }
+  if (!xsvf->match_length) {
+    if (!xsvf->pack_flag_bits) {
+      xsvf->pack_flags = xsvf_player_recv_byte();
+      xsvf->pack_flag_bits = 8;
+    }
+    xsvf->pack_flag_bits--;
+    if (xsvf->pack_flags & 1) {
+      xsvf->match_distance = xsvf_player_recv_byte();
+      xsvf->match_length = xsvf_player_recv_byte() + 3;
+    }
+    xsvf->pack_flags >>= 1;
+  }
+  if (xsvf->match_length) {
+    xsvf->match_length--;
+    b = xsvf->xsvf_history[(uint8_t)(xsvf->history_pos - xsvf->match_distance - 1)];
+  } else {
+    b = xsvf_player_recv_byte();
+  }
+  xsvf->xsvf_history[xsvf->history_pos++] = b;
+  return b;
+}
+
 static uint8_t xsvf_player_get_next_byte(void) {
   return xsvf_player_next_byte();
 }
@@ -380,10 +448,10 @@ static void xsvf_player_get_next_bytes(uint8_t* data, uint32_t count) {
 }
 
 #ifdef XSVF_HEAP
-static uint32_t xsvf_heap_pos(uint32_t* pos, uint16_t size) {
-  uint32_t heap_pos = *pos;
+static uintptr_t xsvf_heap_pos(uintptr_t* pos, uint16_t size) {
+  uintptr_t heap_pos = *pos;
   //allocate on 4 byte boundaries
-  heap_pos = (heap_pos + 3) & 0xFFFFFFFC;
+  heap_pos = (heap_pos + 3) & ~((uintptr_t) 3);
   *pos = heap_pos + size;
   return heap_pos;
 }
@@ -406,7 +474,7 @@ static void xsvf_player_init(jtag_port_t* port) {
 #ifdef XSVF_HEAP
   {
     // variables allocated on the heap
-    uint32_t heap_pos = (uint32_t) XSVF_HEAP;
+    uintptr_t heap_pos = (uintptr_t) XSVF_HEAP;
 
     xsvf = (xsvf_t*) xsvf_heap_pos(&heap_pos, sizeof(xsvf_t));
     xsvf_buf = (uint8_t*) xsvf_heap_pos(&heap_pos, XSVF_BUF_SIZE);
@@ -419,12 +487,13 @@ static void xsvf_player_init(jtag_port_t* port) {
     xsvf->xsvf_tdo_expected = (uint8_t*) xsvf_heap_pos(&heap_pos, S_MAX_CHAIN_SIZE_BYTES);
     xsvf->xsvf_address_mask = (uint8_t*) xsvf_heap_pos(&heap_pos, S_MAX_CHAIN_SIZE_BYTES);
     xsvf->xsvf_data_mask = (uint8_t*) xsvf_heap_pos(&heap_pos, S_MAX_CHAIN_SIZE_BYTES);
+    xsvf->xsvf_history = (uint8_t*) xsvf_heap_pos(&heap_pos, XPACK_HISTORY_SIZE);
     xsvf_tms_transitions = (uint8_t*) xsvf_heap_pos(&heap_pos, 16);
     xsvf_tms_map = (uint16_t*) xsvf_heap_pos(&heap_pos, 32);
 
-    if (heap_pos - ((uint32_t)XSVF_HEAP) > sizeof(XSVF_HEAP)) {
+    if (heap_pos - ((uintptr_t)XSVF_HEAP) > sizeof(XSVF_HEAP)) {
       Serial.print(F("Q-1,ERROR: Heap is small:"));
-      Serial.println(heap_pos - ((uint32_t)XSVF_HEAP), DEC);
+      Serial.println((uint32_t) (heap_pos - ((uintptr_t)XSVF_HEAP)), DEC);
       return;
     }
 
@@ -475,6 +544,7 @@ static void xsvf_player_init(jtag_port_t* port) {
     xsvf->xsvf_tdo_expected = xsvf_tdo_expected;
     xsvf->xsvf_address_mask = xsvf_address_mask;
     xsvf->xsvf_data_mask = xsvf_data_mask;
+    xsvf->xsvf_history = xsvf_history;
   }
 #endif
 
@@ -518,6 +588,19 @@ static void xsvf_jtagtap_shift_td(
 	}
 }
 
+// shifts the same TDI value, TDO is ignored
+static void xsvf_jtagtap_shift_pad(jtag_port_t* port, uint8_t bits, uint8_t value, uint8_t must_end) {
+  jtag_port_set_tdi(port, value);
+  while (bits) {
+    bits--;
+    if (bits == 0 && must_end) {
+      jtag_port_set_tms(port, 1);
+      xsvf_jtagtap_state_ack(1);
+    }
+    jtag_port_pulse_clock(port);
+  }
+}
+
 static void xsvf_jtagtap_state_step(jtag_port_t* port, uint8_t tms) {
   jtag_port_set_tms(port, tms);
   jtag_port_pulse_clock(port);
@@ -563,7 +646,10 @@ static void xsvf_jtag_sir(jtag_port_t* port) {
     return;
   }
   xsvf_jtagtap_state_goto(port, XSTATE_SHIFT_IR);
-  xsvf_jtagtap_shift_td(port, xsvf->xsvf_tdi, xsvf->xsvf_tdo, xsvf->sirsize_bits, 1);
+  // other devices in the chain are set to BYPASS (all ones)
+  xsvf_jtagtap_shift_pad(port, jtag_chain.hir, 1, 0);
+  xsvf_jtagtap_shift_td(port, xsvf->xsvf_tdi, xsvf->xsvf_tdo, xsvf->sirsize_bits, jtag_chain.tir == 0);
+  xsvf_jtagtap_shift_pad(port, jtag_chain.tir, 1, 1);
   if (xsvf->runtest) {
     xsvf_jtagtap_state_goto(port, xsvf->endir_state);
   } else {
@@ -622,7 +708,14 @@ static uint8_t xsvf_jtag_sdr(jtag_port_t* port, uint8_t flags)
 		xsvf_jtagtap_state_goto(port, XSTATE_SHIFT_DR);
 	}
 	while (!matched && attempts_left-- >= 0) {
-    xsvf_jtagtap_shift_td(port, xsvf->xsvf_tdi, xsvf->xsvf_tdo, xsvf->sdrsize_bits, must_end);
+    // bypass registers of other devices in the chain
+    if (SDR_MUST_BEGIN) {
+      xsvf_jtagtap_shift_pad(port, jtag_chain.hdr, 0, 0);
+    }
+    xsvf_jtagtap_shift_td(port, xsvf->xsvf_tdi, xsvf->xsvf_tdo, xsvf->sdrsize_bits, must_end && jtag_chain.tdr == 0);
+    if (must_end) {
+      xsvf_jtagtap_shift_pad(port, jtag_chain.tdr, 0, 1);
+    }
 		if (!must_check) {
 			break;
 		}
@@ -661,6 +754,57 @@ static uint8_t xsvf_jtag_sdr(jtag_port_t* port, uint8_t flags)
 
 
 
+static uint32_t xsvf_jtag_read_tdo_bits(jtag_port_t* port, uint8_t bits) {
+  uint32_t v = 0;
+  uint8_t i;
+  for (i = 0; i < bits; i++) {
+    v |= ((uint32_t) jtag_port_pulse_clock_read_tdo(port)) << i;
+  }
+  return v;
+}
+
+/*
+ * Scans the JTAG chain and prints the IDCODE of each device starting
+ * at the TDO side ('C' followed by hex IDCODE, 0 for devices without
+ * IDCODE register) and the total IR length of the chain ('CIR:' followed
+ * by decimal length). Returns the number of devices.
+ */
+static uint8_t xsvf_jtag_scan_chain(jtag_port_t* port) {
+  uint8_t n = 0;
+  uint8_t ir = 0;
+
+  // after reset the devices select IDCODE register (starts with 1) or BYPASS (single 0 bit)
+  xsvf_jtagtap_state_goto(port, XSTATE_TEST_LOGIC_RESET);
+  xsvf_jtagtap_state_goto(port, XSTATE_SHIFT_DR);
+  jtag_port_set_tdi(port, 1);
+  while (n < JTAG_CHAIN_MAX_DEVICES) {
+    uint32_t id = jtag_port_pulse_clock_read_tdo(port);
+    if (id) {
+      id |= xsvf_jtag_read_tdo_bits(port, 31) << 1;
+      // shifted-in ones reached TDO: the end of the chain
+      if (id == 0xFFFFFFFF) {
+        break;
+      }
+    }
+    Serial.print(F("C"));
+    Serial.println(id, HEX);
+    n++;
+  }
+  xsvf_jtagtap_state_goto(port, XSTATE_RUN_TEST_IDLE);
+
+  // fill the IR registers by zeros, then count the bits until the first 1 appears at TDO
+  xsvf_jtagtap_state_goto(port, XSTATE_SHIFT_IR);
+  xsvf_jtagtap_shift_pad(port, 255, 0, 0);
+  jtag_port_set_tdi(port, 1);
+  while (ir < 255 && !jtag_port_pulse_clock_read_tdo(port)) {
+    ir++;
+  }
+  xsvf_jtagtap_state_goto(port, XSTATE_TEST_LOGIC_RESET);
+  Serial.print(F("CIR:"));
+  Serial.println(ir, DEC);
+  return n;
+}
+
 /*
  * Reads the next instruction from the serial port. Also reads any
  * remaining instruction parameters into the instruction buffer.
@@ -911,6 +1055,13 @@ static uint8_t xsvf_player_handle_next_instruction(jtag_port_t* port) {
     //read test reset mode (0-on, 1-off, 2-Z, 3-Absent)
     xsvf_player_get_next_byte();
   } else
+  // ---[PACK - the rest of the stream is packed] ----------------------------
+  if (instruction == XPACK) {
+#if XSVF_DEBUG
+    Serial.println(F("XPACK"));
+#endif
+    xsvf->packed = 1;
+  } else
   // ---[UNKNOWN ] --------------------------------------------
   {
 #if XSVF_DEBUG
@@ -45,9 +45,18 @@ To compile: gcc -g3 -O0 -o afterburner afterburner.c
 #include <string.h>
 #include <errno.h>
 #include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
 
-#include "serial_port.h"
+#include "libafterburner.h"
 #include "exerciser.h"
+#include "jedec.h"
+#include "galsim.h"
 
 #define VERSION "v.0.6.2"
 
@@ -59,94 +68,28 @@ To compile: gcc -g3 -O0 -o afterburner afterburner.c
 
 #define MAX_LINE (16*1024)
 
-#define MAXFUSES 30000
 #define GALBUFSIZE (256 * 1024)
 
-#define JTAG_ID 0xFF
-
-
-typedef enum {
-    UNKNOWN,
-    GAL16V8,
-    GAL18V10,
-    GAL20V8,
-    GAL20RA10,
-    GAL20XV10,
-    GAL22V10,
-    GAL26CV12,
-    GAL26V12,
-    GAL6001,
-    GAL6002,
-    ATF16V8B,
-    ATF20V8B,
-    ATF22V10B,
-    ATF22V10C,
-    ATF750C,
-    PEEL18CV8,
-    //jtag based PLDs at the end: they do not have a gal type in MCU software
-    ATF1502AS,
-    ATF1504AS,
-} Galtype;
-
-
-/* GAL info */
-static struct {
-    Galtype type;
-    unsigned char id0, id1; /* variant 1, variant 2 (eg. 16V8=0x00, 16V8A+=0x1A)*/
-    char *name;       /* pointer to chip name               */
-    int fuses;        /* total number of fuses              */
-    int pins;         /* number of pins on chip             */
-    int rows;         /* number of fuse rows                */
-    int bits;         /* number of fuses per row            */
-    int uesrow;       /* UES row number                     */
-    int uesfuse;      /* first UES fuse number              */
-    int uesbytes;     /* number of UES bytes                */
-    int eraserow;     /* row adddeess for erase             */
-    int eraseallrow;  /* row address for erase all          */
-    int pesrow;       /* row address for PES read/write     */
-    int pesbytes;     /* number of PES bytes                */
-    int cfgrow;       /* row address of config bits         */
-    int cfgbits;      /* number of config bits              */
-}
-galinfo[] = {
-    {UNKNOWN,   0x00, 0x00, "unknown",     0, 0, 0,  0, 0,   0, 0, 0, 0, 0, 8, 0, 0},
-    {GAL16V8,   0x00, 0x1A, "GAL16V8",  2194, 20, 32, 64, 32, 2056, 8, 63, 54, 58, 8, 60, 82},
-    {GAL18V10,  0x50, 0x51, "GAL18V10", 3540, 20, 36, 96, 36, 3476, 8, 61, 60, 58, 10, 16, 20},
-    {GAL20V8,   0x20, 0x3A, "GAL20V8",  2706, 24, 40, 64, 40, 2568, 8, 63, 59, 58, 8, 60, 82},
-    {GAL20RA10, 0x60, 0x61, "GAL20RA10", 3274, 24, 40, 80, 40, 3210, 8, 61, 60, 58, 10, 16, 10},
-    {GAL20XV10, 0x65, 0x66, "GAL20XV10", 1671, 24, 40,  40, 44, 1631, 5, 61, 60, 58,  5, 16, 31},
-    {GAL22V10,  0x48, 0x49, "GAL22V10", 5892, 24, 44, 132, 44, 5828, 8, 61, 60, 58, 10, 16, 20},
-    {GAL26CV12, 0x58, 0x59, "GAL26CV12", 6432, 28, 52, 122, 52, 6368, 8, 61, 60, 58, 12, 16, 24},
-    {GAL26V12,  0x5D, 0x5D, "GAL26V12",  7912, 28, 52, 150, 52, 7848, 8, 61, 60, 58, 12, 16, 48},
-    {GAL6001,   0x40, 0x41, "GAL6001", 8294, 24, 78, 75, 97, 8222, 9, 63, 62, 96, 8, 8, 68},
-    {GAL6002,   0x44, 0x44, "GAL6002", 8330, 24, 78, 75, 97, 8258, 9, 63, 62, 96, 8, 8, 104},
-    {ATF16V8B,  0x00, 0x00, "ATF16V8B", 2194, 20, 32, 64, 32, 2056, 8, 63, 54, 58, 8, 60, 82},
-    {ATF20V8B,  0x00, 0x00, "ATF20V8B",  2706, 24, 40, 64, 40, 2568, 8, 63, 59, 58, 8, 60, 82},
-    {ATF22V10B, 0x00, 0x00, "ATF22V10B", 5892, 24, 44, 132, 44, 5828, 8, 61, 60, 58, 10, 16, 20},
-    {ATF22V10C, 0x00, 0x00, "ATF22V10C", 5892, 24, 44, 132, 44, 5828, 8, 61, 60, 58, 10, 16, 20},
-    {ATF750C,   0x00, 0x00, "ATF750C",  14499, 24, 84, 171, 84, 14435, 8, 61, 60, 127, 10, 16, 71},
-    {PEEL18CV8, 0x00, 0x00, "PEEL18CV8", 2696, 24, 36,  74, 0,    0,   0, 0, 0, 0, 0, 0, 0},
-    {ATF1502AS, JTAG_ID, JTAG_ID, "ATF1502AS",   0, 0, 0,  0, 0,   0, 0, 0, 0, 0, 8, 0, 0},
-    {ATF1504AS, JTAG_ID, JTAG_ID, "ATF1504AS",   0, 0, 0,  0, 0,   0, 0, 0, 0, 0, 8, 0, 0},
-};
-
 char verbose = 0;
 char* filename = 0;
 char* deviceName = 0;
 char* pesString = NULL;
+char* outFilename = NULL;
+char* simFilename = NULL;
 
-SerialDeviceHandle serialF = INVALID_HANDLE;
-Galtype gal;
-int security = 0;
-unsigned short checksum;
+AfbProgrammer* programmer = NULL;
+AfbDesign design;
+AfbGalType gal;
+int lastFuse = 0;
 char galbuffer[GALBUFSIZE];
-char fusemap[MAXFUSES];
 char noGalCheck = 0;
 char varVppExists = 0;
 char printSerialWhileWaiting = 0;
 int calOffset = 0; //no calibration offset is applied
 char enableSecurity = 0;
 char bigRam = 0;
+char jtagIspExists = 0;
+char xsvfPackExists = 0;
 
 char opRead = 0;
 char opWrite = 0;
@@ -159,23 +102,33 @@ char opMeasureVPP = 0;
 char opSecureGal = 0;
 char opWritePes = 0;
 char opExercise = 0;
+char opConvert = 0;
+char opSimulate = 0;
+char opFuncTest = 0;
 char flagEnableApd = 0;
 char flagEraseAll = 0;
+char flagJtagChain = 0;
+char flagWatch = 0;
+char flagJson = 0;
+char flagTiming = 0;
+char flagBatch = 0;
+char* commands = "";
+char* traceFilename = NULL;
+char* vppLogFilename = NULL;
 
 
-static int waitForSerialPrompt(char* buf, int bufSize, int maxDelay);
 char sendGenericCommand(const char* command, const char* errorText, int maxDelay, char printResult);
 
 static void printGalTypes() {
     int i;
-    for (i = 1; i < sizeof(galinfo) / sizeof(galinfo[0]); i++) {
+    for (i = 1; i < afbGalInfoCount; i++) {
         if (i % 8 == 1) {
             printf("\n\t");
         } else
         if (i > 1) {
             printf(" ");
         }
-        printf("%s", galinfo[i].name);
+        printf("%s", afbGalInfo[i].name);
     }
 }
 
@@ -183,7 +136,7 @@ static void printHelp() {
     printf("Afterburner " VERSION_EXTENDED "  a GAL programming tool for Arduino based programmer\n");
     printf("more info: https://github.com/ole00/afterburner\n");
     printf("usage: afterburner command(s) [options]\n");
-    printf("commands: ierwvsbm\n");
+    printf("commands: ierwvpsbmxcgf\n");
     printf("   i : read device info and programming voltage\n");
     printf("   r : read fuse map from the GAL chip and display it, -t option must be set\n");
     printf("   w : write fuse map, -f  and -t options must be set\n");
@@ -194,18 +147,39 @@ static void printHelp() {
     printf("   b : calibrate variable VPP on new board designs. Ensure the GAL is NOT inserted.\n");
     printf("   m : measure variable VPP on new board designs. Ensure the GAL is NOT inserted.\n");
     printf("   x : exercise test script, -f must be set.\n");
+    printf("   c : convert ATF150x .jed file to .xsvf file, -f and -t options must be set. Optionally '-o' can be set.\n");
+    printf("   g : generate exerciser script by simulation of the .jed file, -f and -t options must be set.\n");
+    printf("       Without '-sim' it is the truth table of a combinatorial design. Optionally '-o' can be set.\n");
+    printf("   f : functional test of a combinatorial design: the programmer applies all input combinations and\n");
+    printf("       the signature of the outputs is compared with the simulation. -f and -t options must be set.\n");
         printf("options:\n");
     printf("  -v : verbose mode\n");
     printf("  -t <gal_type> : the GAL type. use ");
     printGalTypes();
     printf("\n");
-    printf("  -f <file> : JEDEC fuse map file or script to exercise\n");
+    printf("  -f <file> : JEDEC fuse map file or script to exercise. ATF150x chips accept .jed or .xsvf files\n");
     printf("  -d <serial_device> : name of the serial device. Without this option the device is guessed.\n");
     printf("                       serial params are: 57600, 8N1\n");
     printf("  -nc : do not check device GAL type before operation: force the GAL type set on command line\n");
     printf("  -sec: enable security - protect the chip. Use with 'w' or 'v' commands.\n");
     printf("  -co <offset>: Set calibration offset. Use with 'b' command. Value: -20 (-0.2V) to 25 (+0.25V)\n");
     printf("  -all: use with 'e' command to erase all data including PES.\n");
+    printf("  -o <file> : use with 'c' command to specify the output .xsvf file, with 'g' the output script.\n");
+    printf("  -sim <file> : use with 'g' command. The test script is simulated and written with the expected\n");
+    printf("                levels (H, L) of the outputs.\n");
+    printf("  -chain : ATF150x ICs are in a JTAG chain. Use comma separated file names with -f option,\n");
+    printf("           one file per ATF150x IC in the order printed by 'i' command, '-' skips the IC.\n");
+    printf("  -watch : use with 'w' command. Keeps the programmer open, watches the .jed file and on each change\n");
+    printf("           erases, writes and verifies the GAL again. Press Ctrl+C to quit.\n");
+    printf("  -timing : print the time spent by the programmer in each phase of the erase, write, verify\n");
+    printf("            and read commands\n");
+    printf("  -trace <file> : record all bytes sent to and received from the programmer into a binary file,\n");
+    printf("                  use 'aftrace' to print the latency summary or to replay it\n");
+    printf("  -vpplog <file> : sample VPP during the programming and erase pulses and save min / max / mean\n");
+    printf("                   of each pulse and the waveform of the last pulses into a CSV file (variable VPP only)\n");
+    printf("  -batch : use with 'x' command. The script is sent to the programmer as vector tables\n");
+    printf("           and run by the MCU with its own timing.\n");
+    printf("  -json : print the result as one JSON object to stdout, other texts are printed to stderr\n");
     printf("  -pes <PES> : use with 'p' command to specify new PES. PES format is 8 hex bytes with a delimiter.\n");
     printf("               For example 00:03:3A:A1:00:00:00:90\n");
     printf("examples:\n");
@@ -224,7 +198,7 @@ static void printHelp() {
 }
 
 static int8_t verifyArgs(char* type) {
-    if (!opRead && !opWrite && !opErase && !opInfo && !opVerify && !opTestVPP && !opCalibrateVPP && !opMeasureVPP && !opWritePes && !opExercise) {
+    if (!opRead && !opWrite && !opErase && !opInfo && !opVerify && !opTestVPP && !opCalibrateVPP && !opMeasureVPP && !opWritePes && !opExercise && !opConvert && !opSimulate && !opFuncTest) {
         printHelp();
         printf("Error: no command specified.\n");
         return -1;
@@ -246,13 +220,13 @@ static int8_t verifyArgs(char* type) {
         return -1;
     } else if (0 != type) {
         int i;
-        for (i = 1; i < sizeof(galinfo) / sizeof(galinfo[0]); i++) {
-            if (strcmp(type, galinfo[i].name) == 0) {
-                gal = galinfo[i].type;
+        for (i = 1; i < afbGalInfoCount; i++) {
+            if (strcmp(type, afbGalInfo[i].name) == 0) {
+                gal = afbGalInfo[i].type;
                 break;
             }
         }
-        if (UNKNOWN == gal) {
+        if (AFB_GAL_UNKNOWN == gal) {
             printf("Error: unknown GAL type. Types: ");
             printGalTypes();
             printf("\n");
@@ -260,13 +234,29 @@ static int8_t verifyArgs(char* type) {
         }
     }
     if (0 == filename && (opWrite == 1 || opVerify == 1)) {
-        printf("Error: missing %s filename (param: -f fname)\n", galinfo[gal].id0 == JTAG_ID ? ".xsvf" : ".jed");
+        printf("Error: missing %s filename (param: -f fname)\n", afbGalInfo[gal].id0 == AFB_JTAG_ID ? ".jed or .xsvf" : ".jed");
         return -1;
     }
      if (0 == filename && opExercise == 1) {
         printf("Error: missing script filename (param: -f fname)\n");
         return -1;
     }
+    if (flagWatch && (!opWrite || afbGalInfo[gal].id0 == AFB_JTAG_ID)) {
+        printf("Error: -watch requires 'w' command and a GAL type\n");
+        return -1;
+    }
+    if (opSimulate && (AFB_GAL_UNKNOWN == gal || 0 == filename)) {
+        printf("Error: simulation requires GAL type and .jed file (params: -t type -f fname)\n");
+        return -1;
+    }
+    if (opFuncTest && (AFB_GAL_UNKNOWN == gal || 0 == filename)) {
+        printf("Error: signature test requires GAL type and .jed file (params: -t type -f fname)\n");
+        return -1;
+    }
+    if (opConvert && (afbGalInfo[gal].id0 != AFB_JTAG_ID || 0 == filename)) {
+        printf("Error: convert requires ATF150x type and .jed file (params: -t type -f fname)\n");
+        return -1;
+    }
    return 0;
 }
 
@@ -275,7 +265,7 @@ static int8_t checkArgs(int argc, char** argv) {
     char* type = 0;
     char* modes = 0;
 
-    gal = UNKNOWN;
+    gal = AFB_GAL_UNKNOWN;
 
     for (i = 1; i < argc; i++) {
         char* param = argv[i];
@@ -299,6 +289,28 @@ static int8_t checkArgs(int argc, char** argv) {
         }  else if (strcmp("-pes", param) == 0) {
             i++;
             pesString = argv[i];
+        } else if (strcmp("-chain", param) == 0) {
+            flagJtagChain = 1;
+        } else if (strcmp("-watch", param) == 0) {
+            flagWatch = 1;
+        } else if (strcmp("-json", param) == 0) {
+            flagJson = 1;
+        } else if (strcmp("-timing", param) == 0) {
+            flagTiming = 1;
+        } else if (strcmp("-batch", param) == 0) {
+            flagBatch = 1;
+        } else if (strcmp("-trace", param) == 0) {
+            i++;
+            traceFilename = argv[i];
+        } else if (strcmp("-vpplog", param) == 0) {
+            i++;
+            vppLogFilename = argv[i];
+        } else if (strcmp("-o", param) == 0) {
+            i++;
+            outFilename = argv[i];
+        } else if (strcmp("-sim", param) == 0) {
+            i++;
+            simFilename = argv[i];
         } else if (strcmp("-co", param) == 0) {
             i++;
             calOffset = atoi(argv[i]);
@@ -313,6 +325,7 @@ static int8_t checkArgs(int argc, char** argv) {
         }
         else if (param[0] != '-') {
             modes = param;
+            commands = param;
         }
     }
 
@@ -350,6 +363,16 @@ static int8_t checkArgs(int argc, char** argv) {
             opExercise = 1;
             noGalCheck = 1;
             break;
+        case 'c':
+            opConvert = 1;
+            break;
+        case 'g':
+            opSimulate = 1;
+            break;
+        case 'f':
+            opFuncTest = 1;
+            noGalCheck = 1;
+            break;
         default:
             printf("Error: unknown operation '%c' \n", modes[i]);
         }
@@ -363,214 +386,35 @@ static int8_t checkArgs(int argc, char** argv) {
     return 0;
 }
 
-static unsigned short checkSum(unsigned short n) {
-    unsigned short c, e, i;
-    unsigned long a;
+// parses the .jed file into the fuse map, returns 0 on success
+static int parseFuseMap(void) {
+    AfbResult result;
 
-    c = e = 0;
-    a = 0;
-    for (i = 0; i < n; i++) {
-        e++;
-        if (e == 9) {
-            e = 1;
-            a += c;
-            c = 0;
-        }
-        c >>= 1;
-        if (fusemap[i]) {
-            c += 0x80;
-        }
+    if (verbose) {
+        printf("opening file: '%s'\n", filename);
     }
-    return (unsigned short)((c >> (8 - e)) + a);
-}
-
-static int parseFuseMap(char *ptr) {
-    int i, n, type, checksumpos, address, pins, lastfuse;
-    int state = 0; // 0=outside JEDEC, 1=skipping comment or unknown, 2=read command
-
-    security = 0;
-    checksum = 0;
-    checksumpos = 0;
-    pins = 0;
-    lastfuse = 0;
-
-    for (n = 0; ptr[n]; n++) {
-        if (ptr[n] == '*') {
-            state = 2;
-        } else
-            switch (state) {
-            case 2:
-                if (!isspace(ptr[n]))
-                    switch (ptr[n]) {
-                    case 'L':
-                        address = 0;
-                        state = 3;
-                        break;
-                    case 'F':
-                        state = 5;
-                        break;
-                    case 'G':
-                        state = 13;
-                        break;
-                    case 'Q':
-                        state = 7;
-                        break;
-                    case 'C':
-                        checksumpos = n;
-                        state = 14;
-                        break;
-                    default:
-                        state = 1;
-                    }
-                break;
-            case 3:
-                if (!isdigit(ptr[n])) {
-                    return n;
-                }
-                address = ptr[n] - '0';
-                state = 4;
-                break;
-            case 4:
-                if (isspace(ptr[n])) {
-                    state = 6;
-                } else if (isdigit(ptr[n])) {
-                    address = 10 * address + (ptr[n] - '0');
-                } else {
-                    return n;
-                }
-                break;
-            case 5:
-                if (isspace(ptr[n])) break; // ignored
-                if (ptr[n] == '0' || ptr[n] == '1') {
-                    memset(fusemap, ptr[n] - '0', sizeof(fusemap));
-                } else {
-                    return n;
-                }
-                state = 1;
-                break;
-            case 6:
-                if (isspace(ptr[n])) break; // ignored
-                if (ptr[n] == '0' || ptr[n] == '1') {
-                    fusemap[address++] = ptr[n] - '0';
-                } else {
-                    return n;
-                }
-                break;
-            case 7:
-                if (isspace(ptr[n])) break; // ignored
-                if (ptr[n] == 'P') {
-                    pins = 0;
-                    state = 8;
-                } else if (ptr[n] == 'F') {
-                    lastfuse = 0;
-                    state = 9;
-                } else {
-                    state = 2;
-                }
-                break;
-            case 8:
-                if (isspace(ptr[n])) break; // ignored
-                if (!isdigit(ptr[n])) return n;
-                pins = ptr[n] - '0';
-                state = 10;
-                break;
-            case 9:
-                if (isspace(ptr[n])) break; // ignored
-                if (!isdigit(ptr[n])) return n;
-                lastfuse = ptr[n] - '0';
-                state = 11;
-                break;
-            case 10:
-                if (isdigit(ptr[n])) {
-                    pins = 10 * pins + (ptr[n] - '0');
-                } else if (isspace(ptr[n])) {
-                    state = 12;
-                } else {
-                    return n;
-                }
-                break;
-            case 11:
-                if (isdigit(ptr[n])) {
-                    lastfuse = 10 * lastfuse + (ptr[n] - '0');
-                } else if (isspace(ptr[n])) {
-                    state = 12;
-                } else {
-                    return n;
-                }
-                break;
-            case 12:
-                if (!isspace(ptr[n])) {
-                    return n;
-                }
-                break;
-            case 13:
-                if (isspace(ptr[n])) break; // ignored
-                if (ptr[n] == '0' || ptr[n] == '1') {
-                    security = ptr[n] - '0';
-                } else {
-                    return n;
-                }
-                state = 1;
-                break;
-            case 14:
-                if (isspace(ptr[n])) break; // ignored
-                if (isdigit(ptr[n])) {
-                    checksum = ptr[n] - '0';
-                } else if (toupper(ptr[n]) >= 'A' && toupper(ptr[n]) <= 'F') {
-                    checksum = toupper(ptr[n]) - 'A' + 10;
-                } else return n;
-                state = 15;
-                break;
-            case 15:
-                if (isdigit(ptr[n])) {
-                    checksum = 16 * checksum + ptr[n] - '0';
-                } else if (toupper(ptr[n]) >= 'A' && toupper(ptr[n]) <= 'F') {
-                    checksum = 16 * checksum + toupper(ptr[n]) - 'A' + 10;
-                } else if (isspace(ptr[n])) {
-                    state = 2;
-                } else return n;
-                break;
-            }
+    result = afbDesignLoadFile(&design, gal, filename);
+    if (result == AFB_ERR_FILE) {
+        printf("Error: failed to open file: %s\n", filename);
+        return -1;
     }
-
-    if (lastfuse || pins) {
-        int cs = checkSum(lastfuse);
-        if (checksum && checksum != cs) {
-            printf("Checksum does not match! given=0x%04X calculated=0x%04X last fuse=%i\n", checksum, cs, lastfuse);
-        }
-
-        for (type = 0, i = 1; i < sizeof(galinfo) / sizeof(galinfo[0]); i++) {
-            if (
-                (lastfuse == 0 ||
-                 galinfo[i].fuses == lastfuse ||
-                 (galinfo[i].uesfuse == lastfuse && galinfo[i].uesfuse + 8 * galinfo[i].uesbytes == galinfo[i].fuses))
-                &&
-                (pins == 0 ||
-                 galinfo[i].pins == pins ||
-                 (galinfo[i].pins == 24 && pins == 28))
-            ) {
-                if (gal == 0) {
-                    type = i;
-                    break;
-                } else if (!type) {
-                    type = i;
-                }
-            }
-        }
+    if (result != AFB_OK) {
+        printf("Error: failed to parse JEDEC file at offset %ld\n", design.jedec.errorPosition);
+        return -1;
     }
-    if (lastfuse == 2195 && gal == ATF16V8B) {
-        flagEnableApd = fusemap[2194];
-        if (verbose) {
-            printf("PD fuse detected: %i\n", fusemap[2194]);
+    lastFuse = design.jedec.fuseCount;
+    if (lastFuse || design.jedec.pins) {
+        if (design.jedec.checksum && design.jedec.checksum != design.calculatedChecksum) {
+            printf("Checksum does not match! given=0x%04X calculated=0x%04X last fuse=%i\n", design.jedec.checksum, design.calculatedChecksum, lastFuse);
         }
     }
-    if (lastfuse == 5893 && gal == ATF22V10C) {
-        flagEnableApd = fusemap[5892];
+    if ((lastFuse == 2195 && gal == AFB_ATF16V8B) || (lastFuse == 5893 && gal == AFB_ATF22V10C)) {
+        flagEnableApd = design.apdFuse;
         if (verbose) {
-            printf("PD fuse detected: %i\n", fusemap[5892]);
+            printf("PD fuse detected: %i\n", flagEnableApd);
         }
     }
-    return n;
+    return 0;
 }
 
 static char readFile(int* fileSize) {
@@ -598,255 +442,203 @@ static char readFile(int* fileSize) {
     return 0;
 }
 
-static char checkForString(char* buf, int start, const char* key) {
-    int labelPos = strstr(buf + start, key) -  buf;
-    return (labelPos > 0 && labelPos < 500) ? 1 : 0;
-}
-
-static int openSerial(void) {
-    char buf[512] = {0};
-    char devName[256] = {0};
-    int total;
-    int labelPos;
-    int retry = 4;
-
-
-    //open device name
-    if (deviceName == 0) {
-        serialDeviceGuessName(&deviceName);
-    }
-    snprintf(devName, sizeof(devName), "%s", (deviceName == 0) ? DEFAULT_SERIAL_DEVICE_NAME : deviceName);
-    serialDeviceCheckName(devName, sizeof(devName));
-
-    if (verbose) {
-        printf("opening serial: %s\n", devName);
-    }
-
-    while (retry) {
-        retry--;
-        serialF = serialDeviceOpen(devName);
-        if (serialF == INVALID_HANDLE) {
-            printf("Error: failed to open serial device: %s\n", devName);
-            return -2;
-        }
-#ifndef _USE_WIN_API_
-        //read garbage
-        total = waitForSerialPrompt(buf, 512, 4);
-#endif
+/* -------------------- JSON output -------------------- */
 
-        // prod the programmer to output it's identification
-        sprintf(buf, "*\r");
-        serialDeviceWrite(serialF, buf, 2);
+#define MAX_PHASES 16
 
-        //read programmer's message
-        total = waitForSerialPrompt(buf, 512, 1000);
-        buf[total] = 0;
+// one operation run by main(), reported in the JSON output
+typedef struct {
+    const char* name;
+    long ms;
+    char result;
+    int status;     // AFB_STATUS_xxx of the programmer's error response
+} Phase;
+
+static Phase phases[MAX_PHASES];
+static int phaseCount = 0;
+static long phaseStart;
+static long jsonStart;
+static FILE* jsonOut = NULL;
+static char* captured = NULL;   // programmer output
+static int capturedLen = 0;
+static int capturedSize = 0;
+static int jsonStatus = AFB_STATUS_NONE;
+static char jsonMessage[128];
+
+#define RUN_PHASE(name, op) (phaseBegin(name), phaseEnd(op))
+
+// the JSON object is printed to the original stdout, all other texts go to stderr
+static void startJson(void) {
+    fflush(stdout);
+    jsonOut = fdopen(dup(1), "w");
+    dup2(2, 1);
+    jsonStart = afbTimeMs();
+}
 
-        //check we are communicating with Afterburner programmer
-        labelPos = strstr(buf, "AFTerburner v.") -  buf;
+static void captureOutput(const char* text) {
+    int len = strlen(text);
 
-        bigRam = 0;
-        if (labelPos >= 0 && labelPos < 500 && buf[total - 3] == '>') {
-            // check for new board desgin: variable VPP
-            varVppExists = checkForString(buf, labelPos, " varVpp ");
-            if (verbose && varVppExists) {
-                printf("variable VPP board detected\n");
-            }
-            // check for Big Ram
-            bigRam = checkForString(buf, labelPos, " RAM-BIG");
-            if (verbose && bigRam) {
-                printf("MCU Big RAM detected\n");
-            }
-            //all OK
-            return 0;
-        }
-        if (verbose) {
-            printf("Output from programmer not recognised (%d): %s\n", labelPos, buf);
-            printf("--------------\n");
+    if (capturedLen + len >= capturedSize) {
+        int size = (capturedLen + len + 1) * 2;
+        char* buf = (char*) realloc(captured, size);
+        if (buf == NULL) {
+            return;
         }
-        serialDeviceClose(serialF);
-        serialF = INVALID_HANDLE;
+        captured = buf;
+        capturedSize = size;
     }
-    return -4;
+    memcpy(captured + capturedLen, text, len + 1);
+    capturedLen += len;
 }
 
-static void closeSerial(void) {
-    if (INVALID_HANDLE == serialF) {
-        return;
+static void phaseBegin(const char* name) {
+    if (phaseCount < MAX_PHASES) {
+        phases[phaseCount].name = name;
     }
-    serialDeviceClose(serialF);
-    serialF = INVALID_HANDLE;
+    phaseStart = afbTimeMs();
 }
 
-
-static int checkPromptExists(char* buf, int bufSize) {
-    int i;
-    for (i = 0; i < bufSize - 2 && buf[i] != 0; i++) {
-        if (buf[i] == '>' && buf[i+1] == '\r' && buf[i+2] == '\n') {
-            return i;
+static char phaseEnd(char result) {
+    if (phaseCount < MAX_PHASES) {
+        Phase* p = &phases[phaseCount++];
+        p->ms = afbTimeMs() - phaseStart;
+        p->result = result;
+        p->status = (programmer != NULL && result != 0) ? afbGetStatus(programmer) : AFB_STATUS_NONE;
+        // the first error is the reported one
+        if (p->status != AFB_STATUS_NONE && jsonStatus == AFB_STATUS_NONE) {
+            jsonStatus = p->status;
+            snprintf(jsonMessage, sizeof(jsonMessage), "%s", afbGetStatusText(programmer));
         }
     }
-    return -1;
+    return result;
 }
 
-static char* stripPrompt(char* buf) {
-    int len;
-    int i;
-    if (buf == 0) {
-        return 0;
-    }
-    len = strlen(buf);
-    i  = checkPromptExists(buf, len);
-    if (i >= 0) {
-        buf[i] = 0;
-        len = i;
-    }
-
-    //strip rear new line characters
-    for (i = len - 1; i >= 0; i--) {
-        if (buf[i] != '\r' && buf[i] != '\n') {
-            break;
+static void printJsonString(FILE* f, const char* s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char) *s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c == '\n') {
+            fputs("\\n", f);
+        } else if (c < 0x20 || c >= 0x7F) {
+            if (c != '\r') {
+                fprintf(f, "\\u%04x", c);
+            }
         } else {
-            buf[i] = 0;
-        }
-    }
-
-    //strip frontal new line characters
-    for (i = 0; buf[i] != 0; i++) {
-        if (buf[0] == '\r' || buf[0] == '\n') {
-            buf++;
+            fputc(c, f);
         }
     }
-    return buf;
+    fputc('"', f);
 }
 
-//finds beginnig of the last line
-static char* findLastLine(char* buf) {
+static void printJsonResult(char result) {
+    FILE* f = jsonOut;
+    const char* pes = (captured != NULL) ? strstr(captured, "PES info: ") : NULL;
     int i;
-    char* result = buf;
-
-    if (buf == 0) {
-        return 0;
-    }
-    for (i = 0; buf[i] != 0; i++) {
-        if (buf[i] == '\r' || buf[i] == '\n') {
-            result = buf + i + 1;
-        }      
-    }
-    return result;
-}
 
-static char* printBuffer(char* bufPrint, int readSize) {
-    int i;
-    char doPrint = 1;
-    for (i = 0; i < readSize;i++) {
-        if (*bufPrint == '>') {
-            doPrint = 0;
-        }
-        if (doPrint) {
-            printf("%c", *bufPrint);
-            if (*bufPrint == '\n' || *bufPrint == '\r') {
-                fflush(stdout);
-            }
-            bufPrint++;
+    fprintf(f, "{\"result\":%d,\"commands\":", result);
+    printJsonString(f, commands);
+    fprintf(f, ",\"device\":");
+    printJsonString(f, afbGalInfo[gal].name);
+    fprintf(f, ",\"firmware\":");
+    printJsonString(f, programmer != NULL ? afbGetVersion(programmer) : "");
+    fprintf(f, ",\"features\":%d", programmer != NULL ? afbGetFeatures(programmer) : 0);
+    fprintf(f, ",\"status\":%d,\"message\":", jsonStatus);
+    printJsonString(f, jsonMessage);
+    if (jsonStatus == AFB_STATUS_VERIFY) {
+        const char* errors = strrchr(jsonMessage, ':');
+        fprintf(f, ",\"verifyErrors\":%d", errors != NULL ? atoi(errors + 1) : -1);
+    } else if (opVerify && 0 == result) {
+        fprintf(f, ",\"verifyErrors\":0");
+    }
+    if (pes != NULL) {
+        char buf[128];
+        pes += 10;
+        snprintf(buf, sizeof(buf), "%.*s", (int) strcspn(pes, "\r\n"), pes);
+        fprintf(f, ",\"pes\":");
+        printJsonString(f, buf);
+    }
+    if (lastFuse) {
+        fprintf(f, ",\"fuses\":%d,\"checksum\":\"%04X\"", lastFuse, design.calculatedChecksum);
+    }
+    fprintf(f, ",\"phases\":[");
+    for (i = 0; i < phaseCount; i++) {
+        fprintf(f, "%s{\"name\":\"%s\",\"ms\":%ld,\"result\":%d,\"status\":%d}", i ? "," : "",
+            phases[i].name, phases[i].ms, phases[i].result, phases[i].status);
+    }
+    fprintf(f, "]");
+    for (i = 0; programmer != NULL && i < afbGetTimingCount(programmer); i++) {
+        const AfbTiming* t = afbGetTiming(programmer, i);
+        fprintf(f, "%s{\"command\":\"%c\",\"total\":%ld,\"shift\":%ld,\"power\":%ld,\"vpp\":%ld,"
+            "\"strobe\":%ld,\"serial\":%ld,\"typeCheck\":%ld,\"powerUps\":%ld}", i ? "," : ",\"timing\":[",
+            t->command, t->total, t->shift, t->power, t->vpp, t->strobe, t->serial, t->typeCheck, t->powerUps);
+        if (i == afbGetTimingCount(programmer) - 1) {
+            fprintf(f, "]");
         }
     }
-    return bufPrint;
+    fprintf(f, ",\"ms\":%ld,\"output\":", afbTimeMs() - jsonStart);
+    printJsonString(f, captured != NULL ? captured : "");
+    fprintf(f, "}\n");
+    fflush(f);
 }
 
-static int waitForSerialPrompt(char* buf, int bufSize, int maxDelay) {
-    char* bufStart = buf;
-    int bufTotal = bufSize;
-    int bufPos = 0;
-    int readSize;
-    char* bufPrint = buf;
-    char doPrint = printSerialWhileWaiting;
-    
-    memset(buf, 0, bufSize);
+// saves the VPP of the pulses: one row per waveform sample, or one row with empty time and VPP
+// when only min / max / mean of the pulse is known
+static void writeVppLog(void) {
+    FILE* f;
+    int i, j;
 
-    while (maxDelay > 0) {
-        readSize = serialDeviceRead(serialF, buf, bufSize);
-        if (readSize > 0) {
-            bufPos += readSize;
-            if (checkPromptExists(bufStart, bufTotal) >= 0) {
-                maxDelay = 4; //force exit, but read the rest of the line
-            } else {
-                buf += readSize;
-                bufSize -= readSize;
-                if (bufSize <= 0) {
-                    printf("ERROR: serial port read buffer is too small!\nAre you dumping large amount of data?\n");
-                    return -1;
-                }
+    if (programmer == NULL || !(afbGetFeatures(programmer) & AFB_FEATURE_VPP_LOG)) {
+        printf("No VPP log: the programmer's firmware or board does not support it.\n");
+        return;
+    }
+    f = fopen(vppLogFilename, "w");
+    if (f == NULL) {
+        printf("Error: failed to write the VPP log to %s\n", vppLogFilename);
+        return;
+    }
+    fprintf(f, "command,pulse,ms,samples,min[V],max[V],mean[V],time[us],vpp[V]\n");
+    for (i = 0; i < afbGetVppPulseCount(programmer); i++) {
+        const AfbVppPulse* v = afbGetVppPulse(programmer, i);
+        char pulse[128];
+        int rows = 0;
+
+        snprintf(pulse, sizeof(pulse), "%c,%d,%d,%d,%.2f,%.2f,%.2f", v->command, v->pulse, v->ms,
+            v->samples, v->min / 100.0, v->max / 100.0, v->mean / 100.0);
+        for (j = 0; j < v->waveCount; j++) {
+            if (v->wave[j] >= 0) {
+                fprintf(f, "%s,%d,%.2f\n", pulse, j * v->slotUs, v->wave[j] / 100.0);
+                rows++;
             }
-            if (printSerialWhileWaiting) {
-                bufPrint = printBuffer(bufPrint, readSize);
-            }                
         }
-        if (maxDelay > 0) {
-        /* WIN_API handles timeout itself */
-#ifndef _USE_WIN_API_
-            usleep(10 * 1000);
-            maxDelay -= 10;
-#else
-            maxDelay -= 30;           
-#endif
-            if(maxDelay <= 0 && verbose) {
-                printf("waitForSerialPrompt timed out\n");
-            }
+        if (rows == 0) {
+            fprintf(f, "%s,,\n", pulse);
         }
     }
-    return bufPos;
+    fclose(f);
+    printf("VPP log of %d pulses saved to %s\n", afbGetVppPulseCount(programmer), vppLogFilename);
 }
 
-static int sendBuffer(char* buf) {
-    int total;
-    int writeSize;
+// prints the time spent by the programmer in each phase of the GAL commands
+static void printTiming(void) {
+    int i;
 
-    if (buf == 0) {
-        return -1;
-    }
-    total = strlen(buf);
-    // write the query into the serial port's file
-    // file is opened non blocking so we have to ensure all contents is written
-    while (total > 0) {
-        writeSize = serialDeviceWrite(serialF, buf, total);
-        if (writeSize < 0) {
-            printf("ERROR: written: %i (%s)\n", writeSize, strerror(errno));
-            return -4;
-        }
-        buf += writeSize;
-        total -= writeSize;
+    if (programmer == NULL || afbGetTimingCount(programmer) == 0) {
+        printf("No timing: the programmer's firmware does not support it.\n");
+        return;
     }
-    return 0;
-}
-
-static int sendLine(char* buf, int bufSize, int maxDelay) {
-    int total;
-    char* obuf = buf;
-
-    if (serialF == INVALID_HANDLE) {
-        if (verbose) {
-            printf("Error: serial port is not opened\n");
+    printf("command  total[ms]  shift[ms]  power[ms]    vpp[ms] strobe[ms] serial[ms]  typecheck[ms]  power ups\n");
+    for (i = 0; i < afbGetTimingCount(programmer); i++) {
+        const AfbTiming* t = afbGetTiming(programmer, i);
+        printf("   %c    %9.1f  %9.1f  %9.1f  %9.1f  %9.1f  %9.1f      %9.1f", t->command,
+            t->total / 1000.0, t->shift / 1000.0, t->power / 1000.0, t->vpp / 1000.0,
+            t->strobe / 1000.0, t->serial / 1000.0, t->typeCheck / 1000.0);
+        if (t->powerUps >= 0) {
+            printf("  %9ld", t->powerUps);
         }
-        return -1;
-    }
-
-    total = sendBuffer(buf);
-    if (total) {
-        return total;
-    }
-
-    total = waitForSerialPrompt(obuf, bufSize, (maxDelay < 0) ? 6 : maxDelay);
-    if (total < 0) {
-        return total;
-    }
-    obuf[total] = 0;
-    obuf = stripPrompt(obuf);
-    if (verbose) {
-        printf("read: %i '%s'\n", total, obuf);
+        printf("\n");
     }
-
-    return total;
 }
 
 static void updateProgressBar(char* label, int current, int total) {
@@ -860,162 +652,135 @@ static void updateProgressBar(char* label, int current, int total) {
     }
 }
 
-// Upload fusemap in byte format (as opposed to bit format used in JEDEC file).
-static char upload() {
-    char fuseSet;
-    char buf[MAX_LINE];
-    char line[64];
-    unsigned int i, j, n;
-    unsigned short csum;
-    int apdFuse = flagEnableApd;
-    int totalFuses = galinfo[gal].fuses;
-
-    if (apdFuse) {
-        totalFuses++;
+static void printOutput(void* user, const char* text) {
+    if (flagJson) {
+        captureOutput(text);
     }
+    printf("%s", text);
+    fflush(stdout);
+}
 
-    // Start  upload
-    sprintf(buf, "u\r");
-    sendLine(buf, MAX_LINE, 20);
+static void printProgress(void* user, const char* label, int current, int total) {
+    updateProgressBar((char*) label, current, total);
+}
 
-    //device type
-    sprintf(buf, "#t %c %s\r", '0' + (int) gal, galinfo[gal].name);
-    sendLine(buf, MAX_LINE, 300);
+// finishes the operation started by afbXxxStart() call
+static AfbResult runOperation(AfbResult result) {
+    if (result == AFB_PENDING) {
+        result = afbWait(programmer);
+    }
+    return result;
+}
 
-    //fuse map
-    buf[0] = 0;
-    fuseSet = 0;
-    
-    printf("Uploading fuse map...\n");
-    for (i = 0; i < totalFuses;) {
-        unsigned char f = 0;
-        if (i % 32 == 0) {
-            if (i != 0) {
-                strcat(buf, "\r");
-                //the buffer contains at least one fuse set to 1
-                if (fuseSet) {
-#ifdef DEBUG_UPLOAD
-                    printf("%s\n", buf);
-#endif
-                    sendLine(buf, MAX_LINE, 100);
-                    buf[0] = 0;
-                }
-                fuseSet = 0;
-            }
-            sprintf(buf, "#f %04i ", i);
+static int openSerial(void) {
+    AfbResult result;
+    int features;
+
+    if (programmer == NULL) {
+        programmer = afbCreate();
+        if (programmer == NULL) {
+            printf("Error: %s\n", afbGetResultText(AFB_ERR_MEMORY));
+            return AFB_ERR_MEMORY;
         }
-        f = 0;
-        for (j = 0; j < 8 && i < totalFuses; j++,i++) {
-            if (fusemap[i]) {
-                f |= (1 << j);
-                fuseSet = 1;
-            }
+        afbSetCallbacks(programmer, printProgress, printOutput, NULL);
+        if (traceFilename != NULL && afbSetTrace(programmer, traceFilename) != AFB_OK) {
+            return AFB_ERR_FILE;
         }
-
-        sprintf(line, "%02X", f);
-        strcat(buf, line);
-
-        updateProgressBar("", i, totalFuses);
     }
-    updateProgressBar("", totalFuses, totalFuses);
+    afbSetVerbose(programmer, verbose);
+    afbSetTiming(programmer, flagTiming);
+    afbSetVppLog(programmer, vppLogFilename != NULL);
 
-    // send last unfinished fuse line
-    if (fuseSet) {
-        strcat(buf, "\r");
-#ifdef DEBUG_UPLOAD
-        printf("%s\n", buf);
-#endif
-        sendLine(buf, MAX_LINE, 100);
+    result = afbOpen(programmer, deviceName);
+    if (result != AFB_OK) {
+        return result;
+    }
+    features = afbGetFeatures(programmer);
+    varVppExists = (features & AFB_FEATURE_VAR_VPP) ? 1 : 0;
+    bigRam = (features & AFB_FEATURE_BIG_RAM) ? 1 : 0;
+    jtagIspExists = (features & AFB_FEATURE_JTAG_ISP) ? 1 : 0;
+    xsvfPackExists = (features & AFB_FEATURE_XSVF_PACK) ? 1 : 0;
+    // the capture is off after the programmer resets
+    if (vppLogFilename != NULL && (features & AFB_FEATURE_VPP_LOG)) {
+        result = runOperation(afbCommandStart(programmer, "L1\r", 300, AFB_CMD_CHECK));
+        if (result != AFB_OK) {
+            return result;
+        }
     }
+    return 0;
+}
 
-    //checksum
-    csum = checkSum(totalFuses);
-    if (verbose) {
-        printf("sending csum: %04X\n", csum);
+static void closeSerial(void) {
+    // watch mode keeps the programmer open between the writes
+    if (flagWatch) {
+        return;
     }
-    sprintf(buf, "#c %04X\r", csum);
-    sendLine(buf, MAX_LINE, 300);
+    afbClose(programmer);
+}
 
-    //end of upload
-    return sendGenericCommand("#e\r", "Upload failed", 300, 0); 
+static int sendBuffer(char* buf) {
+    int total = strlen(buf);
 
+    // write the query into the serial port's file
+    // file is opened non blocking so we have to ensure all contents is written
+    while (total > 0) {
+        int writeSize = afbWriteRaw(programmer, buf, total);
+        if (writeSize < 0) {
+            printf("ERROR: written: %i (%s)\n", writeSize, strerror(errno));
+            return -4;
+        }
+        buf += writeSize;
+        total -= writeSize;
+    }
+    return 0;
 }
 
 //returns 0 on success
 char sendGenericCommand(const char* command, const char* errorText, int maxDelay, char printResult) {
-    char buf[MAX_LINE];
-    int readSize;
+    AfbResult result;
+    int flags = AFB_CMD_CHECK;
 
-    sprintf(buf, "%s", command);
-    readSize = sendLine(buf, MAX_LINE, maxDelay);
-    if (readSize < 0)  {
-        if (verbose) {
+    if (printResult) {
+        flags |= AFB_CMD_PRINT;
+    }
+    if (printSerialWhileWaiting) {
+        flags |= AFB_CMD_STREAM;
+    }
+    result = runOperation(afbCommandStart(programmer, command, maxDelay, flags));
+    if (result != AFB_OK) {
+        if (verbose && result != AFB_ERR_DEVICE) {
             printf("%s\n", errorText);
         }
         return -1;
-    } else {
-        char* response = stripPrompt(buf);
-        char* lastLine = findLastLine(response);
-        if (lastLine == 0 || (lastLine[0] == 'E' && lastLine[1] == 'R')) {
-            printf("%s\n", response);
-            return -1;
-        } else if (printResult && printSerialWhileWaiting == 0) {
-            printf("%s\n", response);
-        }
     }
     return 0;
 }
 
-static char operationWriteOrVerify(char doWrite) {
-    char buf[MAX_LINE];
-    int readSize;
-
-    char result;
-
-    if (readFile(NULL)) {
-        return -1;
-    }
-
-    result = parseFuseMap(galbuffer);
-    if (verbose) {
-        printf("parse result=%i\n", result);
-    }
+// uploads the parsed fuse map and writes and / or verifies it
+static char writeDesign(char doWrite) {
+    AfbResult result;
 
     if (openSerial() != 0) {
         return -1;
     }
 
-    // set power-down fuse bit (do it before upload to correctly calculate check-sum)
-    result = sendGenericCommand(flagEnableApd ? "z\r" : "Z\r", "APD set failed ?", 4000, 0);
-    if (result) {
-        goto finish;
-    }
-    result = upload();
-    if (result) {
-        return result;
-    }
-
-    // write command
-    if (doWrite) {
-        result = sendGenericCommand("w\r", "write failed ?", 18000, 0);
-        if (result) {
-            goto finish;
-        }
-    }
+    // sets the power-down fuse, uploads the fuse map, then writes and verifies it
+    printf("Uploading fuse map...\n");
+    result = runOperation(afbWriteStart(programmer, &design, doWrite, opVerify));
 
-    // verify command
-    if (opVerify) {
-        result = sendGenericCommand("v\r", "verify failed ?", 18000, 0);
-    }
-finish:
     closeSerial();
-    return result;
+    return result == AFB_OK ? 0 : -1;
 }
 
+static char operationWriteOrVerify(char doWrite) {
+    if (parseFuseMap()) {
+        return -1;
+    }
+    return writeDesign(doWrite);
+}
 
 static char operationReadInfo(void) {
-
-    char result;
+    AfbResult result;
 
     if (openSerial() != 0) {
         return -1;
@@ -1024,10 +789,13 @@ static char operationReadInfo(void) {
     if (verbose) {
         printf("sending 'p' command...\n");
     }
-    result = sendGenericCommand("p\r", "info failed ?", 4000, 1);
+    result = runOperation(afbInfoStart(programmer));
+    if (result != AFB_OK && result != AFB_ERR_DEVICE && verbose) {
+        printf("info failed ?\n");
+    }
 
     closeSerial();
-    return result;
+    return result == AFB_OK ? 0 : -1;
 }
 
 // Test of programming voltage. Most chips require +12V to start prograaming.
@@ -1097,12 +865,12 @@ static char operationMeasureVpp(void) {
     }
 
     if (verbose) {
-        printf("sending '%c' command...\n", gal != UNKNOWN ? 'M' : 'm');
+        printf("sending '%c' command...\n", gal != AFB_GAL_UNKNOWN ? 'M' : 'm');
     }
     
     //print the measured voltages if the feature is available
     printSerialWhileWaiting = 1;
-    if (gal != UNKNOWN) {
+    if (gal != AFB_GAL_UNKNOWN) {
         result = sendGenericCommand("M\r", "custom measurement failed", 40000, 1);
     } else {
         result = sendGenericCommand("m\r", "VPP measurement failed", 40000, 1);
@@ -1115,8 +883,7 @@ static char operationMeasureVpp(void) {
 
 
 static char operationSetGalCheck(void) {
-    int readSize;
-    char result;
+    AfbResult result;
 
     if (openSerial() != 0) {
         return -1;
@@ -1124,15 +891,13 @@ static char operationSetGalCheck(void) {
     if (verbose) {
         printf("sending '%c' command\n", noGalCheck ? 'F' : 'f');
     }
-    result = sendGenericCommand(noGalCheck ? "F\r" : "f\r", "noGalCheck failed ?", 4000, 0);
+    result = runOperation(afbSetGalCheckStart(programmer, !noGalCheck));
     closeSerial();
-    return result;    
+    return result == AFB_OK ? 0 : -1;
 }
 
-static char operationSetGalType(Galtype type) {
-    char buf[MAX_LINE];
-    int readSize;
-    char result;
+static char operationSetGalType(AfbGalType type) {
+    AfbResult result;
 
     if (openSerial() != 0) {
         return -1;
@@ -1140,10 +905,9 @@ static char operationSetGalType(Galtype type) {
     if (verbose) {
         printf("sending 'g' command type=%i\n", type);
     }
-    sprintf(buf, "g%c\r", '0' + (int)type); 
-    result = sendGenericCommand(buf, "setGalType failed ?", 4000, 0);
+    result = runOperation(afbSetGalTypeStart(programmer, type));
     closeSerial();
-    return result;    
+    return result == AFB_OK ? 0 : -1;
 }
 
 static char operationSecureGal() {
@@ -1162,108 +926,596 @@ static char operationSecureGal() {
 }
 
 static char operationWritePes(void) {
-    char buf[MAX_LINE];
-    int readSize;
-    char result;
+    AfbResult result;
 
     if (openSerial() != 0) {
         return -1;
     }
 
-    //Switch to upload mode to specify GAL
-    sprintf(buf, "u\r");
-    sendLine(buf, MAX_LINE, 300);
-
-    //set GAL type
-    sprintf(buf, "#t %c\r", '0' + (int) gal);
-    sendLine(buf, MAX_LINE, 300);
-
-    //set new PES
-    sprintf(buf, "#p %s\r", pesString);
-    sendLine(buf, MAX_LINE, 300);
-
-    //Exit upload mode (ensure the return texts are discarded by waiting 100 ms)
-    sprintf(buf, "#e\r");
-    sendLine(buf, MAX_LINE, 100);
-
     if (verbose) {
         printf("sending 'P' command...\n");
     }
-    result = sendGenericCommand("P\r", "write PES failed ?", 4000, 0);
+    result = runOperation(afbWritePesStart(programmer, gal, pesString));
 
     closeSerial();
-    return result;
+    return result == AFB_OK ? 0 : -1;
 }
 
 static char operationEraseGal(void) {
-    char buf[MAX_LINE];
-    int readSize;
-    char result;
+    AfbResult result;
 
     if (openSerial() != 0) {
         return -1;
     }
 
-    //Switch to upload mode to specify GAL
-    sprintf(buf, "u\r");
-    sendLine(buf, MAX_LINE, 300);
+    result = runOperation(afbEraseStart(programmer, gal, flagEraseAll));
 
-    //set GAL type
-    sprintf(buf, "#t %c\r", '0' + (int) gal);
-    sendLine(buf, MAX_LINE, 300);
+    closeSerial();
+    return result == AFB_OK ? 0 : -1;
+}
 
-    //Exit upload mode (ensure the return texts are discarded by waiting 100 ms)
-    sprintf(buf, "#e\r");
-    sendLine(buf, MAX_LINE, 100);
+static char operationReadFuses(void) {
+    AfbResult result;
 
-    if (flagEraseAll) {
-        result = sendGenericCommand("~\r", "erase all failed ?", 4000, 0);
-    } else {
-        result = sendGenericCommand("c\r", "erase failed ?", 4000, 0);
+    if (openSerial() != 0) {
+        return -1;
     }
 
+    // the fuse map is printed by the output callback
+    result = runOperation(afbReadStart(programmer, gal));
+
     closeSerial();
-    return result;
+    return result == AFB_OK ? 0 : -1;
 }
 
-static char operationReadFuses(void) {
-    char* response;
-    char* buf = galbuffer;
-    int readSize;
+// ATF150x fuse map: JEDEC fuse index <-> SVF row and column (see utils/jtag/device.py)
+#define ATF_MAX_ROW 769
+#define ATF_MAX_ROW_BYTES 21
+#define ATF_IDCODE_1502 0x0150203F
+#define ATF_IDCODE_1504 0x0150403F
+#define ATF_IDCODE_MASK 0xFFFEEFFF
+
+// ISP stream records - see jtag_atf150x.h in the Arduino sketch
+#define ISP_END       0
+#define ISP_IDCODE    1
+#define ISP_ENABLE    2
+#define ISP_ERASE     3
+#define ISP_PROGRAM   4
+#define ISP_VERIFY    5
+#define ISP_DISABLE   6
+#define ISP_WIDTH     7
+#define ISP_READ      8
+#define ISP_SCAN      9
+
+#define ISP_ROW_FRAME 0x02      // starts the binary frame of a row read by ISP_READ
+
+// SVF rows are stored as big endian bit vectors: row bit 0 is the LSB of the last byte
+static unsigned char atfRows[ATF_MAX_ROW][ATF_MAX_ROW_BYTES];
+static short atfRowOrder[ATF_MAX_ROW];
+static int atfRowCount = 0;
+// number of rows received from the MCU during read-back
+static int atfRowsRead = 0;
+
+static unsigned int atfIdcode(void) {
+    return gal == AFB_ATF1502AS ? ATF_IDCODE_1502 : ATF_IDCODE_1504;
+}
 
-    if (openSerial() != 0) {
-        return -1;
+// returns the number of bits in the SVF row
+static int atfRowWidth(int row) {
+    if (row == 256) {
+        return 32;
+    } else if (row == 512) {
+        return 4;
+    } else if (row == 768) {
+        return 16;
+    }
+    return gal == AFB_ATF1502AS ? 86 : 166;
+}
+
+// returns -1 for reserved fuses, 0 otherwise
+static int atfJedToSvf(int jed, int* row, int* col) {
+    if (gal == AFB_ATF1502AS) {
+        if (jed < 7680) {
+            *row = 12 + jed % 96;
+            *col = 79 - jed / 96;
+        } else if (jed < 15360) {
+            *row = 128 + (jed - 7680) % 96;
+            *col = 79 - (jed - 7680) / 96;
+        } else if (jed < 16320) {
+            *row = (jed - 15360) / 80;
+            *col = 79 - (jed - 15360) % 80;
+        } else if (jed < 16720) {
+            *row = 224 + (jed - 16320) % 5;
+            *col = 79 - (jed - 16320) / 5;
+        } else if (jed < 16750) {
+            *row = 224 + (jed - 16320) % 5;
+            *col = 85 - (jed - 16320) / 5 + 80;
+        } else if (jed < 16782) {
+            *row = 256;
+            *col = 31 - (jed - 16750);
+        } else if (jed < 16786) {
+            *row = 512;
+            *col = 3 - (jed - 16782);
+        } else if (jed < 16802) {
+            *row = 768;
+            *col = 15 - (jed - 16786);
+        } else {
+            return -1;
+        }
+    } else {
+        if (jed < 15360) {
+            *row = 12 + jed % 96;
+            *col = 165 - jed / 96;
+        } else if (jed < 30720) {
+            *row = 128 + (jed - 15360) % 96;
+            *col = 165 - (jed - 15360) / 96;
+        } else if (jed < 32640) {
+            *row = (jed - 30720) / 160;
+            *col = 165 - (jed - 30720) % 160;
+        } else if (jed < 34134) {
+            *row = 224 + (jed - 32640) % 9;
+            *col = 165 - (jed - 32640) / 9;
+        } else if (jed < 34166) {
+            *row = 256;
+            *col = 31 - (jed - 34134);
+        } else if (jed < 34170) {
+            *row = 512;
+            *col = 3 - (jed - 34166);
+        } else if (jed < 34186) {
+            *row = 768;
+            *col = 15 - (jed - 34170);
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Converts the JEDEC fuse map into SVF rows. The rows are ordered by their first
+// appearance in the fuse map - the same order as used by fuseconv.py
+static int atfFusesToRows(void) {
+    int i, row, col;
+    char used[ATF_MAX_ROW] = {0};
+
+    atfRowCount = 0;
+    for (i = 0; i < afbGalInfo[gal].fuses; i++) {
+        int size;
+        if (atfJedToSvf(i, &row, &col)) {
+            continue;
+        }
+        size = (atfRowWidth(row) + 7) / 8;
+        if (!used[row]) {
+            int width = atfRowWidth(row);
+            used[row] = 1;
+            atfRowOrder[atfRowCount++] = row;
+            // unprogrammed bits are 1, padding bits above the row width are 0
+            memset(atfRows[row], 0xFF, size);
+            if (width & 7) {
+                atfRows[row][0] = (1 << (width & 7)) - 1;
+            }
+        }
+        if (jedecGetFuse(&design.jedec, i)) {
+            atfRows[row][size - 1 - col / 8] |= (1 << (col & 7));
+        } else {
+            atfRows[row][size - 1 - col / 8] &= ~(1 << (col & 7));
+        }
     }
+    return atfRowCount;
+}
 
-    //Switch to upload mode to specify GAL
-    sprintf(buf, "u\r");
-    sendLine(buf, MAX_LINE, 100);
+static int atfAddRowRecords(unsigned char* buf, int pos, char record) {
+    int i;
+    int width = 0;
+
+    for (i = 0; i < atfRowCount; i++) {
+        int row = atfRowOrder[i];
+        if (atfRowWidth(row) != width) {
+            width = atfRowWidth(row);
+            buf[pos++] = ISP_WIDTH;
+            buf[pos++] = width >> 8;
+            buf[pos++] = width & 0xFF;
+        }
+        buf[pos++] = record;
+        buf[pos++] = row >> 8;
+        buf[pos++] = row & 0xFF;
+        memcpy(buf + pos, atfRows[row], (width + 7) / 8);
+        pos += (width + 7) / 8;
+    }
+    return pos;
+}
 
-    //set GAL type
-    sprintf(buf, "#t %c\r", '0' + (int) gal);
-    sendLine(buf, MAX_LINE, 100);
+// Creates the ISP stream for the MCU. Returns the size of the stream.
+static int atfMakeIspStream(unsigned char* buf, char doWrite, char doVerify) {
+    int pos = 0;
+    unsigned int id = atfIdcode();
+
+    buf[pos++] = ISP_IDCODE;
+    buf[pos++] = (id >> 24) & 0xFF;
+    buf[pos++] = (id >> 16) & 0xFF;
+    buf[pos++] = (id >> 8) & 0xFF;
+    buf[pos++] = id & 0xFF;
+    buf[pos++] = ISP_ENABLE;
+    if (doWrite) {
+        buf[pos++] = ISP_ERASE;
+        pos = atfAddRowRecords(buf, pos, ISP_PROGRAM);
+    }
+    if (doVerify) {
+        pos = atfAddRowRecords(buf, pos, ISP_VERIFY);
+    }
+    buf[pos++] = ISP_DISABLE;
+    buf[pos++] = ISP_END;
+    return pos;
+}
 
-    //Exit upload mode (ensure the texts are discarded by waiting 100 ms)
-    sprintf(buf, "#e\r");
-    sendLine(buf, MAX_LINE, 1000);
+// Creates the ISP stream that reads all rows. Returns the size of the stream.
+static int atfMakeReadStream(unsigned char* buf) {
+    int i;
+    int pos = 0;
+    int width = 0;
+    unsigned int id = atfIdcode();
+
+    // the row order and row widths do not depend on the fuse map contents
+    jedecClear(&design.jedec, 0);
+    atfFusesToRows();
+
+    buf[pos++] = ISP_IDCODE;
+    buf[pos++] = (id >> 24) & 0xFF;
+    buf[pos++] = (id >> 16) & 0xFF;
+    buf[pos++] = (id >> 8) & 0xFF;
+    buf[pos++] = id & 0xFF;
+    buf[pos++] = ISP_ENABLE;
+    for (i = 0; i < atfRowCount; i++) {
+        int row = atfRowOrder[i];
+        if (atfRowWidth(row) != width) {
+            width = atfRowWidth(row);
+            buf[pos++] = ISP_WIDTH;
+            buf[pos++] = width >> 8;
+            buf[pos++] = width & 0xFF;
+        }
+        buf[pos++] = ISP_READ;
+        buf[pos++] = row >> 8;
+        buf[pos++] = row & 0xFF;
+    }
+    buf[pos++] = ISP_DISABLE;
+    buf[pos++] = ISP_END;
+    atfRowsRead = 0;
+    return pos;
+}
 
-    //READ_FUSE command
-    sprintf(buf, "r\r");
-    readSize = sendLine(buf, GALBUFSIZE, 22000);
-    if (readSize < 0)  {
-        return -1;
+// stores the row received from the MCU, rows are received in the order they were requested
+static void atfStoreReadRow(const unsigned char* data, int size) {
+    int row;
+    if (atfRowsRead >= atfRowCount) {
+        printf("Warning: unexpected row data\n");
+        return;
     }
-    response = stripPrompt(buf);
-    printf("%s\n", response);
-    closeSerial();
+    row = atfRowOrder[atfRowsRead++];
+    if (size != (atfRowWidth(row) + 7) / 8) {
+        printf("Warning: row %d has unexpected size %d\n", row, size);
+        return;
+    }
+    memcpy(atfRows[row], data, size);
+}
 
-    if (response[0] == 'E' && response[1] == 'R') {
-        return -1;
+// Converts the SVF rows into JEDEC fuse map. Reserved fuses are 0 (see svf_to_jed() in utils/jtag/device.py)
+static void atfRowsToFuses(void) {
+    int i, row, col;
+
+    jedecClear(&design.jedec, 0);
+    for (i = 0; i < afbGalInfo[gal].fuses; i++) {
+        if (0 == atfJedToSvf(i, &row, &col)) {
+            int size = (atfRowWidth(row) + 7) / 8;
+            jedecSetFuse(&design.jedec, i, (atfRows[row][size - 1 - col / 8] >> (col & 7)) & 1);
+        }
+    }
+}
+
+static void atfPrintJedec(void) {
+    int i;
+    int fuses = afbGalInfo[gal].fuses;
+
+    // STX and ETX markers make the file readable by utils/jtag/fuseconv.py
+    printf("\x02JEDEC file for %s*QP%d*QF%d*QV0*F0*G0*X0*\n", afbGalInfo[gal].name, afbGalInfo[gal].pins, fuses);
+    for (i = 0; i < fuses; i++) {
+        if ((i & 63) == 0) {
+            printf("L%05d ", i);
+        }
+        putchar(jedecGetFuse(&design.jedec, i) ? '1' : '0');
+        if ((i & 63) == 63 || i == fuses - 1) {
+            printf("*\n");
+        }
+    }
+    printf("C%04X\n*\n\x03" "0000\n", jedecChecksum(&design.jedec, fuses));
+}
+
+// XSVF instructions used by the .jed to .xsvf conversion (see jtag_xsvf_player.h)
+#define XCOMPLETE 0
+#define XTDOMASK 1
+#define XSIR 2
+#define XSDR 3
+#define XREPEAT 7
+#define XSDRSIZE 8
+#define XSDRTDO 9
+#define XSTATE 18
+#define XENDIR 19
+#define XENDDR 20
+#define XWAITSTATE 24
+#define XTRST 28
+
+#define XSTATE_RESET 0
+#define XSTATE_IDLE 1
+
+// ATF15xx instructions (IR is 10 bits long)
+#define ATF_IDCODE            0x059
+#define ATF_ISC_CONFIG        0x280
+#define ATF_ISC_READ          0x28C
+#define ATF_ISC_DATA          0x290
+#define ATF_ISC_PROGRAM_ERASE 0x29E
+#define ATF_ISC_ADDRESS       0x2A1
+#define ATF_ISC_LATCH_ERASE   0x2B3
+#define ATF_ISC_UNKNOWN       0x2BF
+
+// XSVF writer: XSDRSIZE and XTDOMASK are emitted only when they change (as svf2xsvf.py does)
+typedef struct {
+    unsigned char* buf;
+    int pos;
+    int sdrSize;
+    int maskBits;
+    unsigned char mask[ATF_MAX_ROW_BYTES];
+} XsvfWriter;
+
+static void xsvfLong(XsvfWriter* x, unsigned int v) {
+    x->buf[x->pos++] = (v >> 24) & 0xFF;
+    x->buf[x->pos++] = (v >> 16) & 0xFF;
+    x->buf[x->pos++] = (v >> 8) & 0xFF;
+    x->buf[x->pos++] = v & 0xFF;
+}
+
+static void xsvfBytes(XsvfWriter* x, const unsigned char* data, int bits) {
+    memcpy(x->buf + x->pos, data, (bits + 7) / 8);
+    x->pos += (bits + 7) / 8;
+}
+
+static void xsvfByteCmd(XsvfWriter* x, unsigned char cmd, unsigned char val) {
+    x->buf[x->pos++] = cmd;
+    x->buf[x->pos++] = val;
+}
+
+static void xsvfSir(XsvfWriter* x, int ir) {
+    x->buf[x->pos++] = XSIR;
+    x->buf[x->pos++] = 10;
+    x->buf[x->pos++] = ir >> 8;
+    x->buf[x->pos++] = ir & 0xFF;
+}
+
+static void xsvfWait(XsvfWriter* x, unsigned int usecs) {
+    xsvfByteCmd(x, XWAITSTATE, XSTATE_IDLE);
+    x->buf[x->pos++] = XSTATE_IDLE;
+    xsvfLong(x, 0);
+    xsvfLong(x, usecs);
+}
+
+static void xsvfSdrSetup(XsvfWriter* x, int bits, const unsigned char* mask) {
+    int size = (bits + 7) / 8;
+    if (x->sdrSize != bits) {
+        x->sdrSize = bits;
+        x->buf[x->pos++] = XSDRSIZE;
+        xsvfLong(x, bits);
+    }
+    if (x->maskBits != bits || memcmp(x->mask, mask, size)) {
+        x->maskBits = bits;
+        memcpy(x->mask, mask, size);
+        x->buf[x->pos++] = XTDOMASK;
+        xsvfBytes(x, mask, bits);
+    }
+}
+
+// SDR without TDO check
+static void xsvfSdr(XsvfWriter* x, int bits, const unsigned char* tdi) {
+    unsigned char zeros[ATF_MAX_ROW_BYTES] = {0};
+    xsvfSdrSetup(x, bits, zeros);
+    x->buf[x->pos++] = XSDR;
+    xsvfBytes(x, tdi, bits);
+}
+
+static void xsvfSdrValue(XsvfWriter* x, int bits, unsigned int value) {
+    unsigned char tdi[4];
+    int i = (bits + 7) / 8;
+    while (i) {
+        i--;
+        tdi[i] = value & 0xFF;
+        value >>= 8;
+    }
+    xsvfSdr(x, bits, tdi);
+}
+
+static void xsvfSdrTdo(XsvfWriter* x, int bits, const unsigned char* tdi, const unsigned char* tdo, const unsigned char* mask) {
+    xsvfSdrSetup(x, bits, mask);
+    x->buf[x->pos++] = XSDRTDO;
+    xsvfBytes(x, tdi, bits);
+    xsvfBytes(x, tdo, bits);
+}
+
+static void xsvfAtfSetAddress(XsvfWriter* x, int row) {
+    xsvfSir(x, ATF_ISC_ADDRESS);
+    xsvfSdrValue(x, 11, row);
+}
+
+// Converts the SVF rows into XSVF. The output is the same as of fuseconv.py + svf2xsvf.py.
+// Returns the size of the XSVF data.
+static int atfMakeXsvf(unsigned char* buf, char doWrite, char doVerify) {
+    XsvfWriter x;
+    unsigned char tdi[4] = {0xFF, 0xFE, 0xEF, 0xFF};
+    unsigned char tdo[4];
+    unsigned char ones[ATF_MAX_ROW_BYTES];
+    unsigned int id = atfIdcode();
+    int i;
+
+    memset(&x, 0, sizeof(x));
+    x.buf = buf;
+    x.sdrSize = -1;
+
+    // header
+    xsvfByteCmd(&x, XREPEAT, 0);
+    xsvfByteCmd(&x, XTRST, 3); // absent
+    xsvfByteCmd(&x, XENDIR, 0);
+    xsvfByteCmd(&x, XENDDR, 0);
+    xsvfByteCmd(&x, XSTATE, XSTATE_RESET);
+
+    // check IDCODE
+    tdo[0] = (id >> 24) & 0xFF;
+    tdo[1] = (id >> 16) & 0xFF;
+    tdo[2] = (id >> 8) & 0xFF;
+    tdo[3] = id & 0xFF;
+    xsvfSir(&x, ATF_IDCODE);
+    xsvfSdrTdo(&x, 32, tdi, tdo, tdi);
+
+    // ISC enable
+    xsvfSir(&x, ATF_ISC_CONFIG);
+    xsvfSdrValue(&x, 10, 0x1B9);
+    xsvfByteCmd(&x, XSTATE, XSTATE_IDLE);
+
+    if (doWrite) {
+        // ISC erase
+        xsvfSir(&x, ATF_ISC_LATCH_ERASE);
+        xsvfSir(&x, ATF_ISC_PROGRAM_ERASE);
+        xsvfWait(&x, 210000);
+        xsvfSir(&x, ATF_ISC_UNKNOWN);
+
+        // ISC program
+        for (i = 0; i < atfRowCount; i++) {
+            int row = atfRowOrder[i];
+            xsvfAtfSetAddress(&x, row);
+            xsvfSir(&x, ATF_ISC_DATA | (row >> 8));
+            xsvfSdr(&x, atfRowWidth(row), atfRows[row]);
+            xsvfSir(&x, ATF_ISC_PROGRAM_ERASE);
+            xsvfWait(&x, 30000);
+            xsvfSir(&x, ATF_ISC_UNKNOWN);
+        }
+    }
+
+    if (doVerify) {
+        for (i = 0; i < atfRowCount; i++) {
+            int row = atfRowOrder[i];
+            int width = atfRowWidth(row);
+            memset(ones, 0xFF, sizeof(ones));
+            if (width & 7) {
+                ones[0] = (1 << (width & 7)) - 1;
+            }
+            xsvfAtfSetAddress(&x, row);
+            xsvfSir(&x, ATF_ISC_READ);
+            xsvfWait(&x, 20000);
+            xsvfSir(&x, ATF_ISC_DATA | (row >> 8));
+            xsvfSdrTdo(&x, width, atfRows[row], atfRows[row], ones);
+        }
     }
 
+    // ISC disable
+    xsvfSir(&x, ATF_ISC_CONFIG);
+    xsvfSdrValue(&x, 10, 0);
+    xsvfByteCmd(&x, XSTATE, XSTATE_IDLE);
+
+    x.buf[x.pos++] = XCOMPLETE;
+    return x.pos;
+}
+
+// reads the .jed file and converts it to SVF rows
+static int atfReadJedFile(void) {
+    if (parseFuseMap()) {
+        return -1;
+    }
+    if (lastFuse != afbGalInfo[gal].fuses) {
+        printf("Error: %s has %d fuses, JED file has %d. Wrong -t option?\n", afbGalInfo[gal].name, afbGalInfo[gal].fuses, lastFuse);
+        return -1;
+    }
+    atfFusesToRows();
+    if (verbose) {
+        printf("SVF rows: %d\n", atfRowCount);
+    }
     return 0;
 }
 
+static char isJedFile(char* fname) {
+    int len = strlen(fname);
+    return (len > 4 && 0 == strcasecmp(fname + len - 4, ".jed")) ? 1 : 0;
+}
+
+
+// JTAG chain (see xsvf_jtag_scan_chain() in jtag_xsvf_player.h), devices are ordered from TDO side
+#define JTAG_CHAIN_MAX_DEVICES 8
+
+typedef struct {
+    unsigned int idcode;
+    int irLength;
+    AfbGalType type; // ATF1502AS, ATF1504AS or UNKNOWN
+} JtagChainDevice;
+
+static JtagChainDevice jtagChain[JTAG_CHAIN_MAX_DEVICES];
+static int jtagChainCount = 0;
+static int jtagChainIrLength = 0;
+// padding bits of the selected device: hir, tir, hdr, tdr
+static int jtagChainPad[4];
+
+// stores the chain scan result line sent by the MCU (without the 'C' prefix)
+static void jtagStoreChainLine(char* line) {
+    JtagChainDevice* d;
+
+    if (0 == strncmp(line, "IR:", 3)) {
+        jtagChainIrLength = atoi(line + 3);
+        return;
+    }
+    if (jtagChainCount >= JTAG_CHAIN_MAX_DEVICES) {
+        return;
+    }
+    d = &jtagChain[jtagChainCount++];
+    d->idcode = (unsigned int) strtoul(line, NULL, 16);
+    d->type = AFB_GAL_UNKNOWN;
+    d->irLength = 0;
+    if ((d->idcode & ATF_IDCODE_MASK) == (ATF_IDCODE_1502 & ATF_IDCODE_MASK)) {
+        d->type = AFB_ATF1502AS;
+    } else if ((d->idcode & ATF_IDCODE_MASK) == (ATF_IDCODE_1504 & ATF_IDCODE_MASK)) {
+        d->type = AFB_ATF1504AS;
+    }
+    if (d->type != AFB_GAL_UNKNOWN) {
+        d->irLength = 10;
+    }
+}
+
+// selects the target device: other devices in the chain are put to BYPASS
+static void jtagChainSelect(int index) {
+    int i;
+
+    memset(jtagChainPad, 0, sizeof(jtagChainPad));
+    for (i = 0; i < jtagChainCount; i++) {
+        if (i < index) {
+            jtagChainPad[0] += jtagChain[i].irLength;
+            jtagChainPad[2]++;
+        } else if (i > index) {
+            jtagChainPad[1] += jtagChain[i].irLength;
+            jtagChainPad[3]++;
+        }
+    }
+    gal = jtagChain[index].type;
+}
+
+// reads exactly 'size' bytes from the serial port
+static int readJtagSerialBytes(char* buf, int size, int maxDelay) {
+    int pos = 0;
+    while (pos < size && maxDelay > 0) {
+        int readSize = afbReadRaw(programmer, buf + pos, size - pos);
+        if (readSize > 0) {
+            pos += readSize;
+        } else {
+#ifndef _USE_WIN_API_
+            usleep(1 * 1000);
+            maxDelay -= 10;
+#else
+            maxDelay -= 30;
+#endif
+        }
+    }
+    return pos;
+}
 
 static int readJtagSerialLine(char* buf, int bufSize, int maxDelay, int* feedRequest) {
     char* bufStart = buf;
@@ -1273,7 +1525,7 @@ static int readJtagSerialLine(char* buf, int bufSize, int maxDelay, int* feedReq
     memset(buf, 0, bufSize);
 
     while (maxDelay > 0) {
-        readSize = serialDeviceRead(serialF, buf, 1);
+        readSize = afbReadRaw(programmer, buf, 1);
         if (readSize > 0) {
             bufPos += readSize;
             buf[1] = 0;
@@ -1283,7 +1535,7 @@ static int readJtagSerialLine(char* buf, int bufSize, int maxDelay, int* feedReq
                 bufPos -= readSize;
                 buf[0] = 0;
                 //extra 5 bytes should be present: 3 bytes of size, 2 new line chars
-                readSize = serialDeviceRead(serialF, tmp, 3);
+                readSize = afbReadRaw(programmer, tmp, 3);
                 if (readSize == 3) {
                     int retry = 1000;
                     tmp[3] = 0;
@@ -1292,7 +1544,7 @@ static int readJtagSerialLine(char* buf, int bufSize, int maxDelay, int* feedReq
 
                     //read the extra 2 characters (new line chars)
                     while (retry && readSize != 2) {
-                        readSize = serialDeviceRead(serialF, tmp, 2);
+                        readSize = afbReadRaw(programmer, tmp, 2);
                         retry--;
                     }
                     if (readSize != 2 || tmp[0] != '\r' || tmp[1] != '\n') {
@@ -1303,8 +1555,19 @@ static int readJtagSerialLine(char* buf, int bufSize, int maxDelay, int* feedReq
                 }
                 //printf("***\n");
             } else
+            // binary frame: ISP_ROW_FRAME <size> <data>
+            if (buf[0] == ISP_ROW_FRAME && bufPos == 1) {
+                if (readJtagSerialBytes(buf + 1, 1, 1000) == 1) {
+                    int size = (unsigned char) buf[1];
+                    bufPos = 2 + readJtagSerialBytes(buf + 2, size, 1000);
+                    if (bufPos != size + 2) {
+                        printf("Warning: corrupted binary frame! %d \n", bufPos);
+                    }
+                }
+                maxDelay = 0; //force exit
+            } else
             if (buf[0] == '\r') {
-                readSize = serialDeviceRead(serialF, buf, 1); // read \n coming from Arduino
+                readSize = afbReadRaw(programmer, buf, 1); // read \n coming from Arduino
                 //printf("-%c-\n", buf[0] == '\n' ? 'n' : 'r');
                 buf[0] = 0;
                 bufPos++;
@@ -1331,7 +1594,69 @@ static int readJtagSerialLine(char* buf, int bufSize, int maxDelay, int* feedReq
     return bufPos;
 }
 
-static int playJtagFile(char* label, int fSize, int vpp, int showProgress) {
+// XSVF stream packing (see xsvf_player_next_byte() in jtag_xsvf_player.h)
+#define XPACK 0x7F
+#define XPACK_HISTORY_SIZE 256
+#define XPACK_MIN_MATCH 3
+#define XPACK_MAX_MATCH (255 + XPACK_MIN_MATCH)
+
+char xsvfPacked[GALBUFSIZE + GALBUFSIZE / 8 + 2];
+
+// Packs the XSVF data by LZSS. The packed stream starts with XPACK
+// instruction. Returns the packed size.
+static int xsvfPack(const unsigned char* in, int size, unsigned char* out) {
+    int pos = 0;
+    int outPos = 1;
+    int flagPos = 0;
+    int flagBit = 8;
+
+    out[0] = XPACK;
+    while (pos < size) {
+        int bestLen = 0;
+        int bestDist = 0;
+        int dist;
+        int maxLen = size - pos;
+
+        if (maxLen > XPACK_MAX_MATCH) {
+            maxLen = XPACK_MAX_MATCH;
+        }
+        // find the longest match in the history
+        for (dist = 1; dist <= XPACK_HISTORY_SIZE && dist <= pos; dist++) {
+            const unsigned char* src = in + pos - dist;
+            int len = 0;
+            while (len < maxLen && src[len] == in[pos + len]) {
+                len++;
+            }
+            if (len > bestLen) {
+                bestLen = len;
+                bestDist = dist;
+                if (len == maxLen) {
+                    break;
+                }
+            }
+        }
+
+        if (flagBit == 8) {
+            flagPos = outPos++;
+            out[flagPos] = 0;
+            flagBit = 0;
+        }
+        if (bestLen >= XPACK_MIN_MATCH) {
+            out[flagPos] |= 1 << flagBit;
+            out[outPos++] = bestDist - 1;
+            out[outPos++] = bestLen - XPACK_MIN_MATCH;
+            pos += bestLen;
+        } else {
+            out[outPos++] = in[pos++];
+        }
+        flagBit++;
+    }
+    return outPos;
+}
+
+// Sends the data to the MCU's JTAG processor: 'j' command plays XSVF data, 'J' command
+// runs the ATF150x ISP engine which consumes the ISP stream made by atfMakeIspStream().
+static int playJtagStream(char* label, char* data, int fSize, char command, int vpp, int showProgress) {
     char buf[MAX_LINE] = {0};
     int sendPos = 0;
     int lastSendPos = 0;
@@ -1342,19 +1667,36 @@ static int playJtagFile(char* label, int fSize, int vpp, int showProgress) {
     // support for XCOMMENT messages which might be interrupted by a feed request
     int continuePrinting = 0;
 
-    if (openSerial() != 0) {
+    // the serial port might be already opened by the caller
+    if (!afbIsOpen(programmer) && openSerial() != 0) {
         return -1;
     }
+    // pack the XSVF stream if the MCU can unpack it
+    if (command == 'j' && xsvfPackExists) {
+        int packedSize = xsvfPack((unsigned char*) data, fSize, (unsigned char*) xsvfPacked);
+        if (verbose) {
+            printf("XSVF packed size: %d / %d\n", packedSize, fSize);
+        }
+        if (packedSize < fSize) {
+            data = xsvfPacked;
+            fSize = packedSize;
+        }
+    }
     //compute check sum
     if (verbose) {
         int i;
         for (i = 0; i < fSize; i++) {
-            csum += (unsigned char) galbuffer[i];
+            csum += (unsigned char) data[i];
         }
     }
 
-    // send start-JTAG-player command
-    sprintf(buf, "j%d\r", vpp ? 1: 0);
+    // send start-JTAG-player command, optionally with the JTAG chain padding
+    if (flagJtagChain) {
+        sprintf(buf, "%c%d,%d,%d,%d,%d\r", command, vpp ? 1: 0,
+            jtagChainPad[0], jtagChainPad[1], jtagChainPad[2], jtagChainPad[3]);
+    } else {
+        sprintf(buf, "%c%d\r", command, vpp ? 1: 0);
+    }
     sendBuffer(buf);
 
     // read response from MCU and feed the XSVF player with data
@@ -1382,7 +1724,7 @@ static int playJtagFile(char* label, int fSize, int vpp, int showProgress) {
                 }
                 if (chunkSize > 0) {
                     // send the data over serial line
-                    int w = serialDeviceWrite(serialF, galbuffer + sendPos, chunkSize);
+                    int w = afbWriteRaw(programmer, data + sendPos, chunkSize);
                     sendPos += w;
                     // print progress / file position
                     if (showProgress && (sendPos - lastSendPos >= 1024 || sendPos == fSize)) {
@@ -1395,6 +1737,10 @@ static int playJtagFile(char* label, int fSize, int vpp, int showProgress) {
                 continuePrinting = 1;
             }
         }
+        // binary frame with row data
+        if (buf[0] == ISP_ROW_FRAME && readBytes > 2) {
+            atfStoreReadRow((unsigned char*) buf + 2, readBytes - 2);
+        } else
         // when the feed request was detected, there might be still some data in the buffer
         if (buf[0] != 0) {
             //prevous line had a feed request - this is a continuation
@@ -1424,15 +1770,20 @@ static int playJtagFile(char* label, int fSize, int vpp, int showProgress) {
                 break;
             } else
             // ready to receive anouncement
-            if (strcmp("RXSVF", buf) == 0) {
+            if (strcmp("RXSVF", buf) == 0 || strcmp("RISP", buf) == 0) {
                 ready = 1;
             } else
             // print important messages
             if (buf[0] == '!') {
                 // in verbose mode print all messages, otherwise print only success or fail messages
-                if (verbose || 0 == strcmp("!Success", buf) || 0 == strcmp("!Fail", buf)) {
+                // do not mix the success message with the printed JEDEC file when reading
+                if (verbose || (0 == strcmp("!Success", buf) && !opRead) || 0 == strcmp("!Fail", buf)) {
                     printf("%s\n", buf + 1);
                 }
+            } else
+            // JTAG chain scan result
+            if (buf[0] == 'C') {
+                jtagStoreChainLine(buf + 1);
             }
 #if 0
              //print all the rest
@@ -1453,6 +1804,10 @@ static int playJtagFile(char* label, int fSize, int vpp, int showProgress) {
     return result;
 }
 
+static int playJtagFile(char* label, int fSize, int vpp, int showProgress) {
+    return playJtagStream(label, galbuffer, fSize, 'j', vpp, showProgress);
+}
+
 
 static int processJtagInfo(void) {
     int result;
@@ -1463,7 +1818,7 @@ static int processJtagInfo(void) {
         return 0;
     }
 
-    if (!(gal == ATF1502AS || gal == ATF1504AS)) {
+    if (!(gal == AFB_ATF1502AS || gal == AFB_ATF1504AS)) {
         printf("error: info command is unsupported\n");
         return 1;
     }
@@ -1493,7 +1848,7 @@ static int processJtagErase(void) {
         return 0;
     }
     // Use default .xsvf file for erase.
-    sprintf(tmp, "xsvf/erase_%s.xsvf", galinfo[gal].name);
+    sprintf(tmp, "xsvf/erase_%s.xsvf", afbGalInfo[gal].name);
     filename = tmp;
 
     result = readFile(&fSize);
@@ -1507,6 +1862,92 @@ static int processJtagErase(void) {
     return playJtagFile("erase ", fSize, 1, 1);
 }
 
+// Writes and / or verifies the .jed file by the MCU's ISP engine. Older Arduino sketches
+// without the ISP engine are fed with XSVF data converted from the .jed file.
+static int processJtagJed(void) {
+    int size;
+    char command = 'J';
+
+    if (atfReadJedFile()) {
+        return -1;
+    }
+    if (openSerial() != 0) {
+        return -1;
+    }
+    if (jtagIspExists) {
+        size = atfMakeIspStream((unsigned char*) galbuffer, opWrite, opVerify);
+    } else {
+        command = 'j';
+        size = atfMakeXsvf((unsigned char*) galbuffer, opWrite, opVerify);
+    }
+    if (verbose) {
+        printf("%s stream size: %d\n", jtagIspExists ? "ISP" : "XSVF", size);
+    }
+    return playJtagStream(opWrite ? "write " : "verify ", galbuffer, size, command, 0, 1);
+}
+
+// reads the fuses by the MCU's ISP engine and prints them as JEDEC file
+static int processJtagRead(void) {
+    int size;
+    int result;
+
+    if (openSerial() != 0) {
+        return -1;
+    }
+    if (!jtagIspExists) {
+        printf("Error: the programmer does not support reading of %s. Upgrade the Arduino sketch.\n", afbGalInfo[gal].name);
+        closeSerial();
+        return -1;
+    }
+    size = atfMakeReadStream((unsigned char*) galbuffer);
+    result = playJtagStream("read ", galbuffer, size, 'J', 0, 0);
+    if (result) {
+        return result;
+    }
+    if (atfRowsRead != atfRowCount) {
+        printf("Error: received %d rows out of %d\n", atfRowsRead, atfRowCount);
+        return -1;
+    }
+    atfRowsToFuses();
+    atfPrintJedec();
+    return 0;
+}
+
+// converts the .jed file to .xsvf file
+static int processJtagConvert(void) {
+    char tmp[1024];
+    FILE* f;
+    int size;
+
+    if (atfReadJedFile()) {
+        return -1;
+    }
+    // use the input file name with .xsvf extension if the output file name is not specified
+    if (0 == outFilename) {
+        snprintf(tmp, sizeof(tmp) - 5, "%s", filename);
+        if (isJedFile(tmp)) {
+            tmp[strlen(tmp) - 4] = 0;
+        }
+        strcat(tmp, ".xsvf");
+        outFilename = tmp;
+    }
+    size = atfMakeXsvf((unsigned char*) galbuffer, 1, 1);
+
+    f = fopen(outFilename, "wb");
+    if (!f) {
+        printf("Error: failed to open file: %s\n", outFilename);
+        return -1;
+    }
+    if (fwrite(galbuffer, 1, size, f) != size) {
+        printf("Error: failed to write file: %s\n", outFilename);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    printf("%s: %d bytes written\n", outFilename, size);
+    return 0;
+}
+
 static int processJtagWrite(void) {
     int result;
     int fSize = 0;
@@ -1519,6 +1960,9 @@ static int processJtagWrite(void) {
     if (0 == filename) {
         return -1;
     }
+    if (isJedFile(filename)) {
+        return processJtagJed();
+    }
     result = readFile(&fSize);
     if (result) {
         return result;
@@ -1529,21 +1973,75 @@ static int processJtagWrite(void) {
 }
 
 
-static int processJtag(void) {
+// scans the JTAG chain and resolves the IR lengths of the devices
+static int processJtagChainScan(void) {
+    int i;
     int result;
-    if (verbose) {
-        printf("JTAG\n");
-    }
+    int knownIr = 0;
+    int unknown = -1;
+    unsigned char* buf = (unsigned char*) galbuffer;
 
-    if ((gal == ATF1502AS || gal == ATF1504AS) && (opRead || opVerify)) {
-        printf("error: read and verify operation is not supported\n");
-        return 1;
+    if (openSerial() != 0) {
+        return -1;
     }
-
-    result = processJtagInfo();
+    if (!jtagIspExists) {
+        printf("Error: the programmer does not support JTAG chains. Upgrade the Arduino sketch.\n");
+        closeSerial();
+        return -1;
+    }
+    jtagChainCount = 0;
+    jtagChainIrLength = 0;
+    memset(jtagChainPad, 0, sizeof(jtagChainPad));
+    buf[0] = ISP_SCAN;
+    buf[1] = ISP_END;
+    result = playJtagStream("", galbuffer, 2, 'J', 0, 0);
     if (result) {
         return result;
     }
+    if (jtagChainCount == 0) {
+        printf("Error: no JTAG device found\n");
+        return -1;
+    }
+
+    // IR length of a single unknown device can be derived from the total IR length
+    for (i = 0; i < jtagChainCount; i++) {
+        if (jtagChain[i].type == AFB_GAL_UNKNOWN) {
+            if (unknown >= 0) {
+                printf("Error: IR length of JTAG devices %d and %d is unknown\n", unknown, i);
+                return -1;
+            }
+            unknown = i;
+        } else {
+            knownIr += jtagChain[i].irLength;
+        }
+    }
+    if (unknown >= 0) {
+        jtagChain[unknown].irLength = jtagChainIrLength - knownIr;
+    }
+    if (jtagChainIrLength != knownIr + (unknown >= 0 ? jtagChain[unknown].irLength : 0) ||
+        (unknown >= 0 && jtagChain[unknown].irLength < 2)) {
+        printf("Error: unexpected IR length of the JTAG chain: %d\n", jtagChainIrLength);
+        return -1;
+    }
+
+    if (opInfo || verbose) {
+        printf("JTAG chain: %d device(s), IR length %d (TDO side first)\n", jtagChainCount, jtagChainIrLength);
+        for (i = 0; i < jtagChainCount; i++) {
+            printf("%d: ID %08X IR %2d %s\n", i, jtagChain[i].idcode, jtagChain[i].irLength,
+                jtagChain[i].type == AFB_GAL_UNKNOWN ? "unknown" : afbGalInfo[jtagChain[i].type].name);
+        }
+    }
+    return 0;
+}
+
+// erases, writes and verifies the selected device
+static int processJtagTarget(void) {
+    int result;
+
+    if (opVerify && !isJedFile(filename)) {
+        printf("error: verify operation is supported only with .jed files\n");
+        return 1;
+    }
 
     result = processJtagErase();
     if (result) {
@@ -1554,18 +2052,231 @@ static int processJtag(void) {
     if (result) {
         return result;
     }
+
+    // verification without writing
+    if (opVerify && !opWrite) {
+        return processJtagJed();
+    }
     return 0;
 }
 
-static int processExerciser(void) {
+// processes all ATF150x devices in the JTAG chain, one device after another
+static int processJtagChain(void) {
+    int i;
     int result;
-    int fSize = 0;
-    char tmp[32] = {0};
-    int pinCount;
-    int pulseDuration;
+    int atfIndex = 0;
+    int fileCount = 0;
+    char* files[JTAG_CHAIN_MAX_DEVICES];
+    char* originalFname = filename;
+    char fileList[1024];
 
-    result = readFile(&fSize);
-    if (result) {
+    result = processJtagChainScan();
+    if (result || !(opRead || opErase || opWrite || opVerify)) {
+        return result;
+    }
+
+    // split the comma separated file names
+    if (filename) {
+        char* f;
+        snprintf(fileList, sizeof(fileList), "%s", filename);
+        f = strtok(fileList, ",");
+        while (f && fileCount < JTAG_CHAIN_MAX_DEVICES) {
+            files[fileCount++] = f;
+            f = strtok(NULL, ",");
+        }
+    }
+
+    for (i = 0; i < jtagChainCount && 0 == result; i++) {
+        if (jtagChain[i].type == AFB_GAL_UNKNOWN) {
+            continue;
+        }
+        if (filename) {
+            if (atfIndex >= fileCount || 0 == strcmp(files[atfIndex], "-")) {
+                atfIndex++;
+                continue;
+            }
+            filename = files[atfIndex];
+        }
+        atfIndex++;
+        jtagChainSelect(i);
+        if (!opRead) {
+            printf("JTAG device %d: %s %s\n", i, afbGalInfo[gal].name, filename ? filename : "");
+        }
+        result = opRead ? processJtagRead() : processJtagTarget();
+        filename = originalFname;
+    }
+    return result;
+}
+
+static int processJtag(void) {
+    int result;
+    if (verbose) {
+        printf("JTAG\n");
+    }
+
+    if (opConvert) {
+        return processJtagConvert();
+    }
+
+    if (flagJtagChain) {
+        return processJtagChain();
+    }
+
+    if (opRead) {
+        return processJtagRead();
+    }
+
+    result = processJtagInfo();
+    if (result) {
+        return result;
+    }
+    return processJtagTarget();
+}
+
+// status text of the last command, the exerciser reads the sampled levels from it
+const char* getProgrammerStatusText(void) {
+    return afbGetStatusText(programmer);
+}
+
+// sends one vector table by the 'Xb' command and serves the feed requests until the prompt
+// 'vectors' is the count of vectors applied by the table, 'stat' receives the vectors and fails
+static int runExerciseTable(const unsigned char* table, int size, int waitMs, int vectors, int* stat) {
+    char buf[256];
+    int pos = 0;
+    int sendPos = 0;
+    int result = 0;
+    // the table runs for 'waitMs' without any output, a vector takes well below 1 ms
+    time_t deadline = time(NULL) + waitMs / 1000 + vectors / 1000 + 5;
+
+    sprintf(buf, "Xb%05d\r", size);
+    if (sendBuffer(buf)) {
+        return -1;
+    }
+    while (time(NULL) < deadline) {
+        int r = afbReadRaw(programmer, buf + pos, 1);
+        if (r <= 0) {
+            usleep(1000);
+            continue;
+        }
+        if (buf[pos] == '\r') {
+            continue;
+        }
+        if (buf[pos] != '\n' && pos < (int) sizeof(buf) - 1) {
+            pos++;
+            continue;
+        }
+        buf[pos] = 0;
+        pos = 0;
+
+        // feed request: '$' and 3 digits of the size
+        if (buf[0] == '$') {
+            int chunk = size - sendPos;
+            if (chunk > atoi(buf + 1)) {
+                chunk = atoi(buf + 1);
+            }
+            while (chunk > 0) {
+                int w = afbWriteRaw(programmer, (const char*) table + sendPos, chunk);
+                if (w < 0) {
+                    printf("ERROR: written: %i (%s)\n", w, strerror(errno));
+                    return -4;
+                }
+                sendPos += w;
+                chunk -= w;
+            }
+        } else
+        // Echo line of the script
+        if (buf[0] == '#') {
+            printf("%s\n", exerciseGetEcho(atoi(buf + 1)));
+        } else
+        // output levels differ: '!' vector index, sampled levels, expected pattern
+        if (buf[0] == '!') {
+            char levels[32] = "";
+            char expected[32] = "";
+            sscanf(buf + 1, "%*d %31s %31s", levels, expected);
+            // the power pins are not set by the vector
+            if (strlen(expected) == 20 || strlen(expected) == 24) {
+                int pins = strlen(expected);
+                expected[(pins == 20) ? 9 : 11] = 'g';
+                expected[pins - 1] = 'v';
+            }
+            printf("Mismatch: vector %d\n", stat[0] + atoi(buf + 1) + 1);
+            printf("          expected %s\n", expected);
+            printf("          got      %s\n", levels);
+        } else
+        // summary of the table
+        if (strncmp(buf, "OK vectors:", 11) == 0) {
+            int vectors = 0, time = 0, fails = 0;
+            sscanf(buf, "OK vectors:%d time:%d fail:%d", &vectors, &time, &fails);
+            if (verbose) {
+                printf("exercised %d vectors in %d ms, %d failed\n", vectors, time, fails);
+            }
+            stat[0] += vectors;
+            stat[1] += fails;
+        } else
+        if (strncmp(buf, "ER", 2) == 0) {
+            printf("%s\n", buf);
+            result = -1;
+        } else
+        if (buf[0] == '>') {
+            return result;
+        } else
+        if (buf[0] != 0 && verbose) {
+            printf("%s\n", buf);
+        }
+    }
+    printf("Error: exercise vector table timed out\n");
+    return -1;
+}
+
+// batch mode: the script is compiled into vector tables run by the MCU
+static int processExerciserBatch(int fSize) {
+    int result;
+    int i;
+    int stat[2] = {0, 0}; // vectors, mismatches
+
+    if (!(afbGetFeatures(programmer) & AFB_FEATURE_EXE_BATCH)) {
+        printf("Error: the programmer does not support the batch mode, update the firmware\n");
+        return -1;
+    }
+    result = exerciseCompileFile(galbuffer, fSize, bigRam ? EXE_TABLE_MAX : EXE_TABLE_SMALL);
+    if (result) {
+        return result;
+    }
+    if (verbose) {
+        printf("compiled into %d vector table(s)\n", exerciseGetTableCount());
+    }
+
+    result = sendGenericCommand("X1\r", "excersize failed ?", 4000, 0);
+    for (i = 0; result == 0 && i < exerciseGetTableCount(); i++) {
+        int size, waitMs, vectors;
+        const unsigned char* table = exerciseGetTable(i, &size, &waitMs, &vectors);
+        result = runExerciseTable(table, size, waitMs, vectors, stat);
+    }
+    exerciseFreeTables();
+    if (result == 0) {
+        printf("exercised %d vectors, %d mismatch(es)\n", stat[0], stat[1]);
+        if (stat[1]) {
+            result = -1;
+        }
+    }
+
+    // turn off excersize mode
+    if (sendGenericCommand("X0\r", "excersize failed ?", 4000, 0)) {
+        result = -1;
+    }
+    closeSerial();
+    return result;
+}
+
+static int processExerciser(void) {
+    int result;
+    int fSize = 0;
+    char tmp[32] = {0};
+    int pinCount;
+    int pulseDuration;
+
+    result = readFile(&fSize);
+    if (result) {
         return result;
     }
 
@@ -1579,6 +2290,9 @@ static int processExerciser(void) {
     if (result) {
         return result;
     }
+    if (flagBatch) {
+        return processExerciserBatch(fSize);
+    }
 
     // turn on excersize mode
     if (verbose) {
@@ -1605,21 +2319,617 @@ static int processExerciser(void) {
     }
 
     result = exerciseRunFile(galbuffer, fSize);
+    if (exerciseGetMismatches()) {
+        printf("%d mismatch(es)\n", exerciseGetMismatches());
+        if (result == 0) {
+            result = -1;
+        }
+    }
 
     // turn off excersize mode
-    result = sendGenericCommand("X0\r", "excersize failed ?", 4000, 0);
+    if (sendGenericCommand("X0\r", "excersize failed ?", 4000, 0)) {
+        result = -1;
+    }
 
     closeSerial();
 
     return result;
 }
 
+/* -------------------- simulation -------------------- */
+
+// most inputs of an exhaustive truth table
+#define MAX_TRUTH_INPUTS 20
+
+typedef struct {
+    GalSim sim;
+    char last[25];      // pin settings of the previous vector, for the 'x' pins
+    int clock;          // level of pin 1, -1: unknown
+    int unknown;        // outputs without a known level
+    int vectors;
+} SimContext;
+
+static SimContext simContext;
+
+// the programmer sets the pin: not the power pins and not pins 20 - 22 (16 - 18 on the 20 pin ICs)
+static int isExercisedPin(int index, int pins) {
+    if (pins == 20) {
+        return index != 9 && index != 19 && (index < 15 || index > 17);
+    }
+    return index != 11 && index != 23 && (index < 19 || index > 21);
+}
+
+// level of the pin set by the pattern character, 'phase' 1 is the middle of a pulse
+static GalSimBits getPinLevel(char c, int index, int pins, int phase) {
+    GalSimBits b = { 0, 0 };
+
+    switch (c) {
+    case '1':
+    case 'v':
+        b.val = ~0ULL;
+        break;
+    case '0':
+    case 'g':
+        break;
+    case 'p':
+        b.val = (phase == 1) ? 0 : ~0ULL;
+        break;
+    case 'P':
+        b.val = (phase == 1) ? ~0ULL : 0;
+        break;
+    default:
+        // not driven: the programmer's pull-up or a floating pin
+        if (exerciseIsReadablePin(index, pins)) {
+            b.val = ~0ULL;
+        } else {
+            b.unk = ~0ULL;
+        }
+    }
+    return b;
+}
+
+// runs one Test pattern of the script and sets the expected levels of the outputs
+static void simulateVector(char* pins, int pinCount, void* user) {
+    SimContext* c = (SimContext*) user;
+    GalSimBits ext[GALSIM_MAX_PINS];
+    char set[25];
+    int phases = 1;
+    int phase;
+    int i;
+
+    if (pinCount != c->sim.pins) {
+        return;
+    }
+    for (i = 0; i < pinCount; i++) {
+        set[i] = (pins[i] == 'x') ? c->last[i] : pins[i];
+        if (set[i] == 'p' || set[i] == 'P') {
+            phases = 3;
+        }
+    }
+    // the pulses are applied in 3 phases, like the programmer does
+    for (phase = 0; phase < phases; phase++) {
+        for (i = 0; i < pinCount; i++) {
+            ext[i] = getPinLevel(set[i], i, pinCount, phase);
+        }
+        if (c->clock == 0 && (ext[0].val & 1)) {
+            galSimClock(&c->sim);
+        }
+        c->clock = (ext[0].unk & 1) ? -1 : (int) (ext[0].val & 1);
+        galSimStep(&c->sim, ext);
+    }
+
+    for (i = 0; i < pinCount; i++) {
+        if ((pins[i] != 'z' && pins[i] != 'H' && pins[i] != 'L') ||
+            !exerciseIsReadablePin(i, pinCount) || !galSimIsOutput(&c->sim, i)) {
+            continue;
+        }
+        if ((c->sim.driven[i] & 1) && !(c->sim.level[i].unk & 1)) {
+            pins[i] = (c->sim.level[i].val & 1) ? 'H' : 'L';
+        } else {
+            // not counted when the output is known to be disabled
+            if (c->sim.level[i].unk & 1) {
+                c->unknown++;
+            }
+            pins[i] = 'z';
+        }
+    }
+    memcpy(c->last, set, sizeof(set));
+    c->vectors++;
+}
+
+// pins of the exhaustive test: the used inputs, the outputs are pulled up, other pins are kept low.
+// Returns the number of inputs, -1 if there are too many.
+static int setupSimInputs(GalSim* s, int* inputs, char* pattern, GalSimBits* ext) {
+    int inputCount = 0;
+    int i;
+
+    for (i = 0; i < s->pins; i++) {
+        ext[i] = getPinLevel('z', i, s->pins, 0);
+        if (!isExercisedPin(i, s->pins)) {
+            pattern[i] = 'z';
+        } else if (galSimIsOutput(s, i)) {
+            pattern[i] = 'z';
+        } else {
+            // unused inputs are kept low
+            pattern[i] = '0';
+            ext[i].val = 0;
+            ext[i].unk = 0;
+            if (galSimIsInputUsed(s, i)) {
+                inputs[inputCount++] = i;
+            }
+        }
+    }
+    pattern[(s->pins == 20) ? 9 : 11] = 'g';
+    pattern[s->pins - 1] = 'v';
+    pattern[s->pins] = 0;
+    if (inputCount > MAX_TRUTH_INPUTS) {
+        printf("Error: too many inputs: %d (max %d)\n", inputCount, MAX_TRUTH_INPUTS);
+        return -1;
+    }
+    return inputCount;
+}
+
+// writes the script with all combinations of the used inputs, 64 vectors are simulated at once
+static int writeTruthTable(GalSim* s, FILE* out) {
+    GalSimBits ext[GALSIM_MAX_PINS];
+    int inputs[GALSIM_MAX_PINS];
+    int inputCount;
+    char pattern[GALSIM_MAX_PINS + 1];
+    long total;
+    long base;
+    int i;
+
+    if (galSimHasRegisters(s)) {
+        printf("Error: the design has registered outputs, use -sim with a test script\n");
+        return -1;
+    }
+    inputCount = setupSimInputs(s, inputs, pattern, ext);
+    if (inputCount < 0) {
+        return -1;
+    }
+
+    fprintf(out, "# truth table of %s (%s, %s mode)\n", filename, afbGalInfo[s->gal].name, s->modeName);
+    fprintf(out, "PinCount %d\n", s->pins);
+    fprintf(out, "DefaultDelay 0\n");
+
+    total = 1L << inputCount;
+    for (base = 0; base < total; base += 64) {
+        int lanes = (total - base < 64) ? (int) (total - base) : 64;
+        int lane;
+
+        // input 0 is the most significant bit of the vector number
+        for (i = 0; i < inputCount; i++) {
+            uint64_t v = 0;
+            for (lane = 0; lane < lanes; lane++) {
+                if (((base + lane) >> (inputCount - 1 - i)) & 1) {
+                    v |= 1ULL << lane;
+                }
+            }
+            ext[inputs[i]].val = v;
+        }
+        galSimStep(s, ext);
+
+        for (lane = 0; lane < lanes; lane++) {
+            for (i = 0; i < inputCount; i++) {
+                pattern[inputs[i]] = ((ext[inputs[i]].val >> lane) & 1) ? '1' : '0';
+            }
+            for (i = 0; i < s->pins; i++) {
+                if (pattern[i] != 'z' && pattern[i] != 'H' && pattern[i] != 'L') {
+                    continue;
+                }
+                if (exerciseIsReadablePin(i, s->pins) && galSimIsOutput(s, i) &&
+                    ((s->driven[i] >> lane) & 1) && !((s->level[i].unk >> lane) & 1)) {
+                    pattern[i] = ((s->level[i].val >> lane) & 1) ? 'H' : 'L';
+                } else {
+                    pattern[i] = 'z';
+                }
+            }
+            fprintf(out, "Test %s\n", pattern);
+        }
+    }
+    simContext.vectors = (int) total;
+    return 0;
+}
+
+// simulates the .jed file and writes the exerciser script with the expected output levels
+static int processSimulate(void) {
+    SimContext* c = &simContext;
+    FILE* out = stdout;
+    long start;
+    int result;
+
+    if (parseFuseMap()) {
+        return -1;
+    }
+    if (galSimInit(&c->sim, gal, &design.jedec) != GALSIM_OK) {
+        printf("Error: simulation of %s or its mode is not supported\n", afbGalInfo[gal].name);
+        return -1;
+    }
+    if (verbose) {
+        printf("simulating %s in %s mode\n", afbGalInfo[gal].name, c->sim.modeName);
+    }
+    c->clock = -1;
+    c->unknown = 0;
+    c->vectors = 0;
+    memset(c->last, 'z', sizeof(c->last));
+
+    if (simFilename != NULL) {
+        char* jedName = filename;
+        int fSize = 0;
+
+        // the test script is read into the gal buffer
+        filename = simFilename;
+        result = readFile(&fSize);
+        filename = jedName;
+        if (result) {
+            return result;
+        }
+        if (exerciseCheckFile(galbuffer, fSize)) {
+            return -1;
+        }
+    }
+
+    if (outFilename != NULL) {
+        out = fopen(outFilename, "w");
+        if (out == NULL) {
+            printf("Error: failed to create file: %s\n", outFilename);
+            return -1;
+        }
+    }
+    start = afbTimeMs();
+    if (simFilename != NULL) {
+        result = exerciseRewriteFile(galbuffer, strlen(galbuffer), out, simulateVector, c);
+    } else {
+        result = writeTruthTable(&c->sim, out);
+    }
+    if (out != stdout) {
+        fclose(out);
+        if (result == 0) {
+            printf("simulated %d vectors in %ld ms", c->vectors, afbTimeMs() - start);
+            if (c->unknown) {
+                printf(", %d output level(s) unknown", c->unknown);
+            }
+            printf("\n");
+        }
+    }
+    return result;
+}
+
+// Expected result of the 'Xs' signature test: the inputs follow the Gray code (input 0 is
+// bit 0), after each vector the sampled levels (bit N is pin N + 1) are folded into the MISR.
+static int computeSignature(GalSim* s, int* inputs, int inputCount, uint32_t outputs, uint32_t* signature) {
+    GalSimBits ext[GALSIM_MAX_PINS];
+    char pattern[GALSIM_MAX_PINS + 1];
+    uint32_t sig = 0;
+    long total = 1L << inputCount;
+    long base;
+    int i;
+
+    setupSimInputs(s, inputs, pattern, ext);
+    for (base = 0; base < total; base += 64) {
+        int lanes = (total - base < 64) ? (int) (total - base) : 64;
+        int lane;
+
+        for (i = 0; i < inputCount; i++) {
+            uint64_t v = 0;
+            for (lane = 0; lane < lanes; lane++) {
+                long k = base + lane;
+                if (((k ^ (k >> 1)) >> i) & 1) {
+                    v |= 1ULL << lane;
+                }
+            }
+            ext[inputs[i]].val = v;
+        }
+        galSimStep(s, ext);
+
+        for (lane = 0; lane < lanes; lane++) {
+            uint32_t levels = 0;
+            for (i = 0; i < s->pins; i++) {
+                if (!(outputs & (1UL << i))) {
+                    continue;
+                }
+                if ((s->level[i].unk >> lane) & 1) {
+                    printf("Error: unknown level of pin %d in vector %ld\n", i + 1, base + lane);
+                    return -1;
+                }
+                if ((s->level[i].val >> lane) & 1) {
+                    levels |= 1UL << i;
+                }
+            }
+            sig = ((sig << 1) ^ ((sig & 0x80000000UL) ? EXE_MISR_POLY : 0)) ^ levels;
+        }
+    }
+    *signature = sig;
+    return 0;
+}
+
+// runs all input combinations of a combinatorial design on the programmer and compares
+// the signature of the outputs with the simulation
+static int processSignature(void) {
+    GalSim* s = &simContext.sim;
+    GalSimBits ext[GALSIM_MAX_PINS];
+    int inputs[GALSIM_MAX_PINS];
+    char pattern[GALSIM_MAX_PINS + 1];
+    char cmd[32];
+    const char* response;
+    int inputCount;
+    uint32_t inputMask = 0;
+    uint32_t outputMask = 0;
+    uint32_t expected;
+    unsigned int got = 0;
+    long vectors = 0;
+    long start;
+    int result;
+    int i;
+
+    if (parseFuseMap()) {
+        return -1;
+    }
+    if (galSimInit(s, gal, &design.jedec) != GALSIM_OK) {
+        printf("Error: simulation of %s or its mode is not supported\n", afbGalInfo[gal].name);
+        return -1;
+    }
+    if (galSimHasRegisters(s)) {
+        printf("Error: the design has registered outputs, use 'g' and 'x' commands with a test script\n");
+        return -1;
+    }
+    inputCount = setupSimInputs(s, inputs, pattern, ext);
+    if (inputCount < 0) {
+        return -1;
+    }
+    if (inputCount == 0) {
+        printf("Error: the design has no used inputs\n");
+        return -1;
+    }
+    for (i = 0; i < inputCount; i++) {
+        inputMask |= 1UL << inputs[i];
+    }
+    for (i = 0; i < s->pins; i++) {
+        if (exerciseIsReadablePin(i, s->pins) && galSimIsOutput(s, i)) {
+            outputMask |= 1UL << i;
+        }
+    }
+    if (computeSignature(s, inputs, inputCount, outputMask, &expected)) {
+        return -1;
+    }
+
+    if (openSerial() != 0) {
+        return -1;
+    }
+    if (!(afbGetFeatures(programmer) & AFB_FEATURE_EXE_SIG)) {
+        printf("Error: the programmer does not support the signature test, update the firmware\n");
+        closeSerial();
+        return -1;
+    }
+    result = sendGenericCommand("X1\r", "excersize failed ?", 4000, 0);
+    if (result == 0) {
+        sprintf(cmd, "Xs%02d%06X%06X\r", s->pins, inputMask, outputMask);
+        start = afbTimeMs();
+        // about 20 vectors per ms on AVR
+        result = sendGenericCommand(cmd, "signature test failed ?", 4000 + (1 << inputCount) / 16, 0);
+    }
+    if (result == 0) {
+        response = strstr(afbGetResponse(programmer), "OK vectors:");
+        if (response == NULL || sscanf(response, "OK vectors:%ld signature:%x", &vectors, &got) != 2) {
+            printf("Error: unexpected response of the signature test\n");
+            result = -1;
+        } else if (verbose) {
+            printf("tested %ld vectors in %ld ms\n", vectors, afbTimeMs() - start);
+        }
+    }
+
+    // turn off excersize mode
+    if (sendGenericCommand("X0\r", "excersize failed ?", 4000, 0)) {
+        result = -1;
+    }
+    closeSerial();
+    if (result) {
+        return result;
+    }
+    printf("signature of %ld vectors: expected %08X got %08X %s\n", vectors, expected, got,
+        (got == expected) ? "PASS" : "FAIL");
+    return (got == expected) ? 0 : -1;
+}
+
+/* -------------------- watch mode -------------------- */
+
+static AfbDesign lastDesign;        // the design written into the GAL
+static char lastDesignValid = 0;
+
+#ifdef __linux__
+static int watchFd = -1;
+static const char* watchName;
+
+// The directory is watched: editors and compilers often replace the file instead of rewriting it.
+static int watchStart(void) {
+    char dir[1024];
+    const char* slash = strrchr(filename, '/');
+
+    if (slash == NULL) {
+        strcpy(dir, ".");
+        watchName = filename;
+    } else {
+        int len = (slash == filename) ? 1 : slash - filename;
+        snprintf(dir, sizeof(dir), "%.*s", len, filename);
+        watchName = slash + 1;
+    }
+    watchFd = inotify_init();
+    if (watchFd < 0 || inotify_add_watch(watchFd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        printf("Error: failed to watch directory %s (%s)\n", dir, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// waits until the file is written and no other write follows within 200 ms
+static int watchWait(void) {
+    char changed = 0;
+
+    for (;;) {
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        struct pollfd p = {watchFd, POLLIN, 0};
+        int size, i;
+        int r = poll(&p, 1, changed ? 200 : -1);
+
+        if (r == 0) {
+            return 0;
+        }
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        size = read(watchFd, buf, sizeof(buf));
+        if (size <= 0) {
+            return -1;
+        }
+        for (i = 0; i < size; ) {
+            struct inotify_event* e = (struct inotify_event*) (buf + i);
+            if (e->len && strcmp(e->name, watchName) == 0) {
+                changed = 1;
+            }
+            i += sizeof(struct inotify_event) + e->len;
+        }
+    }
+}
+#else
+static struct stat watchStat;
+
+static int watchStart(void) {
+    if (stat(filename, &watchStat) != 0) {
+        printf("Error: failed to watch file %s\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+// polls the modification time and the size of the file until it changes and stays unchanged for 250 ms
+static int watchWait(void) {
+    char changed = 0;
+
+    for (;;) {
+        struct stat st;
+        usleep(250 * 1000);
+        if (stat(filename, &st) != 0) {
+            continue;
+        }
+        if (st.st_mtime != watchStat.st_mtime || st.st_size != watchStat.st_size) {
+            watchStat = st;
+            changed = 1;
+        } else if (changed) {
+            return 0;
+        }
+    }
+}
+#endif
+
+// Prints the fuse rows (JEDEC lines of the AND array) that differ between the designs.
+// Returns the number of changed fuses.
+static int printDesignChanges(const AfbDesign* a, const AfbDesign* b) {
+    int rowSize = afbGalInfo[gal].rows;
+    int arrayFuses = rowSize * afbGalInfo[gal].bits;
+    int total = afbGalInfo[gal].fuses + 1; // +1: power-down fuse
+    int lastRow = -1;
+    int changed = 0;
+    int other = 0;
+    int i;
+
+    for (i = 0; i < total; i++) {
+        if (jedecGetFuse(&a->jedec, i) == jedecGetFuse(&b->jedec, i)) {
+            continue;
+        }
+        changed++;
+        if (i >= arrayFuses) {
+            other++;
+        } else if (i / rowSize != lastRow) {
+            if (lastRow < 0) {
+                printf("changed rows:");
+            }
+            lastRow = i / rowSize;
+            printf(" %d", lastRow);
+        }
+    }
+    if (lastRow >= 0) {
+        printf("\n");
+    }
+    if (other) {
+        printf("changed config / UES fuses: %d\n", other);
+    }
+    return changed;
+}
+
+// Keeps the programmer open and reprograms the GAL each time the .jed file changes.
+// 'result' is the result of the initial write.
+static char processWatch(char result) {
+    if (0 == result) {
+        lastDesign = design;
+        lastDesignValid = 1;
+    }
+    for (;;) {
+        // the timing of the last update
+        if (flagTiming) {
+            printTiming();
+            afbClearTimings(programmer);
+        }
+        printf("watching %s (Ctrl+C to quit)\n", filename);
+        if (watchWait()) {
+            printf("Error: failed to watch the file\n");
+            return -1;
+        }
+        if (parseFuseMap()) {
+            continue;
+        }
+        if (lastDesignValid && 0 == printDesignChanges(&lastDesign, &design)) {
+            printf("no fuse changes, the GAL is not reprogrammed\n");
+            continue;
+        }
+
+        // erase, write and verify
+        opVerify = 1;
+        result = operationSetGalCheck();
+        if (0 == result) {
+            result = operationSetGalType(gal);
+        }
+        if (0 == result || noGalCheck) {
+            result = operationEraseGal();
+        }
+        if (0 == result || noGalCheck) {
+            result = writeDesign(1);
+        }
+        if (0 == result && opSecureGal) {
+            operationSecureGal();
+        }
+
+        lastDesignValid = (0 == result);
+        if (lastDesignValid) {
+            lastDesign = design;
+            printf("GAL updated\n");
+        } else {
+            // the programmer is identified again before the next write
+            afbClose(programmer);
+            printf("Error: GAL update failed\n");
+        }
+    }
+}
+
 int main(int argc, char** argv) {
     char result = 0;
     int i;
 
+    // the texts printed while the arguments are checked go to stderr as well
+    for (i = 1; i < argc; i++) {
+        if (strcmp("-json", argv[i]) == 0) {
+            startJson();
+            break;
+        }
+    }
+
     result = checkArgs(argc, argv);
     if (result) {
+        if (flagJson) {
+            printJsonResult(result);
+        }
         return result;
     }
     if (verbose) {
@@ -1627,59 +2937,84 @@ int main(int argc, char** argv) {
         printf("gal=%d \n", gal);
     }
 
+    // the simulation does not use the programmer
+    if (opSimulate) {
+        result = RUN_PHASE("simulate", processSimulate());
+        goto finish;
+    }
+
     // process JTAG operations
-    if (gal != 0 && galinfo[gal].id0 == JTAG_ID && galinfo[gal].id1 == JTAG_ID) {
-        result = processJtag();
+    if (gal != 0 && afbGalInfo[gal].id0 == AFB_JTAG_ID && afbGalInfo[gal].id1 == AFB_JTAG_ID) {
+        result = RUN_PHASE("jtag", processJtag());
+        goto finish;
+    }
+
+    if (flagWatch && watchStart()) {
+        result = -1;
         goto finish;
     }
 
-    result = operationSetGalCheck();
+    result = RUN_PHASE("check", operationSetGalCheck());
 
-    if (gal != UNKNOWN && 0 == result) {
-        result = operationSetGalType(gal);
+    if (gal != AFB_GAL_UNKNOWN && 0 == result) {
+        result = RUN_PHASE("type", operationSetGalType(gal));
     }
 
     if (opErase && (0 == result || noGalCheck)) {
-        result = operationEraseGal();
+        result = RUN_PHASE("erase", operationEraseGal());
     }
 
     if (0 == result || noGalCheck) {
         if (opWrite) {
             // writing fuses and optionally verification
-            result = operationWriteOrVerify(1);
+            result = RUN_PHASE(opVerify ? "write+verify" : "write", operationWriteOrVerify(1));
         } else if (opInfo) {
-            result = operationReadInfo();
+            result = RUN_PHASE("info", operationReadInfo());
         } else if (opRead) {
-            result = operationReadFuses();
+            result = RUN_PHASE("read", operationReadFuses());
         } else if (opVerify) {
             // verification without writing
-            result = operationWriteOrVerify(0);
+            result = RUN_PHASE("verify", operationWriteOrVerify(0));
         } else if (opTestVPP) {
-            result = operationTestVpp();
+            result = RUN_PHASE("test-vpp", operationTestVpp());
         } else if (opWritePes) {
-            result = operationWritePes();
+            result = RUN_PHASE("write-pes", operationWritePes());
         } else if (opExercise) {
-            result = processExerciser();
+            result = RUN_PHASE("exercise", processExerciser());
+        } else if (opFuncTest) {
+            result = RUN_PHASE("signature", processSignature());
         }
         if (0 == result && (opWrite || opVerify)) {
             if (opSecureGal) {
-                operationSecureGal();
+                RUN_PHASE("secure", operationSecureGal());
             }
         }
         //variable VPP functions (for new board designs)
         if (varVppExists) {
             if (0 == result && opCalibrateVPP) {
-                result = operationCalibrateVpp();
+                result = RUN_PHASE("calibrate-vpp", operationCalibrateVpp());
             }
             if (0 == result && opMeasureVPP) {
-                result = operationMeasureVpp();
+                result = RUN_PHASE("measure-vpp", operationMeasureVpp());
             }
         }
     }
+    if (flagWatch) {
+        result = processWatch(result);
+    }
 
 finish:
     if (verbose) {
         printf("result=%i\n", (char)result);
     }
+    if (flagTiming) {
+        printTiming();
+    }
+    if (vppLogFilename != NULL) {
+        writeVppLog();
+    }
+    if (flagJson) {
+        printJsonResult(result);
+    }
     return result;
 }
@@ -0,0 +1,854 @@
+/*
+
+ AFTERBURNERD : programmer daemon with a local job socket
+
+ part of Afterburner GAL project
+
+ The daemon keeps the serial port open and the programmer identified, then
+ runs the jobs received over a Unix domain socket. Back to back jobs pay
+ only for the time spent by the programmer.
+
+ Start:  ./afterburnerd [-d /dev/ttyUSB0] [-s /tmp/afterburner.sock] [-v]
+
+ Requests and responses are JSON objects, one per line. A job:
+
+   {"id":1, "type":"GAL22V10", "ops":"ewv", "file":"/path/design.jed"}
+
+   id    : optional, copied into the job's events (number or string)
+   type  : GAL type name, as for the -t option of afterburner
+   ops   : operations: e (erase), w (write), v (verify), r (read), i (info),
+           p (write PES), the same combinations as afterburner accepts
+   file  : path of the .jed file (read by the daemon) or
+   jedec : contents of the .jed file
+   nc    : true - skip the GAL type check (-nc)
+   all   : true - erase all (-all)
+   sec   : true - set the security fuse after write / verify (-sec)
+   pes   : PES string for the 'p' operation (-pes)
+
+ The job's events:
+
+   {"id":1,"event":"queued","position":0}
+   {"id":1,"event":"progress","stage":"w","current":1200,"total":5892}
+   {"id":1,"event":"output","text":"..."}
+   {"id":1,"event":"done","result":0,"status":0,"error":"OK"}
+
+   status: code of the programmer's error response (see AFB_STATUS_xxx)
+
+ Other requests:
+
+   {"cmd":"status"}  ->  {"event":"status","open":true,"version":"...","features":3,"queue":0}
+
+ The "file" path is relative to the daemon's working directory.
+ Try it with: socat - UNIX-CONNECT:/tmp/afterburner.sock
+
+*/
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "libafterburner.h"
+
+// SIGPIPE is ignored anyway (OSX has no MSG_NOSIGNAL)
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define DEFAULT_SOCKET_NAME "/tmp/afterburner.sock"
+
+#define MAX_CLIENTS 16
+#define MAX_REQUEST (4 * 1024 * 1024)
+#define MAX_PENDING (4 * 1024 * 1024)  // unsent output of a client that does not read it
+#define MAX_ID 64
+#define MAX_STAGES 8
+
+typedef struct Job {
+    struct Job* next;
+    int client;                 // index of the client, -1: the client disconnected
+    char id[MAX_ID];            // raw JSON value of "id", empty: none
+    AfbGalType gal;
+    char noGalCheck;
+    char eraseAll;
+    char verify;                // verify after write
+    char pes[64];
+    AfbDesign* design;          // NULL when no .jed is needed
+    char stages[MAX_STAGES + 1];// operations in the execution order
+    int stage;                  // index of the running operation
+} Job;
+
+typedef struct {
+    int fd;                     // -1: free slot
+    char* buf;
+    int len;
+    int size;
+    char* out;                  // output not accepted by the socket yet, sent on POLLOUT
+    int outLen;
+    int outSize;
+    char drop;                  // the client is closed by the main loop
+} Client;
+
+static char verbose = 0;
+static char* deviceName = NULL;
+static char* socketName = DEFAULT_SOCKET_NAME;
+static volatile sig_atomic_t quit = 0;
+
+static AfbProgrammer* programmer = NULL;
+static Client clients[MAX_CLIENTS];
+static Job* queue = NULL;       // waiting jobs, the first is running when 'running' is set
+static char running = 0;
+
+/* -------------------- JSON -------------------- */
+
+static const char* skipSpaces(const char* s) {
+    while (isspace((unsigned char) *s)) {
+        s++;
+    }
+    return s;
+}
+
+// returns the position after a JSON string, NULL when the string is not terminated
+static const char* skipString(const char* s) {
+    for (s++; *s != '"'; s++) {
+        if (*s == 0) {
+            return NULL;
+        }
+        if (*s == '\\' && s[1] != 0) {
+            s++;
+        }
+    }
+    return s + 1;
+}
+
+// returns the position after a JSON value, NULL on error
+static const char* skipValue(const char* s) {
+    int depth = 0;
+
+    do {
+        if (*s == '"') {
+            s = skipString(s);
+            if (s == NULL) {
+                return NULL;
+            }
+            continue;
+        }
+        if (*s == 0) {
+            return NULL;
+        }
+        if (*s == '{' || *s == '[') {
+            depth++;
+        } else if (*s == '}' || *s == ']') {
+            depth--;
+        }
+        s++;
+    } while (depth > 0 || (*s != 0 && strchr(",}] \t\r\n", *s) == NULL));
+    return s;
+}
+
+// finds the value of a top level key of the JSON object, returns NULL when not found
+static const char* jsonFind(const char* obj, const char* key) {
+    int keyLen = strlen(key);
+    const char* s = skipSpaces(obj);
+
+    if (*s++ != '{') {
+        return NULL;
+    }
+    for (;;) {
+        const char* name;
+        const char* end;
+
+        s = skipSpaces(s);
+        if (*s != '"') {
+            return NULL;
+        }
+        name = s + 1;
+        end = skipString(s);
+        if (end == NULL) {
+            return NULL;
+        }
+        s = skipSpaces(end);
+        if (*s++ != ':') {
+            return NULL;
+        }
+        s = skipSpaces(s);
+        if (end - 1 - name == keyLen && strncmp(name, key, keyLen) == 0) {
+            return s;
+        }
+        s = skipValue(s);
+        if (s == NULL) {
+            return NULL;
+        }
+        s = skipSpaces(s);
+        if (*s++ != ',') {
+            return NULL;
+        }
+    }
+}
+
+// Returns the unescaped string value of the key (allocated), NULL when the key is missing
+// or is not a string. \uXXXX escapes are limited to 8 bit characters.
+static char* jsonString(const char* obj, const char* key) {
+    const char* s = jsonFind(obj, key);
+    const char* end;
+    char* result;
+    char* d;
+
+    if (s == NULL || *s != '"' || (end = skipString(s)) == NULL) {
+        return NULL;
+    }
+    result = (char*) malloc(end - s);
+    if (result == NULL) {
+        return NULL;
+    }
+    for (d = result, s++; s < end - 1; s++) {
+        if (*s != '\\') {
+            *d++ = *s;
+            continue;
+        }
+        switch (*++s) {
+        case 'n': *d++ = '\n'; break;
+        case 'r': *d++ = '\r'; break;
+        case 't': *d++ = '\t'; break;
+        case 'b': *d++ = '\b'; break;
+        case 'f': *d++ = '\f'; break;
+        case 'u':
+            if (end - 1 - s > 4) {
+                char hex[5] = {0};
+                memcpy(hex, s + 1, 4);
+                *d++ = (char) strtol(hex, NULL, 16);
+                s += 4;
+            }
+            break;
+        default: *d++ = *s;
+        }
+    }
+    *d = 0;
+    return result;
+}
+
+static char jsonBool(const char* obj, const char* key) {
+    const char* s = jsonFind(obj, key);
+    return (s != NULL && strncmp(s, "true", 4) == 0) ? 1 : 0;
+}
+
+// writes the text as a JSON string into the buffer
+static int jsonEscape(char* buf, int size, const char* text) {
+    int pos = 0;
+
+    buf[pos++] = '"';
+    for (; *text && pos < size - 8; text++) {
+        unsigned char c = (unsigned char) *text;
+        if (c == '"' || c == '\\') {
+            buf[pos++] = '\\';
+            buf[pos++] = c;
+        } else if (c == '\n') {
+            buf[pos++] = '\\';
+            buf[pos++] = 'n';
+        } else if (c == '\r') {
+            buf[pos++] = '\\';
+            buf[pos++] = 'r';
+        } else if (c < 0x20 || c >= 0x7F) {
+            pos += sprintf(buf + pos, "\\u%04x", c);
+        } else {
+            buf[pos++] = c;
+        }
+    }
+    buf[pos++] = '"';
+    buf[pos] = 0;
+    return pos;
+}
+
+/* -------------------- clients -------------------- */
+
+// sends the pending output without blocking, the rest waits for POLLOUT
+static void flushClient(int client) {
+    Client* c = &clients[client];
+    int pos = 0;
+
+    while (pos < c->outLen) {
+        int size = send(c->fd, c->out + pos, c->outLen - pos, MSG_NOSIGNAL);
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                // the client is gone
+                c->drop = 1;
+                pos = c->outLen;
+            }
+            break;
+        }
+        pos += size;
+    }
+    c->outLen -= pos;
+    memmove(c->out, c->out + pos, c->outLen);
+}
+
+// queues the line to the client's output, a client that does not read its output
+// is dropped rather than stalling the other clients and the programmer
+static void sendLine(int client, const char* line) {
+    Client* c;
+    int total = strlen(line);
+
+    if (client < 0 || clients[client].fd < 0 || clients[client].drop) {
+        return;
+    }
+    c = &clients[client];
+    if (c->outLen + total > c->outSize) {
+        int newSize = c->outSize ? c->outSize : 16 * 1024;
+        char* out;
+
+        while (newSize < c->outLen + total) {
+            newSize *= 2;
+        }
+        out = (newSize <= MAX_PENDING) ? (char*) realloc(c->out, newSize) : NULL;
+        if (out == NULL) {
+            if (verbose) {
+                printf("client %d does not read its output\n", client);
+            }
+            c->drop = 1;
+            return;
+        }
+        c->out = out;
+        c->outSize = newSize;
+    }
+    memcpy(c->out + c->outLen, line, total);
+    c->outLen += total;
+    flushClient(client);
+}
+
+// sends an event of the job: 'fields' are the JSON members after "event"
+static void sendEvent(const Job* job, const char* event, const char* fields) {
+    char* buf;
+    int size = strlen(fields) + MAX_ID + 64;
+
+    if (job->client < 0) {
+        return;
+    }
+    buf = (char*) malloc(size);
+    if (buf == NULL) {
+        return;
+    }
+    if (job->id[0]) {
+        snprintf(buf, size, "{\"id\":%s,\"event\":\"%s\"%s}\n", job->id, event, fields);
+    } else {
+        snprintf(buf, size, "{\"event\":\"%s\"%s}\n", event, fields);
+    }
+    sendLine(job->client, buf);
+    free(buf);
+}
+
+// 'status' is the AFB_STATUS_xxx code of the programmer's error response
+static void sendDone(const Job* job, AfbResult result, int status, const char* error) {
+    char buf[512];
+    int pos = sprintf(buf, ",\"result\":%d,\"status\":%d,\"error\":", (int) result, status);
+
+    jsonEscape(buf + pos, sizeof(buf) - pos, error);
+    sendEvent(job, "done", buf);
+    if (verbose) {
+        printf("job %s finished: %s\n", job->id, error);
+    }
+}
+
+static void freeJob(Job* job) {
+    free(job->design);
+    free(job);
+}
+
+static void closeClient(int client) {
+    Job** j = &queue;
+
+    if (verbose) {
+        printf("client %d disconnected\n", client);
+    }
+    close(clients[client].fd);
+    clients[client].fd = -1;
+    free(clients[client].buf);
+    clients[client].buf = NULL;
+    clients[client].len = 0;
+    clients[client].size = 0;
+    free(clients[client].out);
+    clients[client].out = NULL;
+    clients[client].outLen = 0;
+    clients[client].outSize = 0;
+    clients[client].drop = 0;
+
+    // the waiting jobs are dropped, the running job has to finish
+    while (*j != NULL) {
+        Job* job = *j;
+        if (job->client == client) {
+            if (job == queue && running) {
+                job->client = -1;
+            } else {
+                *j = job->next;
+                freeJob(job);
+                continue;
+            }
+        }
+        j = &job->next;
+    }
+}
+
+/* -------------------- programmer callbacks -------------------- */
+
+static void onProgress(void* user, const char* label, int current, int total) {
+    char buf[128];
+
+    if (running) {
+        sprintf(buf, ",\"stage\":\"%c\",\"current\":%d,\"total\":%d", queue->stages[queue->stage], current, total);
+        sendEvent(queue, "progress", buf);
+    }
+}
+
+static void onOutput(void* user, const char* text) {
+    if (running) {
+        int size = strlen(text) * 6 + 32;
+        char* buf = (char*) malloc(size);
+        if (buf != NULL) {
+            int pos = sprintf(buf, ",\"text\":");
+            jsonEscape(buf + pos, size - pos, text);
+            sendEvent(queue, "output", buf);
+            free(buf);
+        }
+    } else if (verbose) {
+        printf("%s", text);
+    }
+}
+
+/* -------------------- jobs -------------------- */
+
+static AfbGalType findGalType(const char* name) {
+    int i;
+    for (i = 1; i < afbGalInfoCount; i++) {
+        if (strcmp(name, afbGalInfo[i].name) == 0) {
+            return afbGalInfo[i].type;
+        }
+    }
+    return AFB_GAL_UNKNOWN;
+}
+
+// Fills the job from the request. The operations are ordered the same way
+// the afterburner command line tool runs them. Returns an error text or NULL.
+static const char* parseJob(Job* job, const char* request) {
+    char* type = jsonString(request, "type");
+    char* ops = jsonString(request, "ops");
+    char* pes = jsonString(request, "pes");
+    char* file = jsonString(request, "file");
+    char* jedec = NULL;
+    const char* error = NULL;
+    AfbResult result;
+    const char* id = jsonFind(request, "id");
+    char opWrite, opVerify, opRead, opErase, opInfo, opWritePes, sec;
+    int n = 0;
+
+    if (id != NULL) {
+        const char* end = skipValue(id);
+        if (end != NULL && end - id < MAX_ID) {
+            memcpy(job->id, id, end - id);
+            job->id[end - id] = 0;
+        }
+    }
+    if (type == NULL || (job->gal = findGalType(type)) == AFB_GAL_UNKNOWN) {
+        error = "unknown GAL type";
+        goto finish;
+    }
+    if (afbGalInfo[job->gal].id0 == AFB_JTAG_ID) {
+        error = "JTAG devices are not supported by the daemon";
+        goto finish;
+    }
+    if (ops == NULL || strspn(ops, "ewvrip") != strlen(ops) || ops[0] == 0) {
+        error = "invalid operations";
+        goto finish;
+    }
+    opWrite = strchr(ops, 'w') != NULL;
+    opVerify = strchr(ops, 'v') != NULL;
+    opRead = strchr(ops, 'r') != NULL;
+    opErase = strchr(ops, 'e') != NULL;
+    opInfo = strchr(ops, 'i') != NULL;
+    opWritePes = strchr(ops, 'p') != NULL;
+    sec = jsonBool(request, "sec");
+    job->noGalCheck = jsonBool(request, "nc");
+    job->eraseAll = jsonBool(request, "all");
+    job->verify = opVerify;
+
+    if (opWrite || (opVerify && !opInfo && !opRead)) {
+        if (file == NULL && (jedec = jsonString(request, "jedec")) == NULL) {
+            error = "missing .jed file";
+            goto finish;
+        }
+        job->design = (AfbDesign*) malloc(sizeof(AfbDesign));
+        if (job->design == NULL) {
+            error = afbGetResultText(AFB_ERR_MEMORY);
+            goto finish;
+        }
+        if (file != NULL) {
+            result = afbDesignLoadFile(job->design, job->gal, file);
+        } else {
+            result = afbDesignLoadBuffer(job->design, job->gal, jedec, strlen(jedec));
+        }
+        if (result != AFB_OK) {
+            error = afbGetResultText(result);
+            goto finish;
+        }
+    }
+    if (opWritePes) {
+        if (pes == NULL || strlen(pes) >= sizeof(job->pes)) {
+            error = "missing or invalid PES";
+            goto finish;
+        }
+        strcpy(job->pes, pes);
+    }
+
+    job->stages[n++] = 'f';     // GAL check on / off
+    job->stages[n++] = 'g';     // GAL type
+    if (opErase) {
+        job->stages[n++] = 'e';
+    }
+    if (opWrite) {
+        job->stages[n++] = 'w'; // includes verify
+    } else if (opInfo) {
+        job->stages[n++] = 'i';
+    } else if (opRead) {
+        job->stages[n++] = 'r';
+    } else if (opVerify) {
+        job->stages[n++] = 'v';
+    } else if (opWritePes) {
+        job->stages[n++] = 'p';
+    }
+    if (sec && (opWrite || opVerify)) {
+        job->stages[n++] = 's';
+    }
+    job->stages[n] = 0;
+
+finish:
+    free(type);
+    free(ops);
+    free(pes);
+    free(file);
+    free(jedec);
+    return error;
+}
+
+static AfbResult startStage(Job* job) {
+    switch (job->stages[job->stage]) {
+    case 'f': return afbSetGalCheckStart(programmer, !job->noGalCheck);
+    case 'g': return afbSetGalTypeStart(programmer, job->gal);
+    case 'e': return afbEraseStart(programmer, job->gal, job->eraseAll);
+    case 'w': return afbWriteStart(programmer, job->design, 1, job->verify);
+    case 'v': return afbWriteStart(programmer, job->design, 0, 1);
+    case 'i': return afbInfoStart(programmer);
+    case 'r': return afbReadStart(programmer, job->gal);
+    case 'p': return afbWritePesStart(programmer, job->gal, job->pes);
+    case 's': return afbCommandStart(programmer, "s\r", 4000, AFB_CMD_CHECK);
+    }
+    return AFB_ERR_ARGS;
+}
+
+static void finishJob(AfbResult result, const char* error) {
+    Job* job = queue;
+    int status = (result == AFB_ERR_DEVICE) ? afbGetStatus(programmer) : AFB_STATUS_NONE;
+
+    // the programmer's error text is more specific
+    if (status != AFB_STATUS_NONE) {
+        error = afbGetStatusText(programmer);
+    }
+    sendDone(job, result, status, error);
+    queue = job->next;
+    running = 0;
+    freeJob(job);
+}
+
+// starts the next stage of the running job or finishes the job
+static void nextStage(AfbResult result) {
+    Job* job = queue;
+    char stage = job->stages[job->stage];
+
+    // the same as the command line tool: check and erase failures are ignored with -nc
+    if (result != AFB_OK && !(job->noGalCheck && (stage == 'f' || stage == 'g' || stage == 'e'))) {
+        if (result == AFB_ERR_IO) {
+            // re-open and identify the programmer on the next job
+            afbClose(programmer);
+        }
+        finishJob(result, afbGetResultText(result));
+        return;
+    }
+    job->stage++;
+    if (job->stages[job->stage] == 0) {
+        finishJob(AFB_OK, afbGetResultText(AFB_OK));
+        return;
+    }
+    result = startStage(job);
+    if (result != AFB_PENDING) {
+        nextStage(result);
+    }
+}
+
+static void startJob(void) {
+    Job* job = queue;
+    AfbResult result;
+
+    running = 1;
+    job->stage = 0;
+    if (verbose) {
+        printf("job %s started: %s\n", job->id, job->stages);
+    }
+    if (!afbIsOpen(programmer)) {
+        result = afbOpen(programmer, deviceName);
+        if (result != AFB_OK) {
+            finishJob(result, afbGetResultText(result));
+            return;
+        }
+    }
+    result = startStage(job);
+    if (result != AFB_PENDING) {
+        nextStage(result);
+    }
+}
+
+static void addJob(int client, const char* request) {
+    Job* job = (Job*) calloc(1, sizeof(Job));
+    Job** j = &queue;
+    const char* error;
+    int position = 0;
+    char buf[32];
+
+    if (job == NULL) {
+        return;
+    }
+    job->client = client;
+    error = parseJob(job, request);
+    if (error != NULL) {
+        sendDone(job, AFB_ERR_ARGS, AFB_STATUS_NONE, error);
+        freeJob(job);
+        return;
+    }
+    while (*j != NULL) {
+        j = &(*j)->next;
+        position++;
+    }
+    *j = job;
+    sprintf(buf, ",\"position\":%d", position);
+    sendEvent(job, "queued", buf);
+}
+
+static void sendStatus(int client) {
+    char buf[256];
+    int pos;
+    int count = 0;
+    Job* j;
+
+    for (j = queue; j != NULL; j = j->next) {
+        count++;
+    }
+    pos = sprintf(buf, "{\"event\":\"status\",\"open\":%s,\"version\":", afbIsOpen(programmer) ? "true" : "false");
+    pos += jsonEscape(buf + pos, 80, afbGetVersion(programmer));
+    sprintf(buf + pos, ",\"features\":%d,\"queue\":%d}\n", afbGetFeatures(programmer), count);
+    sendLine(client, buf);
+}
+
+static void processRequest(int client, const char* request) {
+    char* cmd = jsonString(request, "cmd");
+
+    if (cmd == NULL) {
+        addJob(client, request);
+    } else if (strcmp(cmd, "status") == 0) {
+        sendStatus(client);
+    } else {
+        sendLine(client, "{\"event\":\"error\",\"error\":\"unknown command\"}\n");
+    }
+    free(cmd);
+}
+
+// reads the available data from the client and processes the complete lines
+static void readClient(int client) {
+    Client* c = &clients[client];
+    char* line;
+    char* end;
+    int size;
+
+    if (c->size - c->len < 4096) {
+        int newSize = c->size ? c->size * 2 : 16 * 1024;
+        char* buf = (newSize <= MAX_REQUEST) ? (char*) realloc(c->buf, newSize) : NULL;
+        if (buf == NULL) {
+            sendLine(client, "{\"event\":\"error\",\"error\":\"request is too large\"}\n");
+            closeClient(client);
+            return;
+        }
+        c->buf = buf;
+        c->size = newSize;
+    }
+    size = read(c->fd, c->buf + c->len, c->size - 1 - c->len);
+    if (size <= 0) {
+        if (size < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        closeClient(client);
+        return;
+    }
+    c->len += size;
+    c->buf[c->len] = 0;
+
+    line = c->buf;
+    while ((end = strchr(line, '\n')) != NULL) {
+        *end = 0;
+        if (*skipSpaces(line) != 0) {
+            processRequest(client, line);
+        }
+        line = end + 1;
+    }
+    c->len -= line - c->buf;
+    memmove(c->buf, line, c->len + 1);
+}
+
+/* -------------------- main -------------------- */
+
+static void onSignal(int sig) {
+    quit = 1;
+}
+
+static void printHelp(void) {
+    printf("afterburnerd - Afterburner programmer daemon\n");
+    printf("usage: afterburnerd [options]\n");
+    printf("options:\n");
+    printf("  -d <dev>   serial device of the programmer\n");
+    printf("  -s <path>  job socket, default: %s\n", DEFAULT_SOCKET_NAME);
+    printf("  -v         verbose mode\n");
+}
+
+static int openSocket(void) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0) {
+        printf("Error: failed to create socket (%s)\n", strerror(errno));
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketName) >= sizeof(addr.sun_path)) {
+        printf("Error: socket path is too long\n");
+        close(fd);
+        return -1;
+    }
+    strcpy(addr.sun_path, socketName);
+    unlink(socketName);
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        printf("Error: failed to bind socket %s (%s)\n", socketName, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char** argv) {
+    struct pollfd fds[MAX_CLIENTS + 1];
+    int listenFd;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp("-d", argv[i]) == 0 && i + 1 < argc) {
+            deviceName = argv[++i];
+        } else if (strcmp("-s", argv[i]) == 0 && i + 1 < argc) {
+            socketName = argv[++i];
+        } else if (strcmp("-v", argv[i]) == 0) {
+            verbose = 1;
+        } else {
+            printHelp();
+            return 1;
+        }
+    }
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    programmer = afbCreate();
+    if (programmer == NULL) {
+        return 1;
+    }
+    afbSetCallbacks(programmer, onProgress, onOutput, NULL);
+    afbSetVerbose(programmer, verbose);
+
+    // the programmer is identified once, a failure is retried by the next job
+    if (afbOpen(programmer, deviceName) == AFB_OK) {
+        printf("programmer: %s\n", afbGetVersion(programmer));
+    }
+
+    listenFd = openSocket();
+    if (listenFd < 0) {
+        afbDestroy(programmer);
+        return 1;
+    }
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+    printf("listening on %s\n", socketName);
+
+    while (!quit) {
+        int timeout = -1;
+
+        if (!running && queue != NULL) {
+            startJob();
+        }
+        if (running) {
+            AfbResult result = afbPoll(programmer);
+            if (result != AFB_PENDING) {
+                nextStage(result);
+            }
+            // the next command is sent without delay when the response was received
+            timeout = (running && afbIsWaiting(programmer)) ? 10 : 0;
+        } else if (queue != NULL) {
+            timeout = 0;
+        }
+
+        fds[0].fd = listenFd;
+        fds[0].events = POLLIN;
+        for (i = 0; i < MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0 && clients[i].drop) {
+                closeClient(i);
+            }
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = clients[i].outLen ? POLLIN | POLLOUT : POLLIN;
+            fds[i + 1].revents = 0;
+        }
+        if (poll(fds, MAX_CLIENTS + 1, timeout) <= 0) {
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listenFd, NULL, NULL);
+            if (fd >= 0) {
+                for (i = 0; i < MAX_CLIENTS && clients[i].fd >= 0; i++);
+                if (i == MAX_CLIENTS) {
+                    close(fd);
+                } else {
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    clients[i].fd = fd;
+                    if (verbose) {
+                        printf("client %d connected\n", i);
+                    }
+                }
+            }
+        }
+        for (i = 0; i < MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0 && (fds[i + 1].revents & POLLOUT)) {
+                flushClient(i);
+            }
+            if (clients[i].fd >= 0 && (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+                readClient(i);
+            }
+        }
+    }
+
+    close(listenFd);
+    unlink(socketName);
+    afbDestroy(programmer);
+    return 0;
+}
@@ -0,0 +1,453 @@
+/*
+
+ AFTRACE : summary and replay of the serial traces
+
+ part of Afterburner GAL project
+
+ The traces are recorded by: ./afterburner ... -trace FILE
+
+ Usage:
+
+   ./aftrace summary FILE
+       prints the round-trip latency percentiles of each command, the idle
+       gaps between the commands and the transfer rates
+
+   ./aftrace dump FILE
+       prints the records as text
+
+   ./aftrace replay [-n] FILE [LINK]
+       acts as the programmer on a pseudo terminal (LINK is a symlink to it,
+       default /tmp/afterburner-replay). The recorded responses are sent
+       back with the recorded delays after the client sends the same bytes.
+       A response is sent at the time of the client's last read that
+       received nothing, the earliest time the data could have arrived.
+       Then run the same afterburner command with -d LINK to measure the PC
+       side without the hardware. -n: send the responses without delays.
+
+ A command starts by the bytes sent to the programmer and ends by the last
+ byte received before the next send. The round-trip is the time between the
+ first sent byte and the last received byte, the idle gap is the time between
+ the last received byte and the next send.
+
+*/
+
+// posix_openpt() and ptsname() on Linux
+#define _GNU_SOURCE
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+
+#include "libafterburner.h"
+
+#define MAX_NAME 8
+#define MAX_GROUPS 64
+#define REPLAY_TIMEOUT 10000
+
+typedef struct {
+    char type;
+    long long time;             // microseconds since the start of the trace
+    int size;
+    unsigned char* data;
+} Record;
+
+// a growing list of latencies
+typedef struct {
+    long long* v;
+    int count;
+    int max;
+} Samples;
+
+// commands with the same name
+typedef struct {
+    char name[MAX_NAME + 1];
+    Samples rtt;
+    long long sent;
+    long long received;
+} Group;
+
+static Record* records = NULL;
+static int recordCount = 0;
+
+static long long nowUs(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000LL + t.tv_nsec / 1000;
+}
+
+// reads all records of the trace file into memory
+static int loadTrace(const char* fileName) {
+    FILE* f = fopen(fileName, "rb");
+    char magic[AFB_TRACE_MAGIC_SIZE];
+    int max = 0;
+    long long time = 0;
+
+    if (f == NULL) {
+        fprintf(stderr, "Error: failed to open trace file: %s\n", fileName);
+        return -1;
+    }
+    if (fread(magic, 1, AFB_TRACE_MAGIC_SIZE, f) != AFB_TRACE_MAGIC_SIZE ||
+        memcmp(magic, AFB_TRACE_MAGIC, AFB_TRACE_MAGIC_SIZE) != 0) {
+        fprintf(stderr, "Error: not a trace file: %s\n", fileName);
+        fclose(f);
+        return -1;
+    }
+    while (1) {
+        unsigned char h[AFB_TRACE_HEADER_SIZE];
+        Record* r;
+
+        if (fread(h, 1, AFB_TRACE_HEADER_SIZE, f) != AFB_TRACE_HEADER_SIZE) {
+            break;
+        }
+        if (recordCount == max) {
+            max = max ? max * 2 : 1024;
+            records = (Record*) realloc(records, max * sizeof(Record));
+            if (records == NULL) {
+                fprintf(stderr, "Error: out of memory\n");
+                fclose(f);
+                return -1;
+            }
+        }
+        r = &records[recordCount];
+        time += h[1] | (h[2] << 8) | (h[3] << 16) | ((unsigned long) h[4] << 24);
+        r->type = h[0];
+        r->time = time;
+        r->size = h[5] | (h[6] << 8);
+        r->data = (unsigned char*) malloc(r->size + 1);
+        if (r->data == NULL || fread(r->data, 1, r->size, f) != (size_t) r->size) {
+            // the recording was interrupted: use the complete records
+            free(r->data);
+            break;
+        }
+        r->data[r->size] = 0;
+        recordCount++;
+    }
+    fclose(f);
+    return 0;
+}
+
+/* -------------------- summary -------------------- */
+
+static void addSample(Samples* s, long long value) {
+    if (s->count == s->max) {
+        s->max = s->max ? s->max * 2 : 64;
+        s->v = (long long*) realloc(s->v, s->max * sizeof(long long));
+        if (s->v == NULL) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+    }
+    s->v[s->count++] = value;
+}
+
+static int compareSamples(const void* a, const void* b) {
+    long long x = *(const long long*) a;
+    long long y = *(const long long*) b;
+    return (x > y) - (x < y);
+}
+
+// nearest rank percentile of the sorted samples
+static double percentile(const Samples* s, int p) {
+    int i = (s->count * p + 99) / 100 - 1;
+    if (i < 0) {
+        i = 0;
+    }
+    return s->v[i] / 1000.0;
+}
+
+static void printSamples(const char* name, Samples* s, long long sent, long long received) {
+    long long total = 0;
+    int i;
+
+    qsort(s->v, s->count, sizeof(long long), compareSamples);
+    for (i = 0; i < s->count; i++) {
+        total += s->v[i];
+    }
+    printf("%-8s %6d %9.1f %8.2f %8.2f %8.2f %8.2f", name, s->count, total / 1000.0,
+        percentile(s, 50), percentile(s, 90), percentile(s, 99), s->v[s->count - 1] / 1000.0);
+    if (sent >= 0) {
+        printf(" %9lld %9lld", sent, received);
+    }
+    printf("\n");
+}
+
+// the command name is the first word of the sent line: "w", "#f", ...
+static void commandName(const Record* r, char* name) {
+    int i;
+    for (i = 0; i < MAX_NAME && i < r->size && r->data[i] > ' '; i++) {
+        name[i] = r->data[i];
+    }
+    if (i == 0) {
+        name[i++] = (r->data[0] == '\r' || r->data[0] == '\n') ? '\\' : '?';
+    }
+    name[i] = 0;
+}
+
+static Group* findGroup(Group* groups, int* groupCount, const char* name) {
+    int i;
+    for (i = 0; i < *groupCount; i++) {
+        if (strcmp(groups[i].name, name) == 0) {
+            return &groups[i];
+        }
+    }
+    if (*groupCount == MAX_GROUPS) {
+        // the rest is accounted to the last group
+        return &groups[MAX_GROUPS - 1];
+    }
+    strcpy(groups[*groupCount].name, name);
+    return &groups[(*groupCount)++];
+}
+
+static int printSummary(void) {
+    Group* groups = (Group*) calloc(MAX_GROUPS, sizeof(Group));
+    Group* g = NULL;
+    Samples gaps = {0};
+    long long start = -1;       // time of the first sent byte of the current command
+    long long lastRead = -1;    // time of the last received byte
+    long long sent = 0, received = 0, busy = 0;
+    int groupCount = 0;
+    int opens = 0;
+    int i;
+
+    if (groups == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < recordCount; i++) {
+        Record* r = &records[i];
+
+        if (r->type == AFB_TRACE_OPEN) {
+            opens++;
+        } else if (r->type == AFB_TRACE_WRITE) {
+            // a new command: finish the previous one
+            if (g == NULL || lastRead >= start) {
+                char name[MAX_NAME + 1];
+                if (g != NULL && lastRead >= 0) {
+                    addSample(&g->rtt, lastRead - start);
+                    addSample(&gaps, r->time - lastRead);
+                    busy += lastRead - start;
+                }
+                commandName(r, name);
+                g = findGroup(groups, &groupCount, name);
+                start = r->time;
+            }
+            g->sent += r->size;
+            sent += r->size;
+        } else if (r->type == AFB_TRACE_READ && r->size > 0) {
+            lastRead = r->time;
+            received += r->size;
+            if (g != NULL) {
+                g->received += r->size;
+            }
+        }
+    }
+    if (g != NULL && lastRead >= start) {
+        addSample(&g->rtt, lastRead - start);
+        busy += lastRead - start;
+    }
+
+    if (recordCount == 0) {
+        printf("empty trace\n");
+        return 0;
+    }
+    printf("records: %d, device opened: %d times, duration: %.3f s\n", recordCount, opens,
+        (records[recordCount - 1].time - records[0].time) / 1000000.0);
+    printf("sent: %lld bytes, received: %lld bytes\n", sent, received);
+    if (busy > 0) {
+        printf("transfer rate while waiting for the programmer: %.0f bytes/s\n",
+            (sent + received) * 1000000.0 / busy);
+    }
+    printf("\nround-trip [ms]\n");
+    printf("command   count  total    p50      p90      p99      max       sent  received\n");
+    for (i = 0; i < groupCount; i++) {
+        if (groups[i].rtt.count > 0) {
+            printSamples(groups[i].name, &groups[i].rtt, groups[i].sent, groups[i].received);
+        }
+    }
+    if (gaps.count > 0) {
+        printf("\nidle gaps between the commands [ms]\n");
+        printf("          count  total    p50      p90      p99      max\n");
+        printSamples("gap", &gaps, -1, -1);
+    }
+    return 0;
+}
+
+/* -------------------- dump -------------------- */
+
+static int printDump(void) {
+    int i, j;
+
+    for (i = 0; i < recordCount; i++) {
+        Record* r = &records[i];
+        printf("%12.3f %c %5d ", r->time / 1000.0, r->type, r->size);
+        for (j = 0; j < r->size; j++) {
+            unsigned char c = r->data[j];
+            if (c == '\r') {
+                printf("\\r");
+            } else if (c == '\n') {
+                printf("\\n");
+            } else if (c < ' ' || c > '~') {
+                printf("\\x%02X", c);
+            } else {
+                putchar(c);
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+/* -------------------- replay -------------------- */
+
+// reads the bytes the client sends, returns the number of bytes that differ from the record
+static int replayExpect(int fd, const Record* r, int* timeout) {
+    unsigned char buf[256];
+    int pos = 0;
+    int diff = 0;
+
+    while (pos < r->size) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int len = r->size - pos;
+        int i;
+
+        if (poll(&pfd, 1, REPLAY_TIMEOUT) <= 0) {
+            *timeout = 1;
+            return diff + r->size - pos;
+        }
+        if (len > (int) sizeof(buf)) {
+            len = sizeof(buf);
+        }
+        len = read(fd, buf, len);
+        if (len <= 0) {
+            *timeout = 1;
+            return diff + r->size - pos;
+        }
+        for (i = 0; i < len; i++) {
+            if (buf[i] != r->data[pos + i]) {
+                diff++;
+            }
+        }
+        pos += len;
+    }
+    return diff;
+}
+
+static int replay(const char* link, char noDelay) {
+    struct termios t;
+    int fd, keep;
+    int i;
+    int diff = 0;
+    int timeout = 0;
+    long long last = 0;         // replay time of the previous record
+    long long start = 0;
+    long long sent = 0;
+
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+        fprintf(stderr, "Error: failed to create the pseudo terminal\n");
+        return 1;
+    }
+    tcgetattr(fd, &t);
+    cfmakeraw(&t);
+    tcsetattr(fd, TCSANOW, &t);
+    // keep the terminal open between the client's open / close
+    keep = open(ptsname(fd), O_RDWR | O_NOCTTY);
+    if (keep >= 0) {
+        tcgetattr(keep, &t);
+        cfmakeraw(&t);
+        tcsetattr(keep, TCSANOW, &t);
+    }
+    unlink(link);
+    if (symlink(ptsname(fd), link) != 0) {
+        fprintf(stderr, "Error: failed to create link: %s\n", link);
+        return 1;
+    }
+    printf("replaying %d records on %s, run: afterburner ... -d %s\n", recordCount, link, link);
+    fflush(stdout);
+
+    for (i = 0; i < recordCount && !timeout; i++) {
+        Record* r = &records[i];
+
+        if (r->type == AFB_TRACE_WRITE) {
+            int d = replayExpect(fd, r, &timeout);
+            if (d && diff == 0) {
+                printf("first difference in record %d at %.3f ms\n", i, r->time / 1000.0);
+            }
+            diff += d;
+            if (start == 0) {
+                start = nowUs();
+            }
+            last = nowUs();
+        } else if (r->type == AFB_TRACE_READ) {
+            // the programmer's response time is kept, the data is sent right after the empty read
+            char afterEmptyRead = (i > 0 && records[i - 1].type == AFB_TRACE_READ && records[i - 1].size == 0);
+            if (!noDelay && i > 0 && !afterEmptyRead) {
+                long long wait = last + (r->time - records[i - 1].time) - nowUs();
+                if (wait > 0) {
+                    usleep(wait);
+                }
+            }
+            last = nowUs();
+            if (r->size == 0) {
+                continue;
+            }
+            if (write(fd, r->data, r->size) != r->size) {
+                fprintf(stderr, "Error: write failed\n");
+                break;
+            }
+            sent += r->size;
+        }
+    }
+    // let the client read the last response
+    usleep(100 * 1000);
+    if (timeout) {
+        printf("the client stopped sending at record %d of %d\n", i, recordCount);
+    }
+    printf("replay finished: %lld bytes sent in %.3f s, %d bytes differ from the trace\n",
+        sent, start ? (last - start) / 1000000.0 : 0.0, diff);
+    unlink(link);
+    if (keep >= 0) {
+        close(keep);
+    }
+    close(fd);
+    return (diff || timeout) ? 1 : 0;
+}
+
+static void printUsage(void) {
+    printf("usage: aftrace summary FILE\n");
+    printf("       aftrace dump FILE\n");
+    printf("       aftrace replay [-n] FILE [LINK]\n");
+}
+
+int main(int argc, char** argv) {
+    char noDelay = 0;
+    int i = 2;
+
+    if (argc < 3) {
+        printUsage();
+        return 1;
+    }
+    if (strcmp(argv[1], "replay") == 0 && strcmp(argv[i], "-n") == 0) {
+        noDelay = 1;
+        i++;
+    }
+    if (i >= argc || loadTrace(argv[i]) != 0) {
+        return 1;
+    }
+    if (strcmp(argv[1], "summary") == 0) {
+        return printSummary();
+    }
+    if (strcmp(argv[1], "dump") == 0) {
+        return printDump();
+    }
+    if (strcmp(argv[1], "replay") == 0) {
+        return replay((i + 1 < argc) ? argv[i + 1] : "/tmp/afterburner-replay", noDelay);
+    }
+    printUsage();
+    return 1;
+}
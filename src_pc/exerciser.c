@@ -21,6 +21,7 @@
 #define DELAY_CUSTOM 2
 
 char sendGenericCommand(const char* command, const char* errorText, int maxDelay, char printResult);
+const char* getProgrammerStatusText(void);
 
 typedef int (*ExeFunc)(char* line, int lineSize, int check);
 
@@ -33,15 +34,70 @@ static int execPulseDuration(char* line, int lineSize, int check);
 static int execTraceOn(char* line, int lineSize, int check);
 static int execTraceOff(char* line, int lineSize, int check);
 static int execQuit(char* line, int lineSize, int check);
+static int execRepeat(char* line, int lineSize, int check);
+static int execEndRepeat(char* line, int lineSize, int check);
+static int execGroup(char* line, int lineSize, int check);
+static int execSet(char* line, int lineSize, int check);
+static int execCount(char* line, int lineSize, int check);
+static int execShift(char* line, int lineSize, int check);
+static int execWalk(char* line, int lineSize, int check);
 
 
 typedef struct {
     const char* name;
     ExeFunc exeFunc;
     char doDelay;
+    char unroll; // rewrite mode: the line is not copied, the Test lines are written unrolled
 } ExeCommand;
 
 
+// vector table of the batch mode, see aftb_exercise.h
+#define EXE_REC_PINS  1
+#define EXE_REC_PULSE 2
+#define EXE_REC_WAIT  3
+#define EXE_REC_ECHO  4
+#define EXE_REC_CHECK 5
+#define EXE_REC_LOOP  6
+#define EXE_REC_NEXT  7
+#define EXE_REC_GROUP 8
+#define EXE_REC_SET   9
+#define EXE_REC_COUNT 10
+#define EXE_REC_SHIFT 11
+#define EXE_REC_WALK  12
+#define EXE_REC_USE   13
+#define EXE_HEADER_SIZE 3
+
+// limits of the MCU: nested Repeat blocks and pin groups
+#define EXE_MAX_LOOPS 4
+#define EXE_MAX_GROUPS 8
+// the MCU counts the time of the table in 32 bits
+#define EXE_MAX_WAIT 0x7FFFFFFF
+
+typedef struct {
+    unsigned char data[EXE_TABLE_MAX];
+    int size;
+    int waitMs;     // total time of the delays and pulses in the table
+    int vectors;    // vectors applied by the table, the Repeat blocks included
+} ExeTable;
+
+// Repeat block
+typedef struct {
+    char* start;    // the line after 'Repeat'
+    int count;
+    int remaining;  // passes left, the syntax check and the compiler go through the block once
+    int table;      // compiler: the table of the block and its totals at the block start
+    int waitMs;
+    int vectors;
+} ExeLoop;
+
+// pin group, its value drives the 'd' pins and sets the expected levels of the 'e' pins
+typedef struct {
+    char name[16];
+    int size;
+    char pins[24];  // pin indices, the first one is the most significant bit of the value
+    uint32_t value;
+} ExeGroup;
+
 typedef struct {
     int lineNumber;
     char line[1024];
@@ -55,26 +111,53 @@ typedef struct {
     char isPulsedCommand;
     char isTracing;
     char quit;
+    char compile;       // batch mode: the commands are compiled into vector tables
+    int tableLimit;     // maximum table size accepted by the programmer
+    ExeTable* tables;
+    int tableCount;
+    char** echoes;      // Echo lines of the compiled script
+    int echoCount;
+    char* nextLine;     // the line after the current command
+    char* jump;         // set by the end of a Repeat block: the next line to run
+    ExeLoop loops[EXE_MAX_LOOPS];
+    int loopDepth;
+    ExeGroup groups[EXE_MAX_GROUPS];
+    int groupCount;
+    int mismatches;     // vectors with unexpected output levels (line mode)
+    FILE* rewrite;      // rewrite mode: the script is copied here, the Test patterns by 'vectorFunc'
+    ExeVectorFunc vectorFunc;
+    void* vectorUser;
 } ExeContext;
 
 
 static const ExeCommand commands[] = {
-    { "PinCount", execPinCount, DELAY_NONE },
-    { "DefaultDelay", execDefaultDelay, DELAY_NONE },
-    { "Echo", execEcho, DELAY_NONE },
-    { "Test", execTest, DELAY_DEFAULT },
-    { "Delay", execDelay, DELAY_CUSTOM },
-    { "PulseDuration", execPulseDuration, DELAY_NONE },
-    { "TraceOn", execTraceOn, DELAY_NONE },
-    { "TraceOff", execTraceOff, DELAY_NONE },
-    { "Quit", execQuit, DELAY_NONE },
-
-    { "", NULL, 0 } //Terminator
+    { "PinCount", execPinCount, DELAY_NONE, 0 },
+    { "DefaultDelay", execDefaultDelay, DELAY_NONE, 0 },
+    { "Echo", execEcho, DELAY_NONE, 0 },
+    { "Test", execTest, DELAY_DEFAULT, 1 },
+    { "Delay", execDelay, DELAY_CUSTOM, 0 },
+    { "PulseDuration", execPulseDuration, DELAY_NONE, 0 },
+    { "TraceOn", execTraceOn, DELAY_NONE, 0 },
+    { "TraceOff", execTraceOff, DELAY_NONE, 0 },
+    { "Quit", execQuit, DELAY_NONE, 0 },
+    { "Repeat", execRepeat, DELAY_NONE, 1 },
+    { "}", execEndRepeat, DELAY_NONE, 1 },
+    { "Group", execGroup, DELAY_NONE, 1 },
+    { "Set", execSet, DELAY_NONE, 1 },
+    { "Count", execCount, DELAY_NONE, 1 },
+    { "Shift", execShift, DELAY_NONE, 1 },
+    { "Walk", execWalk, DELAY_NONE, 1 },
+
+    { "", NULL, 0, 0 } //Terminator
 };
 
 
 static ExeContext exeCtx;
 
+// pins that can be read back by the programmer ('H' and 'L' levels), index 0 is pin 1
+static const char readablePins24[] = { 0, 9, 10, 12, 13, 14, 15, 16, 17, 18, 22, -1 };
+static const char readablePins20[] = { 0, 10, 11, 12, 13, 14, 18, -1 };
+
 static char* skipFrontWhiteSpace(char* line, char* scriptEnd) {
     while (line < scriptEnd) {
         if (line[0] == ' ' || line[0] == '\t' || line[0] == '\n' || line[0] == '\r') {
@@ -104,6 +187,137 @@ static void copyLineToCtx(char* line, int lineSize) {
 }
 
 
+// returns the table a record of 'size' bytes is added to, starts a new table if needed
+static ExeTable* getTable(int size) {
+    ExeTable* t = exeCtx.tableCount ? &exeCtx.tables[exeCtx.tableCount - 1] : NULL;
+
+    // the header of the table must match the current pin count and pulse duration
+    if (t == NULL || t->size + size > exeCtx.tableLimit ||
+        t->data[0] != exeCtx.pinCount || (t->data[1] | (t->data[2] << 8)) != exeCtx.pulseDuration) {
+        ExeTable* tables = (ExeTable*) realloc(exeCtx.tables, (exeCtx.tableCount + 1) * sizeof(ExeTable));
+        if (tables == NULL) {
+            printf("Error: out of memory\n");
+            return NULL;
+        }
+        exeCtx.tables = tables;
+        t = &tables[exeCtx.tableCount++];
+        t->data[0] = exeCtx.pinCount;
+        t->data[1] = exeCtx.pulseDuration & 0xFF;
+        t->data[2] = exeCtx.pulseDuration >> 8;
+        t->size = EXE_HEADER_SIZE;
+        t->waitMs = 0;
+        t->vectors = 0;
+    }
+    return t;
+}
+
+static int addRecord(const unsigned char* rec, int size) {
+    ExeTable* t = getTable(size);
+
+    if (t == NULL) {
+        return -1;
+    }
+    memcpy(t->data + t->size, rec, size);
+    t->size += size;
+    return 0;
+}
+
+// waits or adds the wait record to the vector table
+static void exeDelay(int delay) {
+    unsigned char rec[5];
+
+    if (exeCtx.rewrite != NULL || (exeCtx.compile && delay <= 0)) {
+        return;
+    }
+    if (!exeCtx.compile) {
+        usleep(delay * 1000);
+        return;
+    }
+    rec[0] = EXE_REC_WAIT;
+    rec[1] = delay & 0xFF;
+    rec[2] = (delay >> 8) & 0xFF;
+    rec[3] = (delay >> 16) & 0xFF;
+    rec[4] = (delay >> 24) & 0xFF;
+    if (addRecord(rec, sizeof(rec)) == 0) {
+        exeCtx.tables[exeCtx.tableCount - 1].waitMs += delay;
+    }
+}
+
+// pin states: 2 bits per pin, pulsed pins in the mask after the states.
+// The pins with the expected level 'H' or 'L' are followed by the check record,
+// the group pins ('d', 'e') are listed by the use record before the pin states.
+static int addPinsRecord(const char* pins) {
+    unsigned char rec[24] = {0};
+    unsigned char* use = rec;
+    unsigned char* vec = rec + 7;
+    unsigned char* check;
+    int size = exeCtx.isPulsedCommand ? 10 : 7;
+    int grouped = 0;
+    int checked = 0;
+    int i;
+
+    use[0] = EXE_REC_USE;
+    vec[0] = exeCtx.isPulsedCommand ? EXE_REC_PULSE : EXE_REC_PINS;
+    check = vec + size;
+    check[0] = EXE_REC_CHECK;
+    for (i = 0; i < exeCtx.pinCount; i++) {
+        int v = 3; // 'x', 'g', 'v': the pin is not set
+        switch (pins[i]) {
+        case '0': case 'P': case 'd': v = 0; break;
+        case '1': case 'p': v = 1; break;
+        case 'z': case 'H': case 'L': case 'e': v = 2; break;
+        }
+        vec[1 + (i >> 2)] |= v << ((i & 3) << 1);
+        if (pins[i] == 'p' || pins[i] == 'P') {
+            vec[7 + (i >> 3)] |= 1 << (i & 7);
+        }
+        if (pins[i] == 'H' || pins[i] == 'L') {
+            check[1 + (i >> 3)] |= 1 << (i & 7);
+            if (pins[i] == 'H') {
+                check[4 + (i >> 3)] |= 1 << (i & 7);
+            }
+            checked = 1;
+        }
+        if (pins[i] == 'd') {
+            use[1 + (i >> 3)] |= 1 << (i & 7);
+            grouped = 1;
+        }
+        if (pins[i] == 'e') {
+            use[4 + (i >> 3)] |= 1 << (i & 7);
+            grouped = checked = 1;
+        }
+    }
+    if (!grouped) {
+        use = vec;
+    }
+    // the use and check records are in the same table as their vector
+    if (addRecord(use, (vec - use) + (checked ? size + 7 : size))) {
+        return -1;
+    }
+    exeCtx.tables[exeCtx.tableCount - 1].vectors++;
+    if (exeCtx.isPulsedCommand) {
+        exeCtx.tables[exeCtx.tableCount - 1].waitMs += exeCtx.pulseDuration * 2;
+    }
+    return 0;
+}
+
+static int addEchoRecord(void) {
+    unsigned char rec[3];
+    char** echoes = (char**) realloc(exeCtx.echoes, (exeCtx.echoCount + 1) * sizeof(char*));
+
+    if (echoes == NULL || exeCtx.echoCount > 0xFFFF) {
+        printf("Error: out of memory\n");
+        return -1;
+    }
+    exeCtx.echoes = echoes;
+    echoes[exeCtx.echoCount] = strdup(exeCtx.line);
+    rec[0] = EXE_REC_ECHO;
+    rec[1] = exeCtx.echoCount & 0xFF;
+    rec[2] = exeCtx.echoCount >> 8;
+    exeCtx.echoCount++;
+    return addRecord(rec, sizeof(rec));
+}
+
 static void waitForKey(void) {
     char buf[512] = {0};
 
@@ -123,6 +337,14 @@ static void waitForKey(void) {
 }
 
 static int execTraceOn(char* line, int lineSize, int check) {
+    // the MCU runs the vector table without stopping
+    if (exeCtx.compile) {
+        printf("Warning: TraceOn is ignored in batch mode\n");
+        return 0;
+    }
+    if (exeCtx.rewrite != NULL) {
+        return 0;
+    }
     exeCtx.isTracing = 1;
     return 0;
 }
@@ -140,6 +362,253 @@ static int execQuit(char* line, int lineSize, int check) {
     return 0;
 }
 
+// totals of a table with a Repeat block: 'total' is the value at the block start,
+// 'body' the value after the first pass
+static int repeatTotal(int total, int body, int count) {
+    long long t = total + (long long) (body - total) * count;
+
+    return (t > EXE_MAX_WAIT) ? EXE_MAX_WAIT : (int) t;
+}
+
+static int execRepeat(char* line, int lineSize, int check) {
+    ExeLoop* loop;
+    int count = -1;
+    char brace = 0;
+
+    copyLineToCtx(line, lineSize);
+    if (sscanf(exeCtx.line, "%d %c", &count, &brace) != 2 || brace != '{' || count < 1 || count > 65535) {
+        printf("Error: invalid Repeat '%s', use: Repeat <1 - 65535> {\n", exeCtx.line);
+        return -1;
+    }
+    if (exeCtx.loopDepth == EXE_MAX_LOOPS) {
+        printf("Error: too many nested Repeat blocks (max %d)\n", EXE_MAX_LOOPS);
+        return -1;
+    }
+    loop = &exeCtx.loops[exeCtx.loopDepth++];
+    loop->start = exeCtx.nextLine;
+    loop->count = count;
+    loop->remaining = (check || exeCtx.compile) ? 1 : count;
+
+    if (check) {
+        return 0;
+    }
+
+    if (exeCtx.verbose) {
+        printf(" * %s %d\n", __FUNCTION__, count);
+    }
+
+    // the MCU repeats the compiled block
+    if (exeCtx.compile) {
+        unsigned char rec[3] = { EXE_REC_LOOP, count & 0xFF, count >> 8 };
+        if (addRecord(rec, sizeof(rec))) {
+            return -1;
+        }
+        loop->table = exeCtx.tableCount - 1;
+        loop->waitMs = exeCtx.tables[loop->table].waitMs;
+        loop->vectors = exeCtx.tables[loop->table].vectors;
+    }
+    return 0;
+}
+
+static int execEndRepeat(char* line, int lineSize, int check) {
+    ExeLoop* loop;
+    ExeTable* t;
+    unsigned char rec = EXE_REC_NEXT;
+
+    if (exeCtx.loopDepth == 0) {
+        printf("Error: '}' without Repeat\n");
+        return -1;
+    }
+    loop = &exeCtx.loops[exeCtx.loopDepth - 1];
+    if (--loop->remaining > 0) {
+        exeCtx.jump = loop->start;
+        return 0;
+    }
+    exeCtx.loopDepth--;
+    if (!exeCtx.compile) {
+        return 0;
+    }
+
+    if (addRecord(&rec, 1)) {
+        return -1;
+    }
+    // the MCU jumps back within the table
+    if (exeCtx.tableCount - 1 != loop->table) {
+        printf("Error: Repeat block does not fit into one vector table (max %d bytes)\n", exeCtx.tableLimit);
+        return -1;
+    }
+    t = &exeCtx.tables[loop->table];
+    t->waitMs = repeatTotal(loop->waitMs, t->waitMs, loop->count);
+    t->vectors = repeatTotal(loop->vectors, t->vectors, loop->count);
+    return 0;
+}
+
+static ExeGroup* findGroup(const char* name) {
+    int i;
+
+    for (i = 0; i < exeCtx.groupCount; i++) {
+        if (strcmp(exeCtx.groups[i].name, name) == 0) {
+            return &exeCtx.groups[i];
+        }
+    }
+    return NULL;
+}
+
+// value bit of the group pin, -1 if the pin is not in a group
+static int getGroupBit(int index) {
+    int i, j;
+
+    for (i = 0; i < exeCtx.groupCount; i++) {
+        const ExeGroup* g = &exeCtx.groups[i];
+        for (j = 0; j < g->size; j++) {
+            if (g->pins[j] == index) {
+                return (g->value >> (g->size - 1 - j)) & 1;
+            }
+        }
+    }
+    return -1;
+}
+
+static int execGroup(char* line, int lineSize, int check) {
+    unsigned char rec[3 + 24];
+    char name[16];
+    char pins[24];
+    char* args;
+    ExeGroup* g;
+    int size = 0;
+    int pos = 0;
+    int pin;
+    int i;
+
+    copyLineToCtx(line, lineSize);
+    if (sscanf(exeCtx.line, "%15s%n", name, &pos) != 1) {
+        pos = 0;
+    }
+    args = exeCtx.line + pos;
+    while (pos && sscanf(args, "%d%n", &pin, &pos) == 1) {
+        args += pos;
+        // not the power pins
+        if (pin < 1 || pin >= exeCtx.pinCount || pin == ((20 == exeCtx.pinCount) ? 10 : 12) || size == 22) {
+            printf("Error: invalid pin %d of the group '%s'\n", pin, exeCtx.line);
+            return -1;
+        }
+        pins[size++] = pin - 1;
+    }
+    args = skipFrontWhiteSpace(args, args + strlen(args));
+    if (size == 0 || *args != 0) {
+        printf("Error: invalid Group '%s', use: Group <name> <pin> [<pin> ...]\n", exeCtx.line);
+        return -1;
+    }
+
+    g = findGroup(name);
+    if (g == NULL) {
+        if (exeCtx.groupCount == EXE_MAX_GROUPS) {
+            printf("Error: too many groups (max %d)\n", EXE_MAX_GROUPS);
+            return -1;
+        }
+        g = &exeCtx.groups[exeCtx.groupCount++];
+        strcpy(g->name, name);
+    }
+    g->size = 0;
+    for (i = 0; i < size; i++) {
+        if (getGroupBit(pins[i]) >= 0) {
+            printf("Error: pin %d is already in a group '%s'\n", pins[i] + 1, exeCtx.line);
+            return -1;
+        }
+    }
+    memcpy(g->pins, pins, size);
+    g->size = size;
+    g->value = 0;
+
+    if (check) {
+        return 0;
+    }
+
+    if (exeCtx.verbose) {
+        printf(" * %s %s %d\n", __FUNCTION__, name, size);
+    }
+
+    if (exeCtx.compile) {
+        rec[0] = EXE_REC_GROUP;
+        rec[1] = g - exeCtx.groups;
+        rec[2] = size;
+        memcpy(rec + 3, pins, size);
+        return addRecord(rec, 3 + size);
+    }
+    return 0;
+}
+
+// changes the group value: 'op' is the record type of the operation, 'arg' the default argument
+static int execGroupOp(char* line, int lineSize, int check, int op, int arg) {
+    unsigned char rec[5];
+    char name[16];
+    ExeGroup* g;
+    uint32_t mask;
+    int args;
+
+    copyLineToCtx(line, lineSize);
+    args = sscanf(exeCtx.line, "%15s %i", name, &arg);
+    g = (args >= 1) ? findGroup(name) : NULL;
+    if (g == NULL) {
+        printf("Error: unknown group '%s'\n", exeCtx.line);
+        return -1;
+    }
+    if ((op == EXE_REC_SET && args != 2) || (op == EXE_REC_SHIFT && (arg < 0 || arg > 1))) {
+        printf("Error: invalid value '%s'\n", exeCtx.line);
+        return -1;
+    }
+
+    mask = (1UL << g->size) - 1;
+    switch (op) {
+    case EXE_REC_SET:
+        g->value = arg & mask;
+        break;
+    case EXE_REC_COUNT:
+        g->value = (g->value + arg) & mask;
+        break;
+    case EXE_REC_SHIFT:
+        g->value = ((g->value << 1) | arg) & mask;
+        break;
+    case EXE_REC_WALK:
+        g->value = ((g->value << 1) | (g->value >> (g->size - 1))) & mask;
+        break;
+    }
+
+    if (check) {
+        return 0;
+    }
+
+    if (exeCtx.verbose) {
+        printf(" * %s %s 0x%X\n", __FUNCTION__, name, g->value);
+    }
+
+    if (exeCtx.compile) {
+        rec[0] = op;
+        rec[1] = g - exeCtx.groups;
+        rec[2] = arg & 0xFF;
+        rec[3] = (arg >> 8) & 0xFF;
+        rec[4] = (arg >> 16) & 0xFF;
+        return addRecord(rec, sizeof(rec));
+    }
+    return 0;
+}
+
+static int execSet(char* line, int lineSize, int check) {
+    return execGroupOp(line, lineSize, check, EXE_REC_SET, 0);
+}
+
+static int execCount(char* line, int lineSize, int check) {
+    return execGroupOp(line, lineSize, check, EXE_REC_COUNT, 1);
+}
+
+static int execShift(char* line, int lineSize, int check) {
+    return execGroupOp(line, lineSize, check, EXE_REC_SHIFT, 0);
+}
+
+static int execWalk(char* line, int lineSize, int check) {
+    return execGroupOp(line, lineSize, check, EXE_REC_WALK, 0);
+}
+
 static int execPulseDuration(char* line, int lineSize, int check) {
     int duration = 100;
 
@@ -227,7 +696,7 @@ static int execDelay(char* line, int lineSize, int check) {
         delay += (exeCtx.pulseDuration * 2) + 1;
     }
 
-    usleep(delay * 1000);
+    exeDelay(delay);
     exeCtx.doDelay = 0; // don't do default delay for the next command
     return 0;
 }
@@ -239,6 +708,13 @@ static int execEcho(char* line, int lineSize, int check) {
     }
     copyLineToCtx(line, lineSize);
 
+    // printed when the MCU reaches the Echo record
+    if (exeCtx.compile) {
+        return addEchoRecord();
+    }
+    if (exeCtx.rewrite != NULL) {
+        return 0;
+    }
     printf("%s\n", exeCtx.line);
     //printf("%s\n", __FUNCTION__);
     return 0;
@@ -256,11 +732,17 @@ static char* getNextPin(char* pin, char* line) {
                 *line == 'V' || *line == 'v' || // VCC
                 *line == 'Z' || *line == 'z' || // Input / High impedance
                 *line == 'P' || *line == 'p' || // Rising pulse / Falling pulse
-                *line == 'X' || *line == 'x'    // Do not care - leave the old setting
+                *line == 'X' || *line == 'x' || // Do not care - leave the old setting
+                *line == 'H' || *line == 'h' || // Expected output level High
+                *line == 'L' || *line == 'l' || // Expected output level Low
+                *line == 'D' || *line == 'd' || // Driven by the value of the pin's group
+                *line == 'E' || *line == 'e'    // Expected level is the value of the pin's group
             ) {
-                //convert to lower case except the pulse 'P' and 'p'
-                if (*line == 'G' || *line == 'V' || *line == 'Z' || *line == 'X') {
+                //convert to lower case except the pulse 'P' and 'p', expected levels are upper case
+                if (*line == 'G' || *line == 'V' || *line == 'Z' || *line == 'X' || *line == 'D' || *line == 'E') {
                     *pin = *line + 32;
+                } else if (*line == 'h' || *line == 'l') {
+                    *pin = *line - 32;
                 } else {
                     *pin = *line;
                 }
@@ -287,6 +769,14 @@ static int setPins(char* pins) {
 
     sprintf(tmp, "x%s\r", pins);
     result = sendGenericCommand(tmp, "Excersize set pins failed?", 2000, 0);
+    // the programmer reports the sampled levels: "mismatch <levels>"
+    if (result && 0 == strncmp(getProgrammerStatusText(), "mismatch ", 9)) {
+        exeCtx.mismatches++;
+        printf("Mismatch: expected %s\n", pins);
+        printf("          got      %s\n", getProgrammerStatusText() + 9);
+        // keep running, the mismatches are reported at the end
+        return 0;
+    }
     return result;
 }
 
@@ -343,6 +833,36 @@ static int execTest(char* line, int lineSize, int check) {
 
     // TODO check that pins 20-22 are either 'z' or 'x' as these can't be set
 
+    // expected levels can be checked only on the pins connected to the MCU
+    i = 0;
+    while (i < exeCtx.pinCount) {
+        if ((pins[i] == 'H' || pins[i] == 'L' || pins[i] == 'e') && !exerciseIsReadablePin(i, exeCtx.pinCount)) {
+            printf("Error: pin %d can not be checked for the output level '%s'\n", i + 1, exeCtx.line);
+            return 1;
+        }
+        i++;
+    }
+
+    // group pins: the compiled vector leaves them to the MCU, otherwise the group value is used
+    i = 0;
+    while (i < exeCtx.pinCount) {
+        if (pins[i] == 'd' || pins[i] == 'e') {
+            int bit = getGroupBit(i);
+            if (bit < 0) {
+                printf("Error: pin %d is not in a group '%s'\n", i + 1, exeCtx.line);
+                return 1;
+            }
+            if (!exeCtx.compile) {
+                if (pins[i] == 'd') {
+                    pins[i] = bit ? '1' : '0';
+                } else {
+                    pins[i] = bit ? 'H' : 'L';
+                }
+            }
+        }
+        i++;
+    }
+
     // check whether there are pulsed pins
     i = 0;
     while (i < exeCtx.pinCount) {
@@ -361,6 +881,14 @@ static int execTest(char* line, int lineSize, int check) {
         printf(" * %s %s\n", __FUNCTION__, pins);
     }
 
+    if (exeCtx.compile) {
+        return addPinsRecord(pins);
+    }
+    if (exeCtx.rewrite != NULL) {
+        exeCtx.vectorFunc(pins, exeCtx.pinCount, exeCtx.vectorUser);
+        fprintf(exeCtx.rewrite, "Test %s\n", pins);
+        return 0;
+    }
     return setPins(pins);
 }
 
@@ -378,6 +906,10 @@ static int runBuffer(char* buffer, int bufSize, int checkSyntax) {
     exeCtx.pinCount = 24;
     exeCtx.doDelay = 0; // don't do default delay for the first test
     exeCtx.isTracing = 0;
+    exeCtx.mismatches = 0;
+    exeCtx.jump = NULL;
+    exeCtx.loopDepth = 0;
+    exeCtx.groupCount = 0;
 
     while (NULL != line && line < scriptEnd) {
         lineCount++;
@@ -388,6 +920,10 @@ static int runBuffer(char* buffer, int bufSize, int checkSyntax) {
                 int i = 0;
                 int found = 0;
 
+                // rewrite mode: comments are copied as they are
+                if (exeCtx.rewrite != NULL && line[0] == '#') {
+                    fprintf(exeCtx.rewrite, "%.*s\n", len, line);
+                }
                 // ignore comments
                 if (line[0] != '#') {
                     while (1) {
@@ -403,6 +939,11 @@ static int runBuffer(char* buffer, int bufSize, int checkSyntax) {
                         if (0 == strncmp(cmd->name, line, maxLen)) {
                             found = 1;
 
+                            // rewrite mode: the commands are copied, the Test lines by execTest()
+                            if (exeCtx.rewrite != NULL && !cmd->unroll) {
+                                fprintf(exeCtx.rewrite, "%.*s\n", len, line);
+                            }
+
                             // delay between commands if not checking syntax
                             if (!checkSyntax) {
                                 // current command is not Delay command AND previous command asked to do default delay
@@ -416,11 +957,12 @@ static int runBuffer(char* buffer, int bufSize, int checkSyntax) {
                                     if (exeCtx.isPulsedCommand) {
                                         delayTime += (exeCtx.pulseDuration * 2) + 1;
                                     }
-                                    usleep(delayTime * 1000);
+                                    exeDelay(delayTime);
                                 }
                             }
 
                             if (!exeCtx.quit) {
+                                exeCtx.nextLine = line + len;
                                 if (cmd->exeFunc(line + maxLen, len - maxLen, checkSyntax)) {
                                     errors++;
                                 }
@@ -437,6 +979,11 @@ static int runBuffer(char* buffer, int bufSize, int checkSyntax) {
                     //printf("--------------------------\n");
                 }
                 line += len;
+                // end of a Repeat block
+                if (exeCtx.jump != NULL) {
+                    line = exeCtx.jump;
+                    exeCtx.jump = NULL;
+                }
                 if (!checkSyntax) {
                     if (exeCtx.quit) {
                         break;
@@ -450,6 +997,10 @@ static int runBuffer(char* buffer, int bufSize, int checkSyntax) {
             break;
         }
     }
+    if (exeCtx.loopDepth && !exeCtx.quit) {
+        printf("Error: missing '}' of a Repeat block\n");
+        errors++;
+    }
     return errors;
 }
 
@@ -465,6 +1016,82 @@ int exerciseFile(char* buffer, int bufSize, int checkSyntax) {
     return runBuffer(buffer, bufSize, checkSyntax);
 }
 
+// compiles the script into vector tables of at most 'tableLimit' bytes
+int exerciseCompileFile(char* buffer, int bufSize, int tableLimit) {
+    int result;
+
+    exerciseFreeTables();
+    if (tableLimit > EXE_TABLE_MAX) {
+        tableLimit = EXE_TABLE_MAX;
+    }
+    exeCtx.tableLimit = tableLimit;
+    exeCtx.compile = 1;
+    result = exerciseFile(buffer, bufSize, 0);
+    exeCtx.compile = 0;
+    return result;
+}
+
+// copies the script into 'out', each Test pattern is passed to 'func' before it is written
+int exerciseRewriteFile(char* buffer, int bufSize, FILE* out, ExeVectorFunc func, void* user) {
+    int result;
+
+    exeCtx.rewrite = out;
+    exeCtx.vectorFunc = func;
+    exeCtx.vectorUser = user;
+    result = exerciseFile(buffer, bufSize, 0);
+    exeCtx.rewrite = NULL;
+    return result;
+}
+
+// the programmer can read the level of the pin, index 0 is pin 1
+int exerciseIsReadablePin(int index, int pinCount) {
+    const char* readable = (20 == pinCount) ? readablePins20 : readablePins24;
+
+    while (*readable >= 0 && *readable != index) {
+        readable++;
+    }
+    return *readable >= 0;
+}
+
+int exerciseGetTableCount(void) {
+    return exeCtx.tableCount;
+}
+
+const unsigned char* exerciseGetTable(int index, int* size, int* waitMs, int* vectors) {
+    if (index < 0 || index >= exeCtx.tableCount) {
+        return NULL;
+    }
+    *size = exeCtx.tables[index].size;
+    *waitMs = exeCtx.tables[index].waitMs;
+    *vectors = exeCtx.tables[index].vectors;
+    return exeCtx.tables[index].data;
+}
+
+int exerciseGetMismatches(void) {
+    return exeCtx.mismatches;
+}
+
+const char* exerciseGetEcho(int index) {
+    if (index < 0 || index >= exeCtx.echoCount) {
+        return "";
+    }
+    return exeCtx.echoes[index];
+}
+
+void exerciseFreeTables(void) {
+    int i;
+
+    for (i = 0; i < exeCtx.echoCount; i++) {
+        free(exeCtx.echoes[i]);
+    }
+    free(exeCtx.echoes);
+    free(exeCtx.tables);
+    exeCtx.echoes = NULL;
+    exeCtx.echoCount = 0;
+    exeCtx.tables = NULL;
+    exeCtx.tableCount = 0;
+}
+
 void exerciseSetVerbose(char verbose) {
     exeCtx.verbose = verbose ? 1 : 0;
 }
@@ -8,11 +8,32 @@
 
 #pragma once
 
+#include <stdio.h>
+
 #define exerciseCheckFile(B,S) exerciseFile(B,S,1)
 #define exerciseRunFile(B,S) exerciseFile(B,S,0)
 
+// largest vector table of the batch mode: the fuse map buffer of a RAM-BIG programmer
+#define EXE_TABLE_MAX 1813
+// the fuse map buffer of a programmer with a small RAM (Arduino UNO)
+#define EXE_TABLE_SMALL 1332
+// signature test ('Xs' command): polynomial of the MISR, the same as in aftb_exercise.h
+#define EXE_MISR_POLY 0x04C11DB7UL
+
+// called with each Test pattern of a rewritten script, index 0 is pin 1. The pattern can be changed.
+typedef void (*ExeVectorFunc)(char* pins, int pinCount, void* user);
+
 
 int exerciseGetPulseDuration(void);
 int exerciseGetPinCount(void);
 void exerciseSetVerbose(char verbose);
 int exerciseFile(char* buffer, int bufSize, int check);
+
+int exerciseCompileFile(char* buffer, int bufSize, int tableLimit);
+int exerciseGetTableCount(void);
+const unsigned char* exerciseGetTable(int index, int* size, int* waitMs, int* vectors);
+const char* exerciseGetEcho(int index);
+int exerciseGetMismatches(void);
+void exerciseFreeTables(void);
+int exerciseRewriteFile(char* buffer, int bufSize, FILE* out, ExeVectorFunc func, void* user);
+int exerciseIsReadablePin(int index, int pinCount);
@@ -0,0 +1,444 @@
+/*
+
+ GALSIM : logic simulator of the programmed GAL
+
+ part of Afterburner GAL project
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "galsim.h"
+
+// columns of the pin levels in the AND array, index 0 is pin 1, -1: the pin is not connected
+static const signed char pinColumns16Simple[20] = {
+     2,  0,  4,  8, 12, 16, 20, 24, 28, -1, 30, 26, 22, 18, -1, -1, 14, 10,  6, -1 };
+static const signed char pinColumns16Complex[20] = {
+     2,  0,  4,  8, 12, 16, 20, 24, 28, -1, 30, -1, 26, 22, 18, 14, 10,  6, -1, -1 };
+static const signed char pinColumns16Registered[20] = {
+    -1,  0,  4,  8, 12, 16, 20, 24, 28, -1, -1, 30, 26, 22, 18, 14, 10,  6,  2, -1 };
+
+static const signed char pinColumns20Simple[24] = {
+     2,  0,  4,  8, 12, 16, 20, 24, 28, 32, 36, -1, 38, 34, 30, 26, 22, -1, -1, 18, 14, 10,  6, -1 };
+static const signed char pinColumns20Complex[24] = {
+     2,  0,  4,  8, 12, 16, 20, 24, 28, 32, 36, -1, 38, 34, -1, 30, 26, 22, 18, 14, 10, -1,  6, -1 };
+static const signed char pinColumns20Registered[24] = {
+    -1,  0,  4,  8, 12, 16, 20, 24, 28, 32, 36, -1, -1, 34, 38, 30, 26, 22, 18, 14, 10,  2,  6, -1 };
+
+static const signed char pinColumns22V10[24] = {
+     0,  4,  8, 12, 16, 20, 24, 28, 32, 36, 40, -1, 42, 38, 34, 30, 26, 22, 18, 14, 10,  6,  2, -1 };
+
+// product terms of the 22V10 OLMCs, starting at pin 23
+static const unsigned char termCount22V10[10] = { 8, 10, 12, 14, 16, 16, 14, 12, 10, 8 };
+
+// fuse map layout of the GAL16V8 and GAL20V8
+typedef struct {
+    int columns;
+    int xorFuse;
+    int ac1Fuse;
+    int ptdFuse;
+    int synFuse;
+    int ac0Fuse;
+    int lastOlmcPin;    // pin of the first OLMC (rows 0 to 7)
+    int oePin;          // output enable of the registered outputs
+} GalSimLayout;
+
+static const GalSimLayout layout16V8 = { 32, 2048, 2120, 2128, 2192, 2193, 18, 10 };
+static const GalSimLayout layout20V8 = { 40, 2560, 2632, 2640, 2704, 2705, 21, 12 };
+
+#define NOT(B) ((~(B).val) & ~(B).unk)
+
+// adds the connected columns of the row, 'fuse' is the first fuse of the row
+static void addRow(GalSim* s, const JedecFile* jedec, int fuse, int columns) {
+    int row = s->rowCount++;
+    int c;
+
+    s->rowSize[row] = 0;
+    s->rowFalse[row] = 0;
+    for (c = 0; c < columns; c++) {
+        // intact fuse (0) connects the column
+        if (!jedecGetFuse(jedec, fuse + c)) {
+            s->rowColumns[row][s->rowSize[row]++] = c;
+            // both the signal and its complement: the term is always false
+            if ((c & 1) && s->rowSize[row] > 1 && s->rowColumns[row][s->rowSize[row] - 2] == c - 1) {
+                s->rowFalse[row] = 1;
+            }
+        }
+    }
+}
+
+// connects the pins and the register outputs to the signals of the AND array
+static void setupSignals(GalSim* s, const signed char* pinColumns) {
+    int i;
+
+    s->signalCount = 0;
+    for (i = 0; i < s->pins; i++) {
+        int signal;
+        int n;
+
+        if (pinColumns[i] < 0) {
+            continue;
+        }
+        signal = pinColumns[i] >> 1;
+        if (signal >= s->signalCount) {
+            s->signalCount = signal + 1;
+        }
+        s->signalPin[signal] = i;
+        s->signalOlmc[signal] = -1;
+        // the feedback of a registered output is the inverted register output
+        for (n = 0; n < s->olmcCount; n++) {
+            if (s->olmc[n].pin == i && s->olmc[n].mode == GALSIM_REG) {
+                s->signalPin[signal] = -1;
+                s->signalOlmc[signal] = n;
+            }
+        }
+    }
+}
+
+static int initV8(GalSim* s, const JedecFile* jedec, const GalSimLayout* l) {
+    int syn = jedecGetFuse(jedec, l->synFuse);
+    int ac0 = jedecGetFuse(jedec, l->ac0Fuse);
+    const signed char* pinColumns;
+    int n;
+
+    if (syn && !ac0) {
+        s->modeName = "simple";
+        pinColumns = (s->pins == 20) ? pinColumns16Simple : pinColumns20Simple;
+    } else if (syn && ac0) {
+        s->modeName = "complex";
+        pinColumns = (s->pins == 20) ? pinColumns16Complex : pinColumns20Complex;
+    } else if (ac0) {
+        s->modeName = "registered";
+        pinColumns = (s->pins == 20) ? pinColumns16Registered : pinColumns20Registered;
+        s->oePin = l->oePin;
+    } else {
+        return GALSIM_ERROR;
+    }
+
+    for (n = 0; n < 64; n++) {
+        addRow(s, jedec, n * l->columns, l->columns);
+        // disabled product term
+        if (!jedecGetFuse(jedec, l->ptdFuse + n)) {
+            s->rowFalse[n] = 1;
+        }
+    }
+
+    s->olmcCount = 8;
+    for (n = 0; n < 8; n++) {
+        GalSimOlmc* o = &s->olmc[n];
+        int ac1 = jedecGetFuse(jedec, l->ac1Fuse + n);
+
+        o->pin = l->lastOlmcPin - n;
+        o->activeHigh = jedecGetFuse(jedec, l->xorFuse + n);
+        o->firstRow = n * 8;
+        o->rowCount = 8;
+        o->oeRow = -1;
+        if (syn && !ac0) {
+            // simple mode: AC1 makes the pin an input
+            o->mode = ac1 ? GALSIM_INPUT : GALSIM_COMB;
+        } else if (ac1) {
+            // complex mode, or combinatorial output in the registered mode: the first term is the OE
+            o->mode = GALSIM_COMB;
+            o->oeRow = o->firstRow++;
+            o->rowCount--;
+        } else {
+            o->mode = GALSIM_REG;
+        }
+        // the pin is driven by the inverted register output, XOR sets the polarity
+        o->dInvert = o->activeHigh;
+        o->pinInvert = 1;
+    }
+    setupSignals(s, pinColumns);
+    return GALSIM_OK;
+}
+
+static int init22V10(GalSim* s, const JedecFile* jedec) {
+    int row = 1;
+    int n;
+
+    s->modeName = "22V10";
+    for (n = 0; n < 132; n++) {
+        addRow(s, jedec, n * 44, 44);
+    }
+    s->arRow = 0;
+    s->spRow = 131;
+
+    s->olmcCount = 10;
+    for (n = 0; n < 10; n++) {
+        GalSimOlmc* o = &s->olmc[n];
+
+        o->pin = 22 - n;
+        o->activeHigh = jedecGetFuse(jedec, 5808 + n * 2);
+        o->mode = jedecGetFuse(jedec, 5809 + n * 2) ? GALSIM_COMB : GALSIM_REG;
+        o->oeRow = row;
+        o->firstRow = row + 1;
+        o->rowCount = termCount22V10[n];
+        row += termCount22V10[n] + 1;
+        // the register feeds the pin directly or inverted
+        o->dInvert = 0;
+        o->pinInvert = !o->activeHigh;
+    }
+    setupSignals(s, pinColumns22V10);
+    return GALSIM_OK;
+}
+
+int galSimInit(GalSim* s, AfbGalType gal, const JedecFile* jedec) {
+    int result;
+
+    memset(s, 0, sizeof(GalSim));
+    s->gal = gal;
+    s->oePin = -1;
+    s->arRow = -1;
+    s->spRow = -1;
+
+    switch (gal) {
+    case AFB_GAL16V8:
+    case AFB_ATF16V8B:
+        s->pins = 20;
+        result = initV8(s, jedec, &layout16V8);
+        break;
+    case AFB_GAL20V8:
+    case AFB_ATF20V8B:
+        s->pins = 24;
+        result = initV8(s, jedec, &layout20V8);
+        break;
+    case AFB_GAL22V10:
+    case AFB_ATF22V10B:
+    case AFB_ATF22V10C:
+        s->pins = 24;
+        result = init22V10(s, jedec);
+        break;
+    default:
+        result = GALSIM_ERROR;
+    }
+    galSimReset(s);
+    return result;
+}
+
+void galSimReset(GalSim* s) {
+    int i;
+
+    for (i = 0; i < GALSIM_MAX_OLMCS; i++) {
+        s->q[i].val = 0;
+        s->q[i].unk = ~0ULL;
+        s->d[i] = s->q[i];
+    }
+    s->sp.val = 0;
+    s->sp.unk = 0;
+    for (i = 0; i < GALSIM_MAX_PINS; i++) {
+        s->level[i].val = 0;
+        s->level[i].unk = ~0ULL;
+        s->driven[i] = 0;
+    }
+}
+
+// product term: the signal levels are in 'sig'
+static GalSimBits evalRow(const GalSim* s, int row, const GalSimBits* sig) {
+    GalSimBits r;
+    uint64_t zero = 0;
+    uint64_t unk = 0;
+    int i;
+
+    if (s->rowFalse[row]) {
+        r.val = 0;
+        r.unk = 0;
+        return r;
+    }
+    for (i = 0; i < s->rowSize[row]; i++) {
+        int c = s->rowColumns[row][i];
+        const GalSimBits* b = &sig[c >> 1];
+        uint64_t v = (c & 1) ? NOT(*b) : b->val;
+
+        zero |= ~v & ~b->unk;
+        unk |= b->unk;
+    }
+    r.val = ~zero & ~unk;
+    r.unk = unk & ~zero;
+    return r;
+}
+
+static GalSimBits evalSum(const GalSim* s, const GalSimOlmc* o, const GalSimBits* sig) {
+    GalSimBits r = { 0, 0 };
+    int i;
+
+    for (i = 0; i < o->rowCount; i++) {
+        GalSimBits t = evalRow(s, o->firstRow + i, sig);
+        r.val |= t.val;
+        r.unk |= t.unk;
+    }
+    r.unk &= ~r.val;
+    return r;
+}
+
+static GalSimBits invertIf(GalSimBits b, int invert) {
+    if (invert) {
+        b.val = NOT(b);
+    }
+    return b;
+}
+
+// maximum evaluations of the combinatorial feedback before the levels are considered unstable
+#define MAX_SETTLE (GALSIM_MAX_OLMCS + 2)
+
+void galSimStep(GalSim* s, const GalSimBits* ext) {
+    GalSimBits sig[GALSIM_MAX_SIGNALS];
+    GalSimBits level[GALSIM_MAX_PINS];
+    uint64_t changed = 0;
+    int iter;
+    int i;
+
+    // the outputs start at their last levels
+    for (i = 0; i < s->pins; i++) {
+        level[i].val = (s->driven[i] & s->level[i].val) | (~s->driven[i] & ext[i].val);
+        level[i].unk = (s->driven[i] & s->level[i].unk) | (~s->driven[i] & ext[i].unk);
+    }
+
+    for (iter = 0; iter < MAX_SETTLE; iter++) {
+        changed = 0;
+        for (i = 0; i < s->signalCount; i++) {
+            if (s->signalOlmc[i] >= 0) {
+                sig[i] = invertIf(s->q[s->signalOlmc[i]], 1);
+            } else {
+                sig[i] = level[s->signalPin[i]];
+            }
+        }
+
+        // asynchronous reset of the registers
+        if (s->arRow >= 0) {
+            GalSimBits ar = evalRow(s, s->arRow, sig);
+            for (i = 0; i < s->olmcCount; i++) {
+                GalSimBits* q = &s->q[i];
+                q->unk = (q->unk & ~ar.val) | (ar.unk & (q->val | q->unk));
+                q->val &= ~ar.val & ~q->unk;
+            }
+        }
+        if (s->spRow >= 0) {
+            s->sp = evalRow(s, s->spRow, sig);
+        }
+
+        for (i = 0; i < s->olmcCount; i++) {
+            const GalSimOlmc* o = &s->olmc[i];
+            GalSimBits out;
+            GalSimBits oe;
+            GalSimBits l;
+
+            if (o->mode == GALSIM_INPUT) {
+                s->driven[o->pin] = 0;
+                continue;
+            }
+            if (o->mode == GALSIM_REG) {
+                s->d[i] = invertIf(evalSum(s, o, sig), o->dInvert);
+                out = invertIf(s->q[i], o->pinInvert);
+            } else {
+                out = invertIf(evalSum(s, o, sig), !o->activeHigh);
+            }
+
+            if (o->oeRow >= 0) {
+                oe = evalRow(s, o->oeRow, sig);
+            } else if (o->mode == GALSIM_REG && s->oePin >= 0) {
+                oe = invertIf(ext[s->oePin], 1);
+            } else {
+                oe.val = ~0ULL;
+                oe.unk = 0;
+            }
+
+            // driven: the output level, not driven: the external level
+            l.val = (oe.val & out.val) | (NOT(oe) & ext[o->pin].val);
+            l.unk = (oe.val & out.unk) | (NOT(oe) & ext[o->pin].unk) | oe.unk;
+            l.val &= ~l.unk;
+            changed |= (l.val ^ level[o->pin].val) | (l.unk ^ level[o->pin].unk);
+            level[o->pin] = l;
+            s->driven[o->pin] = oe.val;
+        }
+        if (!changed) {
+            break;
+        }
+    }
+
+    for (i = 0; i < s->pins; i++) {
+        s->level[i] = level[i];
+        // the vectors that did not settle
+        s->level[i].unk |= changed;
+        s->level[i].val &= ~changed;
+    }
+}
+
+void galSimClock(GalSim* s) {
+    int i;
+
+    for (i = 0; i < s->olmcCount; i++) {
+        if (s->olmc[i].mode != GALSIM_REG) {
+            continue;
+        }
+        s->q[i] = s->d[i];
+        // synchronous preset
+        if (s->spRow >= 0) {
+            s->q[i].unk = (s->q[i].unk & ~s->sp.val) | (s->sp.unk & ~s->q[i].val);
+            s->q[i].val = (s->q[i].val | s->sp.val) & ~s->q[i].unk;
+        }
+    }
+}
+
+int galSimIsOutput(const GalSim* s, int pin) {
+    int i;
+
+    for (i = 0; i < s->olmcCount; i++) {
+        if (s->olmc[i].pin == pin && s->olmc[i].mode != GALSIM_INPUT) {
+            // the output enable is never true
+            if (s->olmc[i].oeRow >= 0 && s->rowFalse[s->olmc[i].oeRow]) {
+                return 0;
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// the term can be true and uses the column
+static int isColumnUsed(const GalSim* s, int row, int column) {
+    int i;
+
+    if (s->rowFalse[row]) {
+        return 0;
+    }
+    for (i = 0; i < s->rowSize[row]; i++) {
+        if ((s->rowColumns[row][i] >> 1) == column) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int galSimIsInputUsed(const GalSim* s, int pin) {
+    int signal;
+    int row;
+
+    if (pin == s->oePin && galSimHasRegisters(s)) {
+        return 1;
+    }
+    for (signal = 0; signal < s->signalCount; signal++) {
+        if (s->signalPin[signal] != pin) {
+            continue;
+        }
+        for (row = 0; row < s->rowCount; row++) {
+            if (isColumnUsed(s, row, signal)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int galSimHasRegisters(const GalSim* s) {
+    int i;
+
+    for (i = 0; i < s->olmcCount; i++) {
+        if (s->olmc[i].mode == GALSIM_REG && galSimIsOutput(s, s->olmc[i].pin)) {
+            return 1;
+        }
+    }
+    return 0;
+}
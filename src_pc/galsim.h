@@ -0,0 +1,94 @@
+/*
+
+ GALSIM : logic simulator of the programmed GAL
+
+ part of Afterburner GAL project
+
+ The fuse map of a GAL16V8, GAL20V8 or GAL22V10 (and the ATF variants) is
+ turned into the product terms and the OLMC configuration. The simulation
+ is bit-parallel: bit N of every signal word belongs to vector N, so one
+ galSimStep() evaluates 64 independent input vectors.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "libafterburner.h"
+
+#define GALSIM_OK 0
+#define GALSIM_ERROR -1
+
+#define GALSIM_MAX_PINS 24
+#define GALSIM_MAX_OLMCS 10
+#define GALSIM_MAX_ROWS 132
+#define GALSIM_MAX_SIGNALS 22
+
+// OLMC modes
+#define GALSIM_INPUT 0      // the pin is an input, the output is disabled
+#define GALSIM_COMB  1      // combinatorial output
+#define GALSIM_REG   2      // registered output, clocked by pin 1
+
+// levels of 64 vectors: bit N is the level in vector N
+typedef struct {
+    uint64_t val;   // 1: high (only where the level is known)
+    uint64_t unk;   // 1: the level is unknown
+} GalSimBits;
+
+typedef struct {
+    int pin;        // index of the pin, 0 is pin 1
+    int firstRow;   // first product term of the sum
+    int rowCount;
+    int oeRow;      // product term of the output enable, -1: none
+    char mode;      // GALSIM_INPUT, GALSIM_COMB or GALSIM_REG
+    char activeHigh;
+    char dInvert;   // register input is the inverted sum
+    char pinInvert; // pin is the inverted register output
+} GalSimOlmc;
+
+typedef struct {
+    AfbGalType gal;
+    int pins;                       // 20 or 24
+    const char* modeName;           // "simple", "complex", "registered" or "22V10"
+
+    int olmcCount;
+    GalSimOlmc olmc[GALSIM_MAX_OLMCS];
+    int oePin;                      // output enable of the registered outputs (active low), -1: none
+    int arRow;                      // asynchronous reset, -1: none
+    int spRow;                      // synchronous preset, -1: none
+
+    // signals of the AND array: a pin level or an inverted register output
+    int signalCount;
+    int signalPin[GALSIM_MAX_SIGNALS];      // -1: not a pin
+    int signalOlmc[GALSIM_MAX_SIGNALS];     // -1: not a register
+
+    // product terms: the connected columns, column 2N is signal N, 2N + 1 its complement
+    int rowCount;
+    unsigned char rowColumns[GALSIM_MAX_ROWS][GALSIM_MAX_SIGNALS * 2];
+    unsigned char rowSize[GALSIM_MAX_ROWS];
+    char rowFalse[GALSIM_MAX_ROWS];         // disabled or always false
+
+    // state
+    GalSimBits q[GALSIM_MAX_OLMCS];         // register outputs
+    GalSimBits d[GALSIM_MAX_OLMCS];         // register inputs of the last step
+    GalSimBits sp;                          // synchronous preset of the last step
+    GalSimBits level[GALSIM_MAX_PINS];      // pin levels of the last step
+    uint64_t driven[GALSIM_MAX_PINS];       // the GAL drives the pin (known output enable)
+} GalSim;
+
+// builds the model of the fuse map, returns GALSIM_ERROR if the GAL type or its mode is not supported
+int galSimInit(GalSim* s, AfbGalType gal, const JedecFile* jedec);
+// sets the registers to unknown levels
+void galSimReset(GalSim* s);
+// evaluates the logic until it settles. 'ext' are the levels of the pins when the GAL does not
+// drive them. The settled levels and output enables are in s->level and s->driven.
+void galSimStep(GalSim* s, const GalSimBits* ext);
+// rising edge of the clock: the registers load the inputs of the last step
+void galSimClock(GalSim* s);
+// the pin is an output in some of the vectors (not for GALSIM_INPUT OLMCs)
+int galSimIsOutput(const GalSim* s, int pin);
+// the pin level is used by the AND array
+int galSimIsInputUsed(const GalSim* s, int pin);
+// some of the used outputs are registered
+int galSimHasRegisters(const GalSim* s);
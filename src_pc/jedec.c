@@ -0,0 +1,333 @@
+/*
+
+ JEDEC : fuse map parser and bit-packed fuse map storage
+
+ part of Afterburner GAL project
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#include "jedec.h"
+
+#define READ_CHUNK (64 * 1024)
+
+// parser states
+#define ST_OUTSIDE 0        // outside JEDEC: before the first '*'
+#define ST_SKIP 1           // skipping comment or unknown field
+#define ST_FIELD 2          // reading field identifier
+#define ST_L_FIRST 3        // L field: first digit of the address
+#define ST_L_ADDRESS 4      // L field: address
+#define ST_F 5              // F field: default fuse value
+#define ST_L_FUSES 6        // L field: fuse values
+#define ST_Q 7              // Q field: sub-field identifier
+#define ST_QP_FIRST 8       // QP field: first digit
+#define ST_QF_FIRST 9       // QF field: first digit
+#define ST_QP 10            // QP field: pin count
+#define ST_QF 11            // QF field: fuse count
+#define ST_Q_END 12         // Q field: trailing white spaces
+#define ST_G 13             // G field: security fuse
+#define ST_C_FIRST 14       // C field: first digit
+#define ST_C 15             // C field: checksum
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define JEDEC_NO_SWAR
+#endif
+
+void jedecInit(JedecFile* j) {
+    memset(j->fuse, 0, sizeof(j->fuse));
+    j->pins = 0;
+    j->fuseCount = 0;
+    j->security = 0;
+    j->checksum = 0;
+    j->state = ST_OUTSIDE;
+    j->address = 0;
+    j->position = 0;
+    j->errorPosition = -1;
+}
+
+// sets all fuses to 0 or 1
+void jedecClear(JedecFile* j, int value) {
+    memset(j->fuse, value ? 0xFF : 0, sizeof(j->fuse));
+}
+
+// sets 'count' fuses (max 64) starting at 'address': bit 0 of 'bits' is the fuse at 'address'
+void jedecSetFuses(JedecFile* j, int address, uint64_t bits, int count) {
+    uint64_t* w = &j->fuse[address >> 6];
+    uint64_t mask = (count == 64) ? ~0ULL : ((1ULL << count) - 1);
+    int shift = address & 63;
+
+    bits &= mask;
+    w[0] = (w[0] & ~(mask << shift)) | (bits << shift);
+    if (shift + count > 64) {
+        w[1] = (w[1] & ~(mask >> (64 - shift))) | (bits >> (64 - shift));
+    }
+}
+
+// Consumes fuse values ('0', '1') and white spaces of an L field.
+// Returns the number of consumed characters or -1 when the fuse address is out of range.
+static long parseFuses(JedecFile* j, const char* data, long size) {
+    long n = 0;
+
+#ifndef JEDEC_NO_SWAR
+    // 8 fuses at once: all 8 characters must be '0' or '1'
+    while (n + 8 <= size && j->address + 8 <= JEDEC_MAX_FUSES) {
+        uint64_t v;
+        memcpy(&v, data + n, 8);
+        if ((v & 0xFEFEFEFEFEFEFEFEULL) != 0x3030303030303030ULL) {
+            break;
+        }
+        // gather the lowest bit of each character: character K becomes bit K
+        v = ((v & 0x0101010101010101ULL) * 0x0102040810204080ULL) >> 56;
+        jedecSetFuses(j, j->address, v, 8);
+        j->address += 8;
+        n += 8;
+    }
+#endif
+    for (; n < size; n++) {
+        char c = data[n];
+        if (c == '0' || c == '1') {
+            if (j->address >= JEDEC_MAX_FUSES) {
+                return -1;
+            }
+            jedecSetFuses(j, j->address++, c - '0', 1);
+        } else if (!isspace(c)) {
+            break;
+        }
+    }
+    return n;
+}
+
+static int hexValue(char c) {
+    if (isdigit(c)) {
+        return c - '0';
+    }
+    c = toupper(c);
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Parses the next part of the JEDEC data. The data can be split at any position,
+// call the function repeatedly with consecutive parts of the file.
+// Returns JEDEC_OK or JEDEC_ERROR (see errorPosition).
+int jedecParse(JedecFile* j, const char* data, long size) {
+    long n;
+
+    if (j->errorPosition >= 0) {
+        return JEDEC_ERROR;
+    }
+
+    for (n = 0; n < size; n++) {
+        char c = data[n];
+
+        // the fuse values are the bulk of the file
+        if (j->state == ST_L_FUSES) {
+            long used = parseFuses(j, data + n, size - n);
+            if (used < 0) {
+                goto error;
+            }
+            n += used;
+            if (n == size) {
+                break;
+            }
+            c = data[n];
+        }
+
+        if (c == '*') {
+            j->state = ST_FIELD;
+            continue;
+        }
+
+        switch (j->state) {
+        case ST_FIELD:
+            if (!isspace(c))
+                switch (c) {
+                case 'L':
+                    j->address = 0;
+                    j->state = ST_L_FIRST;
+                    break;
+                case 'F':
+                    j->state = ST_F;
+                    break;
+                case 'G':
+                    j->state = ST_G;
+                    break;
+                case 'Q':
+                    j->state = ST_Q;
+                    break;
+                case 'C':
+                    j->state = ST_C_FIRST;
+                    break;
+                default:
+                    j->state = ST_SKIP;
+                }
+            break;
+        case ST_L_FIRST:
+            if (!isdigit(c)) {
+                goto error;
+            }
+            j->address = c - '0';
+            j->state = ST_L_ADDRESS;
+            break;
+        case ST_L_ADDRESS:
+            if (isspace(c)) {
+                j->state = ST_L_FUSES;
+            } else if (isdigit(c) && j->address < JEDEC_MAX_FUSES) {
+                j->address = 10 * j->address + (c - '0');
+            } else {
+                goto error;
+            }
+            break;
+        case ST_F:
+            if (isspace(c)) break; // ignored
+            if (c == '0' || c == '1') {
+                jedecClear(j, c - '0');
+            } else {
+                goto error;
+            }
+            j->state = ST_SKIP;
+            break;
+        case ST_L_FUSES:
+            // any other character than fuse value, white space or '*'
+            goto error;
+        case ST_Q:
+            if (isspace(c)) break; // ignored
+            if (c == 'P') {
+                j->pins = 0;
+                j->state = ST_QP_FIRST;
+            } else if (c == 'F') {
+                j->fuseCount = 0;
+                j->state = ST_QF_FIRST;
+            } else {
+                j->state = ST_FIELD;
+            }
+            break;
+        case ST_QP_FIRST:
+            if (isspace(c)) break; // ignored
+            if (!isdigit(c)) goto error;
+            j->pins = c - '0';
+            j->state = ST_QP;
+            break;
+        case ST_QF_FIRST:
+            if (isspace(c)) break; // ignored
+            if (!isdigit(c)) goto error;
+            j->fuseCount = c - '0';
+            j->state = ST_QF;
+            break;
+        case ST_QP:
+            if (isdigit(c)) {
+                j->pins = 10 * j->pins + (c - '0');
+            } else if (isspace(c)) {
+                j->state = ST_Q_END;
+            } else {
+                goto error;
+            }
+            break;
+        case ST_QF:
+            if (isdigit(c)) {
+                j->fuseCount = 10 * j->fuseCount + (c - '0');
+            } else if (isspace(c)) {
+                j->state = ST_Q_END;
+            } else {
+                goto error;
+            }
+            break;
+        case ST_Q_END:
+            if (!isspace(c)) {
+                goto error;
+            }
+            break;
+        case ST_G:
+            if (isspace(c)) break; // ignored
+            if (c == '0' || c == '1') {
+                j->security = c - '0';
+            } else {
+                goto error;
+            }
+            j->state = ST_SKIP;
+            break;
+        case ST_C_FIRST:
+            if (isspace(c)) break; // ignored
+            if (hexValue(c) < 0) goto error;
+            j->checksum = hexValue(c);
+            j->state = ST_C;
+            break;
+        case ST_C:
+            if (hexValue(c) >= 0) {
+                j->checksum = 16 * j->checksum + hexValue(c);
+            } else if (isspace(c)) {
+                j->state = ST_FIELD;
+            } else {
+                goto error;
+            }
+            break;
+        }
+    }
+    j->position += size;
+    return JEDEC_OK;
+
+error:
+    j->errorPosition = j->position + n;
+    j->position += n;
+    return JEDEC_ERROR;
+}
+
+// Parses the JEDEC file by chunks, the file size is not limited.
+// Returns JEDEC_OK, JEDEC_ERROR or -2 when the file can not be read.
+int jedecReadFile(JedecFile* j, const char* fileName) {
+    char* buf;
+    FILE* f;
+    long size;
+    int result = JEDEC_OK;
+
+    f = fopen(fileName, "rb");
+    if (f == NULL) {
+        return -2;
+    }
+    buf = (char*) malloc(READ_CHUNK);
+    if (buf == NULL) {
+        fclose(f);
+        return -2;
+    }
+    while (result == JEDEC_OK && (size = fread(buf, 1, READ_CHUNK, f)) > 0) {
+        result = jedecParse(j, buf, size);
+    }
+    if (ferror(f)) {
+        result = -2;
+    }
+    free(buf);
+    fclose(f);
+    return result;
+}
+
+// JEDEC checksum: 16 bit sum of the fuse map bytes, fuse 0 is bit 0 of the first byte.
+// The fuse bytes are summed 8 at a time: 4 partial sums in 16 bit lanes of a 64 bit word.
+unsigned short jedecChecksum(const JedecFile* j, int fuses) {
+    const uint64_t lanes = 0x00FF00FF00FF00FFULL;
+    uint64_t sum = 0;
+    uint64_t total = 0;
+    int words = fuses >> 6;
+    int i;
+
+    for (i = 0; i < words; i++) {
+        uint64_t w = j->fuse[i];
+        sum += (w & lanes) + ((w >> 8) & lanes);
+        // a lane grows by max 510 per word: fold before it overflows
+        if ((i & 127) == 127) {
+            total += (sum & 0xFFFF) + ((sum >> 16) & 0xFFFF) + ((sum >> 32) & 0xFFFF) + (sum >> 48);
+            sum = 0;
+        }
+    }
+    if (fuses & 63) {
+        uint64_t w = j->fuse[words] & ((1ULL << (fuses & 63)) - 1);
+        sum += (w & lanes) + ((w >> 8) & lanes);
+    }
+    total += (sum & 0xFFFF) + ((sum >> 16) & 0xFFFF) + ((sum >> 32) & 0xFFFF) + (sum >> 48);
+    return (unsigned short) total;
+}
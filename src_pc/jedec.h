@@ -0,0 +1,43 @@
+/*
+
+ JEDEC : fuse map parser and bit-packed fuse map storage
+
+ part of Afterburner GAL project
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// ATF1504AS has 34192 fuses
+#define JEDEC_MAX_FUSES 40000
+#define JEDEC_WORDS ((JEDEC_MAX_FUSES + 63) / 64)
+
+// parse result codes
+#define JEDEC_OK 0
+#define JEDEC_ERROR -1
+
+typedef struct {
+    uint64_t fuse[JEDEC_WORDS]; // fuse N is bit (N & 63) of fuse[N >> 6]
+    int pins;                   // QP field, 0 if not present
+    int fuseCount;              // QF field, 0 if not present
+    int security;               // G field
+    unsigned short checksum;    // C field, 0 if not present
+
+    // parser state: the input can be split at any position
+    int state;
+    int address;
+    long position;              // offset of the next input character
+    long errorPosition;         // offset of the offending character, -1 if no error
+} JedecFile;
+
+#define jedecGetFuse(J, N) ((int) (((J)->fuse[(N) >> 6] >> ((N) & 63)) & 1))
+#define jedecSetFuse(J, N, V) jedecSetFuses(J, N, (V) ? 1 : 0, 1)
+
+void jedecInit(JedecFile* j);
+void jedecClear(JedecFile* j, int value);
+void jedecSetFuses(JedecFile* j, int address, uint64_t bits, int count);
+int jedecParse(JedecFile* j, const char* data, long size);
+int jedecReadFile(JedecFile* j, const char* fileName);
+unsigned short jedecChecksum(const JedecFile* j, int fuses);
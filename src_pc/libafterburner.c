@@ -0,0 +1,1064 @@
+/*
+
+ LIBAFTERBURNER : programmer connection and GAL operations
+
+ part of Afterburner GAL project
+
+*/
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "serial_port.h"
+#include "libafterburner.h"
+
+#define MAX_COMMAND 128
+#define RESPONSE_SIZE (256 * 1024)
+
+// internal step flags: the step queries the timing or the VPP log of the last GAL command
+#define STEP_TIMING 0x100
+#define STEP_VPP_LOG 0x200
+
+// one command sent to the programmer and its response
+typedef struct {
+    char command[MAX_COMMAND];  // empty command only reads the serial line
+    int maxDelay;               // response timeout in milliseconds
+    int flags;                  // AFB_CMD_xxx
+    int progress;               // reported by the progress callback when finished, -1: none
+} AfbStep;
+
+struct AfbProgrammer {
+    SerialDeviceHandle handle;
+    char deviceName[256];
+    char version[64];
+    int features;
+    char verbose;
+
+    AfbProgressFunc progressFunc;
+    AfbOutputFunc outputFunc;
+    void* user;
+
+    // the queued operation
+    AfbStep* steps;
+    int stepCount;
+    int stepMax;
+    int stepIndex;
+    const char* progressLabel;
+    int progressTotal;
+    char busy;
+    char inFlight;
+    long stepStart;
+    AfbResult result;
+
+    // response of the current step
+    char* response;
+    int responseLen;
+    int streamPos;
+    char promptFound;
+    char* responseText;
+
+    // error response of the last operation
+    int status;
+    char statusText[128];
+
+    // collected command timings
+    char timing;
+    AfbTiming* timings;
+    int timingCount;
+    int timingMax;
+
+    // collected VPP logs of the pulses
+    char vppLog;
+    AfbVppPulse* vppPulses;
+    int vppPulseCount;
+    int vppPulseMax;
+
+    // serial traffic trace
+    FILE* trace;
+    long long traceTime;
+    long long traceEmptyRead;   // time of the last read without data, 0: none since the last record
+};
+
+const AfbGalInfo afbGalInfo[] = {
+    {AFB_GAL_UNKNOWN,   0x00, 0x00, "unknown",     0, 0, 0,  0, 0,   0, 0, 0, 0, 0, 8, 0, 0},
+    {AFB_GAL16V8,   0x00, 0x1A, "GAL16V8",  2194, 20, 32, 64, 32, 2056, 8, 63, 54, 58, 8, 60, 82},
+    {AFB_GAL18V10,  0x50, 0x51, "GAL18V10", 3540, 20, 36, 96, 36, 3476, 8, 61, 60, 58, 10, 16, 20},
+    {AFB_GAL20V8,   0x20, 0x3A, "GAL20V8",  2706, 24, 40, 64, 40, 2568, 8, 63, 59, 58, 8, 60, 82},
+    {AFB_GAL20RA10, 0x60, 0x61, "GAL20RA10", 3274, 24, 40, 80, 40, 3210, 8, 61, 60, 58, 10, 16, 10},
+    {AFB_GAL20XV10, 0x65, 0x66, "GAL20XV10", 1671, 24, 40,  40, 44, 1631, 5, 61, 60, 58,  5, 16, 31},
+    {AFB_GAL22V10,  0x48, 0x49, "GAL22V10", 5892, 24, 44, 132, 44, 5828, 8, 61, 60, 58, 10, 16, 20},
+    {AFB_GAL26CV12, 0x58, 0x59, "GAL26CV12", 6432, 28, 52, 122, 52, 6368, 8, 61, 60, 58, 12, 16, 24},
+    {AFB_GAL26V12,  0x5D, 0x5D, "GAL26V12",  7912, 28, 52, 150, 52, 7848, 8, 61, 60, 58, 12, 16, 48},
+    {AFB_GAL6001,   0x40, 0x41, "GAL6001", 8294, 24, 78, 75, 97, 8222, 9, 63, 62, 96, 8, 8, 68},
+    {AFB_GAL6002,   0x44, 0x44, "GAL6002", 8330, 24, 78, 75, 97, 8258, 9, 63, 62, 96, 8, 8, 104},
+    {AFB_ATF16V8B,  0x00, 0x00, "ATF16V8B", 2194, 20, 32, 64, 32, 2056, 8, 63, 54, 58, 8, 60, 82},
+    {AFB_ATF20V8B,  0x00, 0x00, "ATF20V8B",  2706, 24, 40, 64, 40, 2568, 8, 63, 59, 58, 8, 60, 82},
+    {AFB_ATF22V10B, 0x00, 0x00, "ATF22V10B", 5892, 24, 44, 132, 44, 5828, 8, 61, 60, 58, 10, 16, 20},
+    {AFB_ATF22V10C, 0x00, 0x00, "ATF22V10C", 5892, 24, 44, 132, 44, 5828, 8, 61, 60, 58, 10, 16, 20},
+    {AFB_ATF750C,   0x00, 0x00, "ATF750C",  14499, 24, 84, 171, 84, 14435, 8, 61, 60, 127, 10, 16, 71},
+    {AFB_PEEL18CV8, 0x00, 0x00, "PEEL18CV8", 2696, 24, 36,  74, 0,    0,   0, 0, 0, 0, 0, 0, 0},
+    {AFB_ATF1502AS, AFB_JTAG_ID, AFB_JTAG_ID, "ATF1502AS", 16808, 44, 0,  0, 0,   0, 0, 0, 0, 0, 8, 0, 0},
+    {AFB_ATF1504AS, AFB_JTAG_ID, AFB_JTAG_ID, "ATF1504AS", 34192, 44, 0,  0, 0,   0, 0, 0, 0, 0, 8, 0, 0},
+};
+
+const int afbGalInfoCount = sizeof(afbGalInfo) / sizeof(afbGalInfo[0]);
+
+long afbTimeMs(void) {
+#ifdef _USE_WIN_API_
+    return (long) GetTickCount();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000L + t.tv_nsec / 1000000L;
+#endif
+}
+
+// monotonic time in microseconds for the trace records
+static long long timeUs(void) {
+#ifdef _USE_WIN_API_
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return count.QuadPart * 1000000LL / freq.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000LL + t.tv_nsec / 1000;
+#endif
+}
+
+static void output(AfbProgrammer* p, const char* format, ...) {
+    char buf[512];
+    va_list args;
+
+    if (p->outputFunc == NULL) {
+        return;
+    }
+    va_start(args, format);
+    vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    p->outputFunc(p->user, buf);
+}
+
+/* -------------------- design -------------------- */
+
+static void designFinish(AfbDesign* d, AfbGalType gal) {
+    d->gal = gal;
+    d->calculatedChecksum = jedecChecksum(&d->jedec, d->jedec.fuseCount);
+    d->apdFuse = 0;
+    if (d->jedec.fuseCount == 2195 && gal == AFB_ATF16V8B) {
+        d->apdFuse = jedecGetFuse(&d->jedec, 2194);
+    }
+    if (d->jedec.fuseCount == 5893 && gal == AFB_ATF22V10C) {
+        d->apdFuse = jedecGetFuse(&d->jedec, 5892);
+    }
+}
+
+AfbResult afbDesignLoadFile(AfbDesign* d, AfbGalType gal, const char* fileName) {
+    int result;
+
+    jedecInit(&d->jedec);
+    result = jedecReadFile(&d->jedec, fileName);
+    if (result == -2) {
+        return AFB_ERR_FILE;
+    }
+    if (result != JEDEC_OK) {
+        return AFB_ERR_PARSE;
+    }
+    designFinish(d, gal);
+    return AFB_OK;
+}
+
+AfbResult afbDesignLoadBuffer(AfbDesign* d, AfbGalType gal, const char* data, long size) {
+    jedecInit(&d->jedec);
+    if (jedecParse(&d->jedec, data, size) != JEDEC_OK) {
+        return AFB_ERR_PARSE;
+    }
+    designFinish(d, gal);
+    return AFB_OK;
+}
+
+/* -------------------- programmer -------------------- */
+
+AfbProgrammer* afbCreate(void) {
+    AfbProgrammer* p = (AfbProgrammer*) calloc(1, sizeof(AfbProgrammer));
+    if (p == NULL) {
+        return NULL;
+    }
+    p->response = (char*) malloc(RESPONSE_SIZE);
+    if (p->response == NULL) {
+        free(p);
+        return NULL;
+    }
+    p->response[0] = 0;
+    p->responseText = p->response;
+    p->handle = INVALID_HANDLE;
+    return p;
+}
+
+void afbDestroy(AfbProgrammer* p) {
+    if (p == NULL) {
+        return;
+    }
+    afbClose(p);
+    afbSetTrace(p, NULL);
+    free(p->steps);
+    free(p->response);
+    free(p->timings);
+    free(p->vppPulses);
+    free(p);
+}
+
+void afbSetCallbacks(AfbProgrammer* p, AfbProgressFunc progress, AfbOutputFunc output, void* user) {
+    p->progressFunc = progress;
+    p->outputFunc = output;
+    p->user = user;
+}
+
+void afbSetVerbose(AfbProgrammer* p, char verbose) {
+    p->verbose = verbose;
+}
+
+void afbSetTiming(AfbProgrammer* p, char enable) {
+    p->timing = enable;
+}
+
+int afbGetTimingCount(const AfbProgrammer* p) {
+    return p->timingCount;
+}
+
+const AfbTiming* afbGetTiming(const AfbProgrammer* p, int index) {
+    return (index >= 0 && index < p->timingCount) ? &p->timings[index] : NULL;
+}
+
+void afbClearTimings(AfbProgrammer* p) {
+    p->timingCount = 0;
+}
+
+void afbSetVppLog(AfbProgrammer* p, char enable) {
+    p->vppLog = enable;
+}
+
+int afbGetVppPulseCount(const AfbProgrammer* p) {
+    return p->vppPulseCount;
+}
+
+const AfbVppPulse* afbGetVppPulse(const AfbProgrammer* p, int index) {
+    return (index >= 0 && index < p->vppPulseCount) ? &p->vppPulses[index] : NULL;
+}
+
+AfbResult afbSetTrace(AfbProgrammer* p, const char* fileName) {
+    if (p->trace != NULL) {
+        fclose(p->trace);
+        p->trace = NULL;
+    }
+    if (fileName == NULL) {
+        return AFB_OK;
+    }
+    p->trace = fopen(fileName, "wb");
+    if (p->trace == NULL) {
+        output(p, "Error: failed to create trace file: %s\n", fileName);
+        return AFB_ERR_FILE;
+    }
+    fwrite(AFB_TRACE_MAGIC, 1, AFB_TRACE_MAGIC_SIZE, p->trace);
+    p->traceTime = timeUs();
+    return AFB_OK;
+}
+
+int afbIsOpen(const AfbProgrammer* p) {
+    return p != NULL && p->handle != INVALID_HANDLE;
+}
+
+int afbGetFeatures(const AfbProgrammer* p) {
+    return p->features;
+}
+
+const char* afbGetVersion(const AfbProgrammer* p) {
+    return p->version;
+}
+
+const char* afbGetResponse(const AfbProgrammer* p) {
+    return p->responseText;
+}
+
+int afbGetStatus(const AfbProgrammer* p) {
+    return p->status;
+}
+
+const char* afbGetStatusText(const AfbProgrammer* p) {
+    return p->statusText;
+}
+
+const char* afbGetResultText(AfbResult result) {
+    switch (result) {
+    case AFB_OK: return "OK";
+    case AFB_PENDING: return "operation in progress";
+    case AFB_ERR_DEVICE: return "programmer reported an error";
+    case AFB_ERR_OPEN: return "failed to open serial device";
+    case AFB_ERR_IO: return "serial device read / write failed";
+    case AFB_ERR_NO_PROGRAMMER: return "programmer not recognised";
+    case AFB_ERR_BUSY: return "programmer is busy";
+    case AFB_ERR_ARGS: return "invalid parameters";
+    case AFB_ERR_FILE: return "failed to read file";
+    case AFB_ERR_PARSE: return "invalid JEDEC file";
+    case AFB_ERR_MEMORY: return "out of memory";
+    }
+    return "unknown error";
+}
+
+static int checkPromptExists(char* buf, int bufSize) {
+    int i;
+    for (i = 0; i < bufSize - 2 && buf[i] != 0; i++) {
+        if (buf[i] == '>' && buf[i+1] == '\r' && buf[i+2] == '\n') {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static char* stripPrompt(char* buf) {
+    int len;
+    int i;
+    if (buf == 0) {
+        return 0;
+    }
+    len = strlen(buf);
+    i  = checkPromptExists(buf, len);
+    if (i >= 0) {
+        buf[i] = 0;
+        len = i;
+    }
+
+    //strip rear new line characters
+    for (i = len - 1; i >= 0; i--) {
+        if (buf[i] != '\r' && buf[i] != '\n') {
+            break;
+        } else {
+            buf[i] = 0;
+        }
+    }
+
+    //strip frontal new line characters
+    for (i = 0; buf[i] != 0; i++) {
+        if (buf[0] == '\r' || buf[0] == '\n') {
+            buf++;
+        }
+    }
+    return buf;
+}
+
+//finds beginnig of the last line
+static char* findLastLine(char* buf) {
+    int i;
+    char* result = buf;
+
+    if (buf == 0) {
+        return 0;
+    }
+    for (i = 0; buf[i] != 0; i++) {
+        if (buf[i] == '\r' || buf[i] == '\n') {
+            result = buf + i + 1;
+        }
+    }
+    return result;
+}
+
+/* -------------------- operation queue -------------------- */
+
+static AfbResult beginOperation(AfbProgrammer* p, const char* progressLabel, int progressTotal) {
+    if (!afbIsOpen(p)) {
+        return AFB_ERR_OPEN;
+    }
+    if (p->busy) {
+        return AFB_ERR_BUSY;
+    }
+    p->stepCount = 0;
+    p->stepIndex = 0;
+    p->progressLabel = progressLabel;
+    p->progressTotal = progressTotal;
+    p->inFlight = 0;
+    p->result = AFB_OK;
+    p->status = AFB_STATUS_NONE;
+    p->statusText[0] = 0;
+    return AFB_OK;
+}
+
+static AfbStep* addStep(AfbProgrammer* p, int maxDelay, int flags, const char* format, ...) {
+    AfbStep* s;
+    va_list args;
+
+    if (p->stepCount == p->stepMax) {
+        int max = p->stepMax ? p->stepMax * 2 : 64;
+        AfbStep* steps = (AfbStep*) realloc(p->steps, max * sizeof(AfbStep));
+        if (steps == NULL) {
+            p->result = AFB_ERR_MEMORY;
+            return NULL;
+        }
+        p->steps = steps;
+        p->stepMax = max;
+    }
+    s = &p->steps[p->stepCount++];
+    va_start(args, format);
+    vsnprintf(s->command, MAX_COMMAND, format, args);
+    va_end(args);
+    s->maxDelay = maxDelay;
+    s->flags = flags;
+    s->progress = -1;
+    return s;
+}
+
+// GAL command, followed by the timing and VPP log queries when they are collected
+static AfbStep* addGalStep(AfbProgrammer* p, int maxDelay, int flags, const char* command) {
+    AfbStep* s = addStep(p, maxDelay, flags, "%s", command);
+    int index = p->stepCount - 1;
+
+    if (s != NULL && p->timing && (p->features & AFB_FEATURE_TIMING)) {
+        addStep(p, 300, STEP_TIMING, "T\r");
+    }
+    if (s != NULL && p->vppLog && (p->features & AFB_FEATURE_VPP_LOG)) {
+        addStep(p, 2000, STEP_VPP_LOG, "L\r");
+    }
+    // addStep() might have moved the steps
+    return s != NULL ? &p->steps[index] : NULL;
+}
+
+static AfbResult startOperation(AfbProgrammer* p) {
+    if (p->result != AFB_OK) {
+        return p->result;
+    }
+    p->busy = 1;
+    return AFB_PENDING;
+}
+
+static AfbResult finishOperation(AfbProgrammer* p, AfbResult result) {
+    p->busy = 0;
+    p->inFlight = 0;
+    p->result = result;
+    return result;
+}
+
+/* -------------------- serial layer -------------------- */
+
+static void traceRecord(AfbProgrammer* p, char type, const char* data, int size, long long time) {
+    unsigned long delta = (unsigned long) (time - p->traceTime);
+
+    p->traceTime = time;
+    p->traceEmptyRead = 0;
+    // large reads are split into several records, the next ones have zero time delta
+    do {
+        unsigned char h[AFB_TRACE_HEADER_SIZE];
+        int len = (size > 0xFFFF) ? 0xFFFF : size;
+
+        h[0] = type;
+        h[1] = delta & 0xFF;
+        h[2] = (delta >> 8) & 0xFF;
+        h[3] = (delta >> 16) & 0xFF;
+        h[4] = (delta >> 24) & 0xFF;
+        h[5] = len & 0xFF;
+        h[6] = (len >> 8) & 0xFF;
+        fwrite(h, 1, AFB_TRACE_HEADER_SIZE, p->trace);
+        fwrite(data, 1, len, p->trace);
+        data += len;
+        size -= len;
+        delta = 0;
+    } while (size > 0);
+}
+
+static int serialWrite(AfbProgrammer* p, const char* buf, int size) {
+    int writeSize = serialDeviceWrite(p->handle, (char*) buf, size);
+    if (p->trace != NULL && writeSize > 0) {
+        traceRecord(p, AFB_TRACE_WRITE, buf, writeSize, timeUs());
+    }
+    return writeSize;
+}
+
+static int serialRead(AfbProgrammer* p, char* buf, int size) {
+    int readSize = serialDeviceRead(p->handle, buf, size);
+    if (p->trace == NULL) {
+        return readSize;
+    }
+    if (readSize <= 0) {
+        p->traceEmptyRead = timeUs();
+    } else {
+        // the data arrived between the last empty read and now: the replay needs both times
+        if (p->traceEmptyRead) {
+            traceRecord(p, AFB_TRACE_READ, NULL, 0, p->traceEmptyRead);
+        }
+        traceRecord(p, AFB_TRACE_READ, buf, readSize, timeUs());
+    }
+    return readSize;
+}
+
+static AfbResult sendCommand(AfbProgrammer* p, const char* buf) {
+    int total = strlen(buf);
+    // file is opened non blocking so we have to ensure all contents is written
+    while (total > 0) {
+        int writeSize = serialWrite(p, buf, total);
+        if (writeSize < 0) {
+            output(p, "ERROR: written: %i (%s)\n", writeSize, strerror(errno));
+            return AFB_ERR_IO;
+        }
+        buf += writeSize;
+        total -= writeSize;
+    }
+    return AFB_OK;
+}
+
+// passes the received text up to the prompt to the output callback
+static void streamResponse(AfbProgrammer* p) {
+    int end = p->responseLen;
+    int prompt = checkPromptExists(p->response + p->streamPos, end - p->streamPos);
+    char* c = memchr(p->response + p->streamPos, '>', end - p->streamPos);
+
+    if (c != NULL) {
+        end = c - p->response;
+    } else if (prompt >= 0) {
+        end = p->streamPos + prompt;
+    }
+    if (end > p->streamPos && p->outputFunc != NULL) {
+        char keep = p->response[end];
+        p->response[end] = 0;
+        p->outputFunc(p->user, p->response + p->streamPos);
+        p->response[end] = keep;
+    }
+    // the text after '>' is not printed
+    p->streamPos = (c != NULL) ? p->responseLen : end;
+}
+
+// error response: "ER<2 digit code> text", older firmware sends "ER text"
+static void parseStatus(AfbProgrammer* p, const char* line) {
+    const char* text = line + 2;
+    int len;
+
+    if (isdigit((unsigned char) line[2]) && isdigit((unsigned char) line[3])) {
+        p->status = (line[2] - '0') * 10 + (line[3] - '0');
+        text += 2;
+    } else {
+        p->status = AFB_STATUS_OTHER;
+    }
+    while (*text == ' ' || *text == ':') {
+        text++;
+    }
+    len = strcspn(text, "\r\n");
+    if (len >= (int) sizeof(p->statusText)) {
+        len = sizeof(p->statusText) - 1;
+    }
+    memcpy(p->statusText, text, len);
+    p->statusText[len] = 0;
+}
+
+// timing response: "OK total:N shift:N power:N vpp:N strobe:N serial:N typecheck:N powerups:N"
+// (older firmware does not send the powerups)
+static void parseTiming(AfbProgrammer* p, const char* command) {
+    AfbTiming* t;
+
+    if (p->timingCount == p->timingMax) {
+        int max = p->timingMax ? p->timingMax * 2 : 32;
+        AfbTiming* timings = (AfbTiming*) realloc(p->timings, max * sizeof(AfbTiming));
+
+        if (timings == NULL) {
+            output(p, "Error: out of memory, the command timing is not collected\n");
+            return;
+        }
+        p->timings = timings;
+        p->timingMax = max;
+    }
+    t = &p->timings[p->timingCount];
+    t->powerUps = -1;
+    if (sscanf(p->responseText, "OK total:%ld shift:%ld power:%ld vpp:%ld strobe:%ld serial:%ld typecheck:%ld powerups:%ld",
+            &t->total, &t->shift, &t->power, &t->vpp, &t->strobe, &t->serial, &t->typeCheck, &t->powerUps) >= 7) {
+        t->command = command[0];
+        p->timingCount++;
+    }
+}
+
+static AfbVppPulse* addVppPulse(AfbProgrammer* p) {
+    if (p->vppPulseCount == p->vppPulseMax) {
+        int max = p->vppPulseMax ? p->vppPulseMax * 2 : 64;
+        AfbVppPulse* pulses = (AfbVppPulse*) realloc(p->vppPulses, max * sizeof(AfbVppPulse));
+
+        if (pulses == NULL) {
+            return NULL;
+        }
+        p->vppPulses = pulses;
+        p->vppPulseMax = max;
+    }
+    return &p->vppPulses[p->vppPulseCount++];
+}
+
+// VPP log response: "P pulse:N ms:N samples:N min:N max:N mean:N" per pulse, "D pulse:N us:N V V ..."
+// with the waveform of the last pulses ('-': no sample in the slot) and "OK pulses:N"
+static void parseVppLog(AfbProgrammer* p, const char* command) {
+    char* line = p->responseText;
+
+    while (line != NULL && *line != 0) {
+        AfbVppPulse* v = p->vppPulseCount ? &p->vppPulses[p->vppPulseCount - 1] : NULL;
+        AfbVppPulse tmp;
+        int pulse;
+        int slotUs;
+        int pos;
+
+        if (sscanf(line, "P pulse:%d ms:%d samples:%d min:%d max:%d mean:%d", &tmp.pulse, &tmp.ms,
+                &tmp.samples, &tmp.min, &tmp.max, &tmp.mean) == 6) {
+            v = addVppPulse(p);
+            if (v == NULL) {
+                return;
+            }
+            *v = tmp;
+            v->command = command[0];
+            v->slotUs = 0;
+            v->waveCount = 0;
+        } else if (sscanf(line, "D pulse:%d us:%d%n", &pulse, &slotUs, &pos) == 2 && v != NULL && v->pulse == pulse) {
+            char* t = line + pos;
+
+            v->slotUs = slotUs;
+            while (v->waveCount < AFB_VPP_LOG_SAMPLES) {
+                while (*t == ' ') {
+                    t++;
+                }
+                if (*t == '-') {
+                    v->wave[v->waveCount++] = -1;
+                    t++;
+                } else if (*t >= '0' && *t <= '9') {
+                    v->wave[v->waveCount++] = (int) strtol(t, &t, 10);
+                } else {
+                    break;
+                }
+            }
+        }
+        line = strpbrk(line, "\r\n");
+        while (line != NULL && (*line == '\r' || *line == '\n')) {
+            line++;
+        }
+    }
+}
+
+static AfbResult finishStep(AfbProgrammer* p, AfbStep* s) {
+    char* lastLine;
+
+    p->inFlight = 0;
+    p->responseText = stripPrompt(p->response);
+    if (p->verbose) {
+        output(p, "read: %i '%s'\n", p->responseLen, p->responseText);
+    }
+    lastLine = findLastLine(p->responseText);
+    if ((s->flags & AFB_CMD_CHECK) && (lastLine[0] == 'E' && lastLine[1] == 'R')) {
+        output(p, "%s\n", p->responseText);
+        parseStatus(p, lastLine);
+        return finishOperation(p, AFB_ERR_DEVICE);
+    }
+    if ((s->flags & AFB_CMD_PRINT) && !(s->flags & AFB_CMD_STREAM)) {
+        output(p, "%s\n", p->responseText);
+    }
+    if ((s->flags & STEP_TIMING) && p->stepIndex > 0) {
+        parseTiming(p, p->steps[p->stepIndex - 1].command);
+    }
+    if (s->flags & STEP_VPP_LOG) {
+        int i = p->stepIndex - 1;
+
+        while (i > 0 && (p->steps[i].flags & STEP_TIMING)) {
+            i--;
+        }
+        if (i >= 0) {
+            parseVppLog(p, p->steps[i].command);
+        }
+    }
+    if (s->progress >= 0 && p->progressFunc != NULL) {
+        p->progressFunc(p->user, p->progressLabel, s->progress, p->progressTotal);
+    }
+    p->stepIndex++;
+    if (p->stepIndex >= p->stepCount) {
+        return finishOperation(p, AFB_OK);
+    }
+    return AFB_PENDING;
+}
+
+// Advances the queued operation without waiting: sends the next command and / or
+// reads the available part of the response.
+AfbResult afbPoll(AfbProgrammer* p) {
+    AfbStep* s;
+    int readSize;
+
+    if (!p->busy) {
+        return p->result;
+    }
+    s = &p->steps[p->stepIndex];
+
+    if (!p->inFlight) {
+        AfbResult r;
+        p->responseLen = 0;
+        p->streamPos = 0;
+        p->promptFound = 0;
+        p->response[0] = 0;
+        r = sendCommand(p, s->command);
+        if (r != AFB_OK) {
+            return finishOperation(p, r);
+        }
+        p->inFlight = 1;
+        p->stepStart = afbTimeMs();
+    }
+
+    readSize = serialRead(p, p->response + p->responseLen, RESPONSE_SIZE - 1 - p->responseLen);
+    if (readSize > 0) {
+        p->responseLen += readSize;
+        p->response[p->responseLen] = 0;
+        if (p->responseLen >= RESPONSE_SIZE - 1) {
+            output(p, "ERROR: serial port read buffer is too small!\nAre you dumping large amount of data?\n");
+            return finishOperation(p, AFB_ERR_MEMORY);
+        }
+        if (s->flags & AFB_CMD_STREAM) {
+            streamResponse(p);
+        }
+        if (checkPromptExists(p->response, p->responseLen) >= 0) {
+            p->promptFound = 1;
+            return finishStep(p, s);
+        }
+    }
+    if (afbTimeMs() - p->stepStart >= s->maxDelay) {
+        // no prompt: the response might be incomplete, but it is still evaluated
+        if (p->verbose && s->command[0]) {
+            output(p, "waitForSerialPrompt timed out\n");
+        }
+        return finishStep(p, s);
+    }
+    return AFB_PENDING;
+}
+
+AfbResult afbWait(AfbProgrammer* p) {
+    AfbResult result;
+
+    while ((result = afbPoll(p)) == AFB_PENDING) {
+        /* WIN_API handles timeout itself */
+#ifndef _USE_WIN_API_
+        // the next command is sent without delay when the response was received
+        if (p->inFlight) {
+            usleep(10 * 1000);
+        }
+#endif
+    }
+    return result;
+}
+
+int afbIsWaiting(const AfbProgrammer* p) {
+    return p->busy && p->inFlight;
+}
+
+/* -------------------- connection -------------------- */
+
+static char checkForString(char* buf, int start, const char* key) {
+    int labelPos = strstr(buf + start, key) -  buf;
+    return (labelPos > 0 && labelPos < 500) ? 1 : 0;
+}
+
+// opens the serial device and checks the Afterburner programmer responds
+AfbResult afbOpen(AfbProgrammer* p, const char* deviceName) {
+    char* guessedName = NULL;
+    int retry = 4;
+
+    if (afbIsOpen(p)) {
+        return AFB_OK;
+    }
+
+    //open device name, the guessed name is reused when the programmer is re-opened
+    if (deviceName == NULL && p->deviceName[0] == 0) {
+        serialDeviceGuessName(&guessedName);
+        deviceName = guessedName;
+    }
+    if (deviceName != NULL || p->deviceName[0] == 0) {
+        snprintf(p->deviceName, sizeof(p->deviceName), "%s", (deviceName == NULL) ? DEFAULT_SERIAL_DEVICE_NAME : deviceName);
+        serialDeviceCheckName(p->deviceName, sizeof(p->deviceName));
+    }
+
+    if (p->verbose) {
+        output(p, "opening serial: %s\n", p->deviceName);
+    }
+
+    while (retry) {
+        char* buf;
+        int labelPos;
+
+        retry--;
+        p->handle = serialDeviceOpen(p->deviceName);
+        if (p->handle == INVALID_HANDLE) {
+            output(p, "Error: failed to open serial device: %s\n", p->deviceName);
+            return AFB_ERR_OPEN;
+        }
+        if (p->trace != NULL) {
+            traceRecord(p, AFB_TRACE_OPEN, p->deviceName, strlen(p->deviceName), timeUs());
+        }
+
+        beginOperation(p, "", 0);
+#ifndef _USE_WIN_API_
+        //read garbage
+        addStep(p, 4, 0, "");
+#endif
+        // prod the programmer to output it's identification
+        addStep(p, 1000, 0, "*\r");
+        startOperation(p);
+        // the response is evaluated here, the verbose print is not wanted
+        {
+            char verbose = p->verbose;
+            p->verbose = 0;
+            afbWait(p);
+            p->verbose = verbose;
+        }
+        buf = p->responseText;
+
+        //check we are communicating with Afterburner programmer
+        labelPos = strstr(buf, "AFTerburner v.") -  buf;
+
+        p->features = 0;
+        if (labelPos >= 0 && labelPos < 500 && p->promptFound) {
+            char* end;
+            snprintf(p->version, sizeof(p->version), "%s", buf + labelPos + 12);
+            end = strpbrk(p->version, " \r\n");
+            if (end != NULL) {
+                *end = 0;
+            }
+            // check for new board desgin: variable VPP
+            if (checkForString(buf, labelPos, " varVpp ")) {
+                p->features |= AFB_FEATURE_VAR_VPP;
+                if (p->verbose) {
+                    output(p, "variable VPP board detected\n");
+                }
+            }
+            // check for Big Ram
+            if (checkForString(buf, labelPos, " RAM-BIG")) {
+                p->features |= AFB_FEATURE_BIG_RAM;
+                if (p->verbose) {
+                    output(p, "MCU Big RAM detected\n");
+                }
+            }
+            // check for native ATF150x programming support
+            if (checkForString(buf, labelPos, " JTAG-ISP ")) {
+                p->features |= AFB_FEATURE_JTAG_ISP;
+            }
+            // check for packed XSVF support
+            if (checkForString(buf, labelPos, " XSVF-PACK ")) {
+                p->features |= AFB_FEATURE_XSVF_PACK;
+            }
+            // check for the command timing support
+            if (checkForString(buf, labelPos, " TIMING ")) {
+                p->features |= AFB_FEATURE_TIMING;
+            }
+            // check for the exerciser's vector table support
+            if (checkForString(buf, labelPos, " EXE-BATCH ")) {
+                p->features |= AFB_FEATURE_EXE_BATCH;
+            }
+            // check for the exerciser's signature test
+            if (checkForString(buf, labelPos, " EXE-SIG ")) {
+                p->features |= AFB_FEATURE_EXE_SIG;
+            }
+            // check for the VPP log of the programming pulses
+            if (checkForString(buf, labelPos, " VPP-LOG ")) {
+                p->features |= AFB_FEATURE_VPP_LOG;
+            }
+            //all OK
+            p->response[0] = 0;
+            p->responseText = p->response;
+            return AFB_OK;
+        }
+        if (p->verbose) {
+            output(p, "Output from programmer not recognised (%d): %s\n", labelPos, buf);
+            output(p, "--------------\n");
+        }
+        serialDeviceClose(p->handle);
+        p->handle = INVALID_HANDLE;
+    }
+    return AFB_ERR_NO_PROGRAMMER;
+}
+
+void afbClose(AfbProgrammer* p) {
+    if (!afbIsOpen(p)) {
+        return;
+    }
+    serialDeviceClose(p->handle);
+    p->handle = INVALID_HANDLE;
+    p->busy = 0;
+    if (p->trace != NULL) {
+        fflush(p->trace);
+    }
+}
+
+int afbWriteRaw(AfbProgrammer* p, const char* data, int size) {
+    return serialWrite(p, data, size);
+}
+
+int afbReadRaw(AfbProgrammer* p, char* buf, int size) {
+    return serialRead(p, buf, size);
+}
+
+/* -------------------- operations -------------------- */
+
+AfbResult afbCommandStart(AfbProgrammer* p, const char* command, int maxDelay, int flags) {
+    AfbResult r = beginOperation(p, "", 0);
+    if (r != AFB_OK) {
+        return r;
+    }
+    if (strlen(command) >= MAX_COMMAND) {
+        return AFB_ERR_ARGS;
+    }
+    addStep(p, maxDelay, flags, "%s", command);
+    return startOperation(p);
+}
+
+AfbResult afbSetGalCheckStart(AfbProgrammer* p, char check) {
+    return afbCommandStart(p, check ? "f\r" : "F\r", 4000, AFB_CMD_CHECK);
+}
+
+AfbResult afbSetGalTypeStart(AfbProgrammer* p, AfbGalType gal) {
+    char buf[8];
+    sprintf(buf, "g%c\r", '0' + (int) gal);
+    return afbCommandStart(p, buf, 4000, AFB_CMD_CHECK);
+}
+
+// upload mode: sets the GAL type, the texts returned by the programmer are discarded
+static void addSetType(AfbProgrammer* p, AfbGalType gal, int delay, int exitDelay) {
+    addStep(p, delay, 0, "u\r");
+    addStep(p, delay, 0, "#t %c\r", '0' + (int) gal);
+    addStep(p, exitDelay, 0, "#e\r");
+}
+
+AfbResult afbEraseStart(AfbProgrammer* p, AfbGalType gal, char all) {
+    AfbResult r = beginOperation(p, "", 0);
+    if (r != AFB_OK) {
+        return r;
+    }
+    addSetType(p, gal, 300, 100);
+    addGalStep(p, 4000, AFB_CMD_CHECK, all ? "~\r" : "c\r");
+    return startOperation(p);
+}
+
+int afbEncodeUploadLine(const AfbDesign* d, int fuse, char* buf, char* fuseSet) {
+    int totalFuses = afbGalInfo[d->gal].fuses + (d->apdFuse ? 1 : 0);
+    int pos = sprintf(buf, "#f %04i ", fuse);
+    int j;
+
+    *fuseSet = 0;
+    for (j = 0; j < 4 && fuse < totalFuses; j++) {
+        int k;
+        unsigned char f = 0;
+        for (k = 0; k < 8 && fuse < totalFuses; k++, fuse++) {
+            if (jedecGetFuse(&d->jedec, fuse)) {
+                f |= (1 << k);
+                *fuseSet = 1;
+            }
+        }
+        pos += sprintf(buf + pos, "%02X", f);
+    }
+    return fuse;
+}
+
+// Uploads fusemap in byte format (as opposed to bit format used in JEDEC file).
+// Lines without any fuse set are not sent.
+static void addUpload(AfbProgrammer* p, const AfbDesign* d) {
+    AfbStep* s;
+    char buf[AFB_UPLOAD_LINE_SIZE];
+    int totalFuses = afbGalInfo[d->gal].fuses;
+    int i;
+
+    if (d->apdFuse) {
+        totalFuses++;
+    }
+
+    // Start  upload
+    addStep(p, 20, 0, "u\r");
+
+    //device type
+    addStep(p, 300, 0, "#t %c %s\r", '0' + (int) d->gal, afbGalInfo[d->gal].name);
+
+    //fuse map
+    for (i = 0; i < totalFuses;) {
+        char fuseSet;
+
+        i = afbEncodeUploadLine(d, i, buf, &fuseSet);
+        //the line contains at least one fuse set to 1
+        if (fuseSet) {
+            s = addStep(p, 100, 0, "%s\r", buf);
+            if (s != NULL) {
+                s->progress = i;
+            }
+        }
+    }
+
+    //checksum
+    if (p->verbose) {
+        output(p, "sending csum: %04X\n", jedecChecksum(&d->jedec, totalFuses));
+    }
+    addStep(p, 300, 0, "#c %04X\r", jedecChecksum(&d->jedec, totalFuses));
+
+    //end of upload
+    s = addStep(p, 300, AFB_CMD_CHECK, "#e\r");
+    if (s != NULL) {
+        s->progress = totalFuses;
+    }
+}
+
+// sets the power-down fuse, uploads the fuse map and writes and / or verifies it
+AfbResult afbWriteStart(AfbProgrammer* p, const AfbDesign* d, char write, char verify) {
+    AfbResult r;
+
+    if (d->gal == AFB_GAL_UNKNOWN || afbGalInfo[d->gal].id0 == AFB_JTAG_ID) {
+        return AFB_ERR_ARGS;
+    }
+    r = beginOperation(p, "", afbGalInfo[d->gal].fuses + (d->apdFuse ? 1 : 0));
+    if (r != AFB_OK) {
+        return r;
+    }
+    // set power-down fuse bit (do it before upload to correctly calculate check-sum)
+    addStep(p, 4000, AFB_CMD_CHECK, d->apdFuse ? "z\r" : "Z\r");
+    addUpload(p, d);
+    if (write) {
+        addGalStep(p, 18000, AFB_CMD_CHECK, "w\r");
+    }
+    if (verify) {
+        addGalStep(p, 18000, AFB_CMD_CHECK, "v\r");
+    }
+    return startOperation(p);
+}
+
+// reads the fuse map, the programmer's output is passed to the output callback
+AfbResult afbReadStart(AfbProgrammer* p, AfbGalType gal) {
+    AfbResult r = beginOperation(p, "", 0);
+    if (r != AFB_OK) {
+        return r;
+    }
+    // ensure the texts are discarded by waiting 1000 ms
+    addSetType(p, gal, 100, 1000);
+    addGalStep(p, 22000, AFB_CMD_CHECK | AFB_CMD_PRINT, "r\r");
+    return startOperation(p);
+}
+
+AfbResult afbInfoStart(AfbProgrammer* p) {
+    AfbResult r = beginOperation(p, "", 0);
+    if (r != AFB_OK) {
+        return r;
+    }
+    addGalStep(p, 4000, AFB_CMD_CHECK | AFB_CMD_PRINT, "p\r");
+    return startOperation(p);
+}
+
+AfbResult afbWritePesStart(AfbProgrammer* p, AfbGalType gal, const char* pes) {
+    AfbResult r = beginOperation(p, "", 0);
+    if (r != AFB_OK) {
+        return r;
+    }
+    if (pes == NULL || strlen(pes) > MAX_COMMAND - 8) {
+        return AFB_ERR_ARGS;
+    }
+    addStep(p, 300, 0, "u\r");
+    addStep(p, 300, 0, "#t %c\r", '0' + (int) gal);
+    //set new PES
+    addStep(p, 300, 0, "#p %s\r", pes);
+    //Exit upload mode (ensure the return texts are discarded by waiting 100 ms)
+    addStep(p, 100, 0, "#e\r");
+    addGalStep(p, 4000, AFB_CMD_CHECK, "P\r");
+    return startOperation(p);
+}
@@ -0,0 +1,248 @@
+/*
+
+ LIBAFTERBURNER : programmer connection and GAL operations
+
+ part of Afterburner GAL project
+
+ The library can be embedded into other programs (link libafterburner.c
+ and jedec.c, see compile_lib.sh). All state is kept in handles, so one
+ process can drive several programmers:
+
+   AfbProgrammer* p = afbCreate();
+   AfbDesign* d = malloc(sizeof(AfbDesign)); // ~5 KB, too big for a small stack
+   if (p == NULL || d == NULL) {
+       ... out of memory
+   }
+   afbSetCallbacks(p, myProgress, myOutput, myData);
+   if (afbOpen(p, "/dev/ttyUSB0") == AFB_OK &&
+       afbDesignLoadFile(d, AFB_GAL22V10, "design.jed") == AFB_OK) {
+       afbWriteStart(p, d, 1, 1);
+       while (afbPoll(p) == AFB_PENDING) {
+           ... do other work, poll other programmers
+       }
+   }
+   afbDestroy(p);
+   free(d);
+
+The *Start() calls only queue the operation. afbPoll() sends the commands
+and reads the responses without waiting, afbWait() polls until the
+operation is finished. On Windows the serial port reads have a 30 ms
+timeout, so afbPoll() may block for that time.
+
+*/
+
+#pragma once
+
+#include "jedec.h"
+
+#define AFB_JTAG_ID 0xFF
+
+typedef enum {
+    AFB_OK = 0,
+    AFB_PENDING = 1,            // the operation is in progress
+    AFB_ERR_DEVICE = -1,        // the programmer reported an error (ER response)
+    AFB_ERR_OPEN = -2,          // the serial port can not be opened
+    AFB_ERR_IO = -3,            // serial port read / write failed
+    AFB_ERR_NO_PROGRAMMER = -4, // no Afterburner programmer responded
+    AFB_ERR_BUSY = -5,          // another operation is in progress
+    AFB_ERR_ARGS = -6,          // invalid parameters
+    AFB_ERR_FILE = -7,          // the file can not be read
+    AFB_ERR_PARSE = -8,         // the JEDEC file is invalid
+    AFB_ERR_MEMORY = -9,        // out of memory or the response is too large
+} AfbResult;
+
+typedef enum {
+    AFB_GAL_UNKNOWN,
+    AFB_GAL16V8,
+    AFB_GAL18V10,
+    AFB_GAL20V8,
+    AFB_GAL20RA10,
+    AFB_GAL20XV10,
+    AFB_GAL22V10,
+    AFB_GAL26CV12,
+    AFB_GAL26V12,
+    AFB_GAL6001,
+    AFB_GAL6002,
+    AFB_ATF16V8B,
+    AFB_ATF20V8B,
+    AFB_ATF22V10B,
+    AFB_ATF22V10C,
+    AFB_ATF750C,
+    AFB_PEEL18CV8,
+    //jtag based PLDs at the end: they do not have a gal type in MCU software
+    AFB_ATF1502AS,
+    AFB_ATF1504AS,
+} AfbGalType;
+
+/* GAL info */
+typedef struct {
+    AfbGalType type;
+    unsigned char id0, id1; /* variant 1, variant 2 (eg. 16V8=0x00, 16V8A+=0x1A)*/
+    char *name;       /* pointer to chip name               */
+    int fuses;        /* total number of fuses              */
+    int pins;         /* number of pins on chip             */
+    int rows;         /* number of fuse rows                */
+    int bits;         /* number of fuses per row            */
+    int uesrow;       /* UES row number                     */
+    int uesfuse;      /* first UES fuse number              */
+    int uesbytes;     /* number of UES bytes                */
+    int eraserow;     /* row adddeess for erase             */
+    int eraseallrow;  /* row address for erase all          */
+    int pesrow;       /* row address for PES read/write     */
+    int pesbytes;     /* number of PES bytes                */
+    int cfgrow;       /* row address of config bits         */
+    int cfgbits;      /* number of config bits              */
+} AfbGalInfo;
+
+extern const AfbGalInfo afbGalInfo[];
+extern const int afbGalInfoCount;
+
+// programmer features announced in the identification banner
+#define AFB_FEATURE_VAR_VPP   1
+#define AFB_FEATURE_BIG_RAM   2
+#define AFB_FEATURE_JTAG_ISP  4
+#define AFB_FEATURE_XSVF_PACK 8
+#define AFB_FEATURE_TIMING    16
+#define AFB_FEATURE_EXE_BATCH 32
+#define AFB_FEATURE_EXE_SIG   64
+#define AFB_FEATURE_VPP_LOG   128
+
+// status codes of the programmer's error responses ("ER<code> text"), see afterburner.ino
+#define AFB_STATUS_NONE              0
+#define AFB_STATUS_UPLOAD_FAILED     1
+#define AFB_STATUS_GAL_INDEX         2
+#define AFB_STATUS_CHECKSUM          3
+#define AFB_STATUS_UPLOAD_COMMAND    4
+#define AFB_STATUS_PES_WRITE         5
+#define AFB_STATUS_VERIFY            6
+#define AFB_STATUS_GAL_TYPE          7
+#define AFB_STATUS_NO_FUSES          8
+#define AFB_STATUS_UNSUPPORTED       9
+#define AFB_STATUS_NO_VAR_VPP       10
+#define AFB_STATUS_UPLOAD_ABORTED   11
+#define AFB_STATUS_UNKNOWN_GAL      12
+#define AFB_STATUS_CAL_OFFSET       13
+#define AFB_STATUS_UNKNOWN_COMMAND  14
+#define AFB_STATUS_VPP_CHECK        15
+#define AFB_STATUS_VPP_CALIBRATION  16
+#define AFB_STATUS_EXERCISE         17
+#define AFB_STATUS_EXERCISE_MISMATCH 18
+#define AFB_STATUS_VPP_SETTLE       19
+#define AFB_STATUS_OTHER            99  // error response without a code (older firmware)
+
+// afbCommandStart() flags
+#define AFB_CMD_CHECK  1  // 'ER' response fails the operation
+#define AFB_CMD_PRINT  2  // the response is passed to the output callback
+#define AFB_CMD_STREAM 4  // the response is passed to the output callback while it is received
+
+#define AFB_UPLOAD_LINE_SIZE 32          // "#f NNNN " and 4 bytes in hex
+
+// parsed design
+typedef struct {
+    JedecFile jedec;
+    AfbGalType gal;
+    char apdFuse;                       // power-down fuse is set (ATF16V8B, ATF22V10C)
+    unsigned short calculatedChecksum;  // compare with jedec.checksum
+} AfbDesign;
+
+// Trace file of the serial traffic, see afbSetTrace() and aftrace.c. It starts with
+// AFB_TRACE_MAGIC followed by records: type (1 byte), time since the previous record
+// in microseconds (4 bytes), data size (2 bytes), data. Numbers are little endian.
+#define AFB_TRACE_MAGIC "AFBTRC1\n"
+#define AFB_TRACE_MAGIC_SIZE 8
+#define AFB_TRACE_HEADER_SIZE 7
+#define AFB_TRACE_OPEN  'O'     // the serial device was opened, data: device name
+#define AFB_TRACE_WRITE 'W'     // bytes sent to the programmer
+#define AFB_TRACE_READ  'R'     // bytes received from the programmer, a record without data
+                                // marks the last read that received nothing before the data
+
+// time spent by one programmer command in microseconds, see afbSetTiming()
+typedef struct {
+    char command;       // 'w' write, 'v' verify, 'r' read, 'c' / '~' erase, 'p' info, 'P' write PES
+    long total;
+    long shift;         // bit shifting and the rest of the command
+    long power;         // power on / off delays
+    long vpp;           // VPP switching and settle
+    long strobe;        // programming / erase pulses
+    long serial;        // printing of the fuse map or PES
+    long typeCheck;     // PES type check, overlaps the phases above
+    long powerUps;      // power on cycles, -1: not reported by the firmware
+} AfbTiming;
+
+#define AFB_VPP_LOG_SAMPLES 32      // the longest waveform sent by the firmware
+
+// VPP during one programming or erase pulse in 10mV units, see afbSetVppLog()
+typedef struct {
+    char command;       // GAL command of the pulse, as in AfbTiming
+    int pulse;          // index of the pulse within the command
+    int ms;             // pulse length
+    int samples;        // ADC samples taken during the pulse
+    int min;
+    int max;
+    int mean;
+    int slotUs;         // waveform: time slot of each sample, 0: the firmware did not keep it
+    int waveCount;
+    int wave[AFB_VPP_LOG_SAMPLES];  // first sample of each slot, -1: none
+} AfbVppPulse;
+
+typedef struct AfbProgrammer AfbProgrammer;
+
+// called when the operation progresses: current / total
+typedef void (*AfbProgressFunc)(void* user, const char* label, int current, int total);
+// called with the programmer responses and the library messages
+typedef void (*AfbOutputFunc)(void* user, const char* text);
+
+AfbResult afbDesignLoadFile(AfbDesign* d, AfbGalType gal, const char* fileName);
+AfbResult afbDesignLoadBuffer(AfbDesign* d, AfbGalType gal, const char* data, long size);
+// Encodes the "#f" upload line of up to 32 fuses from 'fuse' into 'buf' (AFB_UPLOAD_LINE_SIZE bytes),
+// returns the index of the next fuse. A line with no fuse set ('fuseSet' 0) is not sent.
+int afbEncodeUploadLine(const AfbDesign* d, int fuse, char* buf, char* fuseSet);
+
+AfbProgrammer* afbCreate(void);
+void afbDestroy(AfbProgrammer* p);
+void afbSetCallbacks(AfbProgrammer* p, AfbProgressFunc progress, AfbOutputFunc output, void* user);
+void afbSetVerbose(AfbProgrammer* p, char verbose);
+// 1: the timing of each GAL command is queried and collected (programmer with AFB_FEATURE_TIMING)
+void afbSetTiming(AfbProgrammer* p, char enable);
+int afbGetTimingCount(const AfbProgrammer* p);
+// timing of the collected GAL command 'index' (0 .. afbGetTimingCount() - 1), NULL if out of range
+const AfbTiming* afbGetTiming(const AfbProgrammer* p, int index);
+// drops the collected timings, e.g. before the next operation of a long running session
+void afbClearTimings(AfbProgrammer* p);
+// records all bytes sent and received into the trace file, NULL stops the recording
+AfbResult afbSetTrace(AfbProgrammer* p, const char* fileName);
+// 1: the VPP log of each GAL command is queried and collected (programmer with AFB_FEATURE_VPP_LOG).
+// The capture itself is switched on by the 'L1' command.
+void afbSetVppLog(AfbProgrammer* p, char enable);
+int afbGetVppPulseCount(const AfbProgrammer* p);
+const AfbVppPulse* afbGetVppPulse(const AfbProgrammer* p, int index);
+AfbResult afbOpen(AfbProgrammer* p, const char* deviceName);
+void afbClose(AfbProgrammer* p);
+int afbIsOpen(const AfbProgrammer* p);
+int afbGetFeatures(const AfbProgrammer* p);
+const char* afbGetVersion(const AfbProgrammer* p);
+const char* afbGetResultText(AfbResult result);
+// monotonic time in milliseconds
+long afbTimeMs(void);
+
+// non-blocking operations: call afbPoll() or afbWait() to finish them
+AfbResult afbCommandStart(AfbProgrammer* p, const char* command, int maxDelay, int flags);
+AfbResult afbSetGalCheckStart(AfbProgrammer* p, char check);
+AfbResult afbSetGalTypeStart(AfbProgrammer* p, AfbGalType gal);
+AfbResult afbEraseStart(AfbProgrammer* p, AfbGalType gal, char all);
+AfbResult afbWriteStart(AfbProgrammer* p, const AfbDesign* d, char write, char verify);
+AfbResult afbReadStart(AfbProgrammer* p, AfbGalType gal);
+AfbResult afbInfoStart(AfbProgrammer* p);
+AfbResult afbWritePesStart(AfbProgrammer* p, AfbGalType gal, const char* pes);
+AfbResult afbPoll(AfbProgrammer* p);
+AfbResult afbWait(AfbProgrammer* p);
+// a command was sent and its response is awaited: the caller can sleep before the next afbPoll()
+int afbIsWaiting(const AfbProgrammer* p);
+const char* afbGetResponse(const AfbProgrammer* p);
+// AFB_STATUS_xxx and the text of the error response that failed the last operation
+int afbGetStatus(const AfbProgrammer* p);
+const char* afbGetStatusText(const AfbProgrammer* p);
+
+// raw access for streamed protocols (JTAG player)
+int afbWriteRaw(AfbProgrammer* p, const char* data, int size);
+int afbReadRaw(AfbProgrammer* p, char* buf, int size);
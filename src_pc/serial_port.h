@@ -14,6 +14,7 @@ char guessedSerialDevice[512] = {0};
 
 #ifdef NO_CLOSE
 static SerialDeviceHandle serH = INVALID_HANDLE;
+static char serHName[256];
 #endif
 
 // ideas: https://stackoverflow.com/questions/1388871/how-do-i-get-a-list-of-available-serial-ports-in-win32
@@ -62,7 +63,8 @@ static inline SerialDeviceHandle serialDeviceOpen(char* deviceName) {
     SerialDeviceHandle h;
 
 #ifdef NO_CLOSE
-    if (serH != INVALID_HANDLE) {
+    // the handle is kept open for the device, other devices are opened normally
+    if (serH != INVALID_HANDLE && 0 == strcmp(serHName, deviceName)) {
         return serH;
     }
 #endif
@@ -121,6 +123,7 @@ static inline SerialDeviceHandle serialDeviceOpen(char* deviceName) {
         result = PurgeComm(h, PURGE_RXCLEAR | PURGE_TXCLEAR | PURGE_RXABORT | PURGE_TXABORT);
 #ifdef NO_CLOSE
         serH = h;
+        snprintf(serHName, sizeof(serHName), "%s", deviceName);
 #endif
         return h;
     } else {
@@ -186,6 +189,7 @@ static inline int serialDeviceRead(SerialDeviceHandle deviceHandle, char* buffer
 #define INVALID_HANDLE -1
 #ifdef NO_CLOSE
 static SerialDeviceHandle serH = INVALID_HANDLE;
+static char serHName[256];
 #endif
 
 
@@ -240,7 +244,8 @@ static inline SerialDeviceHandle serialDeviceOpen(char* deviceName) {
 
     SerialDeviceHandle h;
 #ifdef NO_CLOSE
-    if (serH != INVALID_HANDLE) {
+    // the handle is kept open for the device, other devices are opened normally
+    if (serH != INVALID_HANDLE && 0 == strcmp(serHName, deviceName)) {
         return serH;
     }
 #endif
@@ -269,6 +274,7 @@ static inline SerialDeviceHandle serialDeviceOpen(char* deviceName) {
         tcflush(h, TCIOFLUSH); //flush both queues
 #ifdef NO_CLOSE
         serH = h;
+        snprintf(serHName, sizeof(serHName), "%s", deviceName);
 #endif
         return h;
     } else {